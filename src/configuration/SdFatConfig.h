@@ -220,7 +220,7 @@
  *   }
  */
 #ifndef USE_BLOCK_DEVICE_INTERFACE
-#define USE_BLOCK_DEVICE_INTERFACE 0
+#define USE_BLOCK_DEVICE_INTERFACE 1
 #endif  // USE_BLOCK_DEVICE_INTERFACE
 //------------------------------------------------------------------------------
 /**
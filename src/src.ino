@@ -32,7 +32,13 @@ void setup() {
         system_reboot_with_display();
     }
 
-    load_directory(current_directory);
+    album_art.begin();
+    audio.load_meta_cache();
+    if (!library.begin(ROOT)) {
+        Serial.println("Library index failed");
+        display.display_text("Library error", 0, 0);
+    }
+    load_album(current_album);
 
     Serial.println(F("╚════════════════════════════════════════════════════╝"));
     display.display_png(StaticBg, sizeof(StaticBg));
@@ -40,26 +46,26 @@ void setup() {
 
     view_help();
 
-    if (!audio.player.begin()) {
+    audio.player.setAutoNext(true);
+    if (!audio.start()) {
         Serial.println("Failed to start player");
         while(1);
     }
-    audio.player.setVolume(current_volume);
-    audio.player.setAutoNext(true);
+    audio.set_volume(current_volume);
 }
 
 void loop() {
-    audio.player.copy();
-
+    // Decoding and I2S output run in their own tasks (see AudioManager)
     handle_serial();
     handle_touch();
     handle_keypad();
+    library_poll();
 
     // Progress bar update
     unsigned long now = millis();
     float current_time = audio.get_current_time();
 
-    if (audio.player.isActive() &&
+    if (audio.is_active() &&
         (now - last_progress_update_ms >= PROGRESS_UPDATE_INTERVAL_MS ||
          fabsf(current_time - last_reported_time_s) >= 1.0f)) {
 
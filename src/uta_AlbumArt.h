@@ -0,0 +1,335 @@
+#pragma once
+
+#include <new>
+#include <JPEGDEC.h>
+#include <PNGdec.h>
+#include "uta_SDCard.h"
+#include "uta_MetaParser.h"
+
+// Cover art for the playing track.
+//
+// The metadata parsers only record where the embedded JPEG/PNG (APIC frame
+// or FLAC PICTURE block) sits in the file. When a track starts, the art
+// task streams that byte range through the decoder's file callbacks, so
+// the image is never held in RAM. JPEGs are decoded with JPEGDEC's
+// DCT-domain scaling (1/2, 1/4, 1/8 of the IDCT work) to the smallest
+// size that is still at least ART_SIZE, then nearest-neighbour sampled
+// into an ART_SIZE box; PNGs are sampled row by row. The RGB565 result is
+// written to /.uta/art/<album hash>.565 as one pre-allocated (contiguous)
+// file, so the next visit to that album is a single read.
+//
+// The task runs on the display core at the lowest UI priority and takes
+// the SD lock per read, so the audio core never waits on it. A newer
+// request aborts a decode in progress.
+
+#define ART_DIR            "/.uta/art"
+#define ART_MAGIC          0x41415455u   // "UTAA"
+#define ART_SIZE           300           // thumbnail box, pixels
+#define ART_X              ((MAX_IMAGE_WIDTH - ART_SIZE) / 2)
+#define ART_Y              (ALBUM_Y + 40)
+#define ART_MAX_SOURCE_W   2048          // PNG line buffer
+#define UTA_ART_CORE       1
+#define UTA_ART_PRIORITY   1
+
+extern DisplayManager display;
+
+struct ArtFileHeader {
+  uint32_t magic;
+  uint16_t width;
+  uint16_t height;
+};
+
+class AlbumArt {
+public:
+  bool begin() {
+    size_t bytes = sizeof(ArtFileHeader) + ART_SIZE * ART_SIZE * sizeof(uint16_t);
+    thumb = (uint8_t*)heap_caps_malloc(bytes, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    line  = (uint16_t*)heap_caps_malloc(ART_MAX_SOURCE_W * sizeof(uint16_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    void* j = heap_caps_malloc(sizeof(JPEGDEC), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    void* p = heap_caps_malloc(sizeof(PNG), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    request_mutex = xSemaphoreCreateMutex();
+    if (!thumb || !line || !j || !p || !request_mutex) {
+      Serial.println("[WARN] Album art disabled (no PSRAM)");
+      return false;
+    }
+    jpeg = new (j) JPEGDEC();
+    png  = new (p) PNG();
+
+    xTaskCreatePinnedToCore(art_task, "AlbumArt", 8192, this,
+                            UTA_ART_PRIORITY, &task_handle, UTA_ART_CORE);
+    return task_handle != nullptr;
+  }
+
+  // Called when a track starts; only copies the request and returns
+  void show(const char* path, const MetaPicture& picture) {
+    if (!task_handle || !path) return;
+    xSemaphoreTake(request_mutex, portMAX_DELAY);
+    strncpy(req_path, path, sizeof(req_path) - 1);
+    req_path[sizeof(req_path) - 1] = '\0';
+    req_picture = picture;
+    req_serial++;
+    xSemaphoreGive(request_mutex);
+    xTaskNotifyGive(task_handle);
+  }
+
+private:
+  struct Source {
+    FsFile   file;
+    uint64_t base   = 0;
+    uint32_t length = 0;
+    uint32_t pos    = 0;
+  };
+
+  TaskHandle_t      task_handle   = nullptr;
+  SemaphoreHandle_t request_mutex = nullptr;
+  char              req_path[256] = {};
+  MetaPicture       req_picture;
+  volatile uint32_t req_serial    = 0;
+  uint32_t          serial        = 0;     // request being worked on
+
+  uint8_t*  thumb = nullptr;               // ArtFileHeader + pixels, as stored on the card
+  uint16_t* line  = nullptr;
+  JPEGDEC*  jpeg  = nullptr;
+  PNG*      png   = nullptr;
+  Source    src;
+
+  uint64_t shown_key = 0;
+  bool     shown     = false;
+  int      src_w = 0, src_h = 0;           // decoder output size
+  int      out_w = 0, out_h = 0;           // thumbnail size
+
+  uint16_t* pixels() { return (uint16_t*)(thumb + sizeof(ArtFileHeader)); }
+  bool      stale() const { return req_serial != serial; }
+
+  // One thumbnail per album folder
+  static uint64_t album_key(const char* path) {
+    const char* slash = strrchr(path, '/');
+    size_t len = slash ? slash - path : 0;
+    char dir[256];
+    if (len >= sizeof(dir)) len = sizeof(dir) - 1;
+    memcpy(dir, path, len);
+    dir[len] = '\0';
+    return meta_path_hash(dir);
+  }
+
+  static void cache_path(uint64_t key, char* out, size_t cap) {
+    snprintf(out, cap, ART_DIR "/%08lx%08lx.565", (unsigned long)(key >> 32), (unsigned long)key);
+  }
+
+  // Whole file in one read straight into the thumbnail buffer
+  bool load_cached(uint64_t key) {
+    char path[48];
+    cache_path(key, path, sizeof(path));
+    size_t cap = sizeof(ArtFileHeader) + ART_SIZE * ART_SIZE * sizeof(uint16_t);
+
+    SdLock lock;
+    FsFile file = sd.open(path, O_RDONLY);
+    if (!file) return false;
+    uint64_t size = file.fileSize();
+    bool ok = size >= sizeof(ArtFileHeader) && size <= cap && file.read(thumb, size) == (int)size;
+    file.close();
+
+    const auto* h = (const ArtFileHeader*)thumb;
+    ok = ok && h->magic == ART_MAGIC && h->width <= ART_SIZE && h->height <= ART_SIZE &&
+         size == sizeof(ArtFileHeader) + (uint32_t)h->width * h->height * sizeof(uint16_t);
+    if (ok) {
+      out_w = h->width;
+      out_h = h->height;
+    }
+    return ok;
+  }
+
+  void store_cached(uint64_t key) {
+    char path[48];
+    cache_path(key, path, sizeof(path));
+    auto* h   = (ArtFileHeader*)thumb;
+    h->magic  = ART_MAGIC;
+    h->width  = out_w;
+    h->height = out_h;
+    size_t size = sizeof(ArtFileHeader) + (size_t)out_w * out_h * sizeof(uint16_t);
+
+    SdLock lock;
+    if (!sd.exists(ART_DIR) && !sd.mkdir(ART_DIR, true)) return;
+    FsFile file = sd.open(path, O_WRONLY | O_CREAT | O_TRUNC);
+    if (!file) return;
+    file.preAllocate(size);
+    bool ok = file.write(thumb, size) == size;
+    file.close();
+    if (!ok) sd.remove(path);
+  }
+
+  // Output size: fit (w, h) into the ART_SIZE box, never upscaling
+  bool fit(int w, int h) {
+    if (w <= 0 || h <= 0) return false;
+    src_w = w;
+    src_h = h;
+    int longest = w > h ? w : h;
+    int target  = longest < ART_SIZE ? longest : ART_SIZE;
+    out_w = (int)((int64_t)w * target / longest);
+    out_h = (int)((int64_t)h * target / longest);
+    if (out_w < 1) out_w = 1;
+    if (out_h < 1) out_h = 1;
+    return true;
+  }
+
+  // Copies the output pixels whose nearest source lies in this block
+  void place(const uint16_t* block, int x, int y, int w, int h) {
+    int oy = (int)(((int64_t)y * out_h + src_h - 1) / src_h);
+    int ox0 = (int)(((int64_t)x * out_w + src_w - 1) / src_w);
+    uint16_t* out = pixels();
+    for (; oy < out_h; oy++) {
+      int sy = (int)((int64_t)oy * src_h / out_h);
+      if (sy >= y + h) break;
+      const uint16_t* row = block + (sy - y) * w;
+      for (int ox = ox0; ox < out_w; ox++) {
+        int sx = (int)((int64_t)ox * src_w / out_w);
+        if (sx >= x + w) break;
+        out[oy * out_w + ox] = row[sx - x];
+      }
+    }
+  }
+
+  // File callbacks shared by JPEGDEC and PNGdec (same handle layout)
+  static void* open_cb(const char*, int32_t* size) {
+    Source* s = &instance->src;
+    s->pos = 0;
+    *size  = (int32_t)s->length;
+    return s;
+  }
+  static void close_cb(void*) {}
+
+  template <typename F>
+  static int32_t read_cb(F* f, uint8_t* buf, int32_t len) {
+    auto* s = (Source*)f->fHandle;
+    if (len > (int32_t)(s->length - s->pos)) len = s->length - s->pos;
+    if (len <= 0) return 0;
+    int n;
+    {
+      SdLock lock;
+      n = s->file.seekSet(s->base + s->pos) ? s->file.read(buf, len) : -1;
+    }
+    if (n <= 0) return 0;
+    s->pos += n;
+    f->iPos = s->pos;
+    return n;
+  }
+
+  template <typename F>
+  static int32_t seek_cb(F* f, int32_t position) {
+    auto* s = (Source*)f->fHandle;
+    if (position < 0 || (uint32_t)position > s->length) return -1;
+    s->pos  = position;
+    f->iPos = position;
+    return position;
+  }
+
+  static int jpeg_draw(JPEGDRAW* d) {
+    auto* art = (AlbumArt*)d->pUser;
+    art->place(d->pPixels, d->x, d->y, d->iWidth, d->iHeight);
+    vTaskDelay(1);
+    return art->stale() ? 0 : 1;
+  }
+
+  static int png_draw(PNGDRAW* d) {
+    auto* art = (AlbumArt*)d->pUser;
+    art->png->getLineAsRGB565(d, art->line, PNG_RGB565_BIG_ENDIAN, 0xffffffff);
+    art->place(art->line, 0, d->y, d->iWidth, 1);
+    if (d->y % 16 == 15) vTaskDelay(1);
+    return art->stale() ? 0 : 1;
+  }
+
+  bool decode(const char* path, const MetaPicture& picture) {
+    {
+      SdLock lock;
+      if (!src.file.open(path, O_RDONLY)) return false;
+    }
+    src.base   = picture.offset;
+    src.length = picture.length;
+    bool ok = false;
+
+    if (picture.format == META_PICTURE_JPEG) {
+      if (jpeg->open("art", open_cb, close_cb, read_cb<JPEGFILE>, seek_cb<JPEGFILE>, jpeg_draw)) {
+        int w = jpeg->getWidth(), h = jpeg->getHeight();
+        int scale = 1;
+        while (scale < 8 && (w > h ? w : h) / (scale * 2) >= ART_SIZE) scale *= 2;
+        int option = scale == 8 ? JPEG_SCALE_EIGHTH : scale == 4 ? JPEG_SCALE_QUARTER :
+                     scale == 2 ? JPEG_SCALE_HALF : 0;
+
+        if (fit(w / scale, h / scale)) {
+          jpeg->setPixelType(RGB565_BIG_ENDIAN);
+          jpeg->setUserPointer(this);
+          ok = jpeg->decode(0, 0, option) && !stale();
+        }
+        jpeg->close();
+      }
+    } else if (picture.format == META_PICTURE_PNG) {
+      if (png->open("art", open_cb, close_cb, read_cb<PNGFILE>, seek_cb<PNGFILE>, png_draw) == PNG_SUCCESS) {
+        if (png->getWidth() <= ART_MAX_SOURCE_W && fit(png->getWidth(), png->getHeight())) {
+          ok = png->decode(this, 0) == PNG_SUCCESS && !stale();
+        }
+        png->close();
+      }
+    }
+
+    SdLock lock;
+    src.file.close();
+    return ok;
+  }
+
+  void draw() {
+    if (out_w < ART_SIZE || out_h < ART_SIZE) {
+      display.restore_background(ART_X, ART_Y, ART_SIZE, ART_SIZE);
+    }
+    display.draw_image(ART_X + (ART_SIZE - out_w) / 2, ART_Y + (ART_SIZE - out_h) / 2,
+                       out_w, out_h, pixels());
+  }
+
+  void handle(const char* path, const MetaPicture& picture) {
+    uint64_t key = album_key(path);
+    if (shown && key == shown_key) return;
+
+    uint32_t t0 = millis();
+    if (load_cached(key)) {
+      draw();
+      Serial.printf("[INFO] Album art from cache: %dx%d (%lu ms)\n", out_w, out_h, millis() - t0);
+    } else if (picture.format != META_PICTURE_NONE && decode(path, picture)) {
+      store_cached(key);
+      draw();
+      Serial.printf("[INFO] Album art decoded: %dx%d -> %dx%d (%lu ms)\n",
+                    src_w, src_h, out_w, out_h, millis() - t0);
+    } else {
+      if (stale()) return;
+      if (shown) display.restore_background(ART_X, ART_Y, ART_SIZE, ART_SIZE);
+      shown = false;
+      return;
+    }
+    shown     = true;
+    shown_key = key;
+  }
+
+  static void art_task(void* arg) {
+    auto* art = (AlbumArt*)arg;
+    instance  = art;
+    char path[sizeof(art->req_path)];
+    MetaPicture picture;
+
+    while (true) {
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+      while (art->serial != art->req_serial) {
+        xSemaphoreTake(art->request_mutex, portMAX_DELAY);
+        memcpy(path, art->req_path, sizeof(path));
+        picture     = art->req_picture;
+        art->serial = art->req_serial;
+        xSemaphoreGive(art->request_mutex);
+
+        art->handle(path, picture);
+      }
+    }
+  }
+
+  static AlbumArt* instance;
+};
+
+AlbumArt* AlbumArt::instance = nullptr;
+
+AlbumArt album_art;
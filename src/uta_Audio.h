@@ -9,6 +9,85 @@
 #include "AudioTools/AudioCodecs/CodecWAV.h"
 #include "AudioTools/Concurrency/RTOS.h"
 #include "uta_SDCard.h"
+#include "uta_ReadAhead.h"
+#include "uta_RingBuffer.h"
+#include "uta_MetaCache.h"
+#include "uta_MetaParser.h"
+#include "uta_Seek.h"
+#include "uta_Mp3Info.h"
+#include "uta_Probe.h"
+#include "uta_TrackText.h"
+#include "uta_AlbumArt.h"
+#include "uta_Gain.h"
+#include "uta_Clock.h"
+#include "uta_Resampler.h"
+
+// PCM ring between the decode task and the I2S writer (power of two, PSRAM)
+#ifndef UTA_PCM_RING_BYTES
+#define UTA_PCM_RING_BYTES      (256 * 1024)
+#endif
+// Writer (re)starts draining once this many bytes are queued
+#ifndef UTA_PCM_START_WATERMARK
+#define UTA_PCM_START_WATERMARK (64 * 1024)
+#endif
+// Below this fill level we report the buffer as running low
+#ifndef UTA_PCM_LOW_WATERMARK
+#define UTA_PCM_LOW_WATERMARK   (16 * 1024)
+#endif
+#define UTA_PCM_CHUNK_BYTES     2048
+// Track starts / seeks the writer can have pending: several short gapless
+// tracks can sit in the ring at once. When full, the newest is overwritten.
+#ifndef UTA_TRACK_MARKS
+#define UTA_TRACK_MARKS         16
+#endif
+static_assert(UTA_TRACK_MARKS >= 2, "the newest mark is overwritten while the writer reads the oldest");
+
+// Fixed 48 kHz / 32-bit output through the resampler (BYPASS, FAST, HQ),
+// so tracks at different rates don't re-initialise I2S
+#ifndef UTA_RESAMPLE_MODE
+#define UTA_RESAMPLE_MODE       RESAMPLE_BYPASS
+#endif
+
+// Loudness normalisation: default mode and pre-amplification (1/100 dB)
+#ifndef UTA_REPLAYGAIN_MODE
+#define UTA_REPLAYGAIN_MODE     REPLAYGAIN_ALBUM
+#endif
+#ifndef UTA_REPLAYGAIN_PREAMP
+#define UTA_REPLAYGAIN_PREAMP   0
+#endif
+
+// Parsed metadata kept in PSRAM, persisted to the card every few inserts
+#ifndef UTA_META_CACHE_ENTRIES
+#define UTA_META_CACHE_ENTRIES  512
+#endif
+static_assert((UTA_META_CACHE_ENTRIES & (UTA_META_CACHE_ENTRIES - 1)) == 0,
+              "UTA_META_CACHE_ENTRIES is also the bucket count and must be a power of two");
+static_assert(UTA_META_CACHE_ENTRIES > 0 && UTA_META_CACHE_ENTRIES < META_CACHE_NONE,
+              "UTA_META_CACHE_ENTRIES must fit a 16-bit entry index");
+#define UTA_META_CACHE_PATH     "/.uta/meta.cache"
+#define UTA_META_CACHE_SAVE_AFTER 16
+
+// Tag parsing reads the file head into one window instead of field by field
+#ifndef UTA_META_WINDOW_BYTES
+#define UTA_META_WINDOW_BYTES   (16 * 1024)
+#endif
+
+// Longest track path kept for the staged track and the MP3 scan request
+#define UTA_PATH_BYTES          512
+
+// Pre-open the next track and trim to the container's exact sample count
+#ifndef UTA_GAPLESS
+#define UTA_GAPLESS 1
+#endif
+
+#define UTA_DECODE_CORE         0
+#define UTA_DECODE_PRIORITY     3
+#define UTA_WRITER_CORE         0
+#define UTA_WRITER_PRIORITY     6
+#define UTA_MP3_SCAN_CORE       0
+#define UTA_MP3_SCAN_PRIORITY   1
+#define UTA_MP3_SCAN_MARKS      1024
+#define UTA_MP3_SCAN_STACK      8192   // meta_parse_id3v2() alone keeps ~2 KB of text on the stack
 
 extern DisplayManager display;
 
@@ -58,39 +137,172 @@ void formatDuration(float seconds, char* buffer, size_t bufSize = 12) {
 
 class AudioManager {
 public:
+  struct Metadata {
+    TrackText   text;                   // title / artist / album, inline
+    float       duration      = 0.0f;
+    uint64_t    total_samples = 0;      // exact PCM frame count when the container says so
+    uint64_t    audio_offset  = 0;      // first audio byte after any leading tags
+    uint64_t    stream_start  = 0;      // "fLaC" / "RIFF", past leading ID3v2 tags
+    AudioFormat format        = AUDIO_FORMAT_UNKNOWN;   // from the content, not the name
+    uint32_t    stream_bytes  = 0;      // MP3: audio payload the TOC refers to
+    MetaPicture art;                    // embedded cover, located but not loaded
+    ReplayGain  replaygain;             // loudness tags (ReplayGain / R128)
+    bool        has_toc       = false;
+    bool        needs_scan    = false;  // MP3: VBR without header, duration estimated
+    uint8_t     toc[MP3_TOC_ENTRIES];
+
+    const char* title() const  { return text.get(TrackText::TITLE); }
+    const char* artist() const { return text.get(TrackText::ARTIST); }
+    const char* album() const  { return text.get(TrackText::ALBUM); }
+  };
 
 protected:
 
-  class UtaI2S : public I2SStream {
+  // Output of the AudioPlayer: decoded PCM is queued here and drained into
+  // i2s by the writer task, so slow UI work never starves the DMA.
+  class PcmRingStream : public AudioStream {
   public:
-    uint64_t bytes_written = 0;
+    explicit PcmRingStream(AudioManager& owner) : owner(owner) {}
+
+    size_t write(const uint8_t* data, size_t len) override {
+      size_t accepted = len;
 
-    size_t write(const uint8_t* buffer, size_t size) override {
-      size_t res      = I2SStream::write(buffer, size);
-      bytes_written  += res;
+      AudioInfo info     = audioInfo();
+      size_t frame_bytes = info.channels * pcm_sample_bytes(info.bits_per_sample);
+
+      // First PCM of a new track: tell the writer where it starts
+      if (track_mark_pending) {
+        track_mark_pending = false;
+        owner.push_mark(0, next_replaygain);
+      }
 
-      return res;
+      // After a seek: drop the head of the frame we landed on. Gapless:
+      // drop decoder padding past the container's exact length.
+      len = pcm_trim(data, len, frame_bytes, skip_frames, frames_left);
+
+      if (owner.resampler.active() && frame_bytes > 0) {
+        while (len >= frame_bytes) {
+          size_t frames = min(len / frame_bytes, RESAMPLE_BLOCK);
+          size_t out    = owner.resampler.process(data, frames, info.bits_per_sample, info.channels);
+          queue((const uint8_t*)owner.resampler.output(), out * RESAMPLE_OUT_FRAME_BYTES);
+          data += frames * frame_bytes;
+          len  -= frames * frame_bytes;
+        }
+      } else {
+        queue(data, len);
+      }
+      return accepted;
     }
 
-    float getAudioCurrentTime() {
-      auto info = audioInfo();
-      if (info.sample_rate == 0) 
-        return 0.0f;
-      int byte_rate = info.sample_rate * info.channels * (info.bits_per_sample / 8);
+    int availableForWrite() override {
+      return owner.ring.free_space();
+    }
 
-      return byte_rate > 0 ? (float)bytes_written / byte_rate : 0.0f;
+    // `info` is the decoder's format; the ring and I2S run at the output
+    // format, which only differs when the resampler takes this rate
+    void setAudioInfo(AudioInfo info) override {
+      AudioStream::setAudioInfo(info);
+      if (owner.resampler.configure((ResampleMode)owner.rs_mode, info.sample_rate)) {
+        info = AudioInfo(RESAMPLE_OUT_RATE, RESAMPLE_OUT_CHANNELS, 32);
+      }
+      owner.request_reconfigure(info);
     }
 
-    void resetBytesWritten() {
-      bytes_written = 0;
+  private:
+    AudioManager& owner;
+
+    void queue(const uint8_t* data, size_t len) {
+      size_t done = 0;
+      while (done < len) {
+        size_t n = owner.ring.write(data + done, len - done);
+        if (n == 0) {
+          owner.producer_stalls++;
+          vTaskDelay(1);
+          continue;
+        }
+        done += n;
+      }
     }
   };
 
-  static FsFile audio_file;
-  static FsFile meta_file;
+  struct StagedTrack {
+    FsFile   file;
+    Metadata meta;
+    char     path[UTA_PATH_BYTES] = {};
+    int      for_index = -1;
+    bool     ready     = false;
+  };
+
+  static FsFile        audio_file;
+  static ReadAheadFile audio_stream;   // what the decoder actually reads
   static bool played;
 
-  static UtaI2S i2s;
+  static StagedTrack  staged;
+  static bool         gapless;
+  static uint64_t     frames_left;
+  static uint64_t     skip_frames;
+
+  static ReplayGain    next_replaygain;         // opened track, not yet queued
+  static volatile bool track_mark_pending;
+
+  static MetaCache    meta_cache;
+  static bool         meta_cache_ready;
+  static uint32_t     meta_cache_dirty;
+  static uint8_t      meta_window[UTA_META_WINDOW_BYTES];
+
+  static TaskHandle_t  mp3_scan_handle;
+  static char          mp3_scan_path[UTA_PATH_BYTES];   // requested, under the SD lock
+  static char          mp3_scan_file[UTA_PATH_BYTES];   // being scanned, task only
+  static volatile bool mp3_scan_pending;
+  static uint8_t*      mp3_scan_window;
+  static uint32_t*     mp3_scan_marks;
+
+  static I2SStream i2s;
+
+  PcmRingBuffer     ring;
+  PcmRingStream     pcm_out{*this};
+  uint8_t*          ring_storage = nullptr;
+
+  SemaphoreHandle_t player_mutex        = nullptr;
+  TaskHandle_t      decode_task_handle  = nullptr;
+  TaskHandle_t      writer_task_handle  = nullptr;
+
+  volatile bool     producer_idle       = true;
+  volatile bool     flush_pending       = false;
+  volatile bool     reconfigure_pending = false;
+  AudioInfo         pending_info;
+
+  size_t            start_watermark     = UTA_PCM_START_WATERMARK;
+  size_t            low_watermark       = UTA_PCM_LOW_WATERMARK;
+  volatile size_t   min_fill            = UTA_PCM_RING_BYTES;
+  volatile uint32_t underruns           = 0;
+  volatile uint32_t low_water_hits      = 0;
+  volatile uint32_t producer_stalls     = 0;
+
+  // Where a track (or a seek within it) begins in the ring. The writer
+  // switches loudness gain and restarts the clock exactly there, so the
+  // tail of the previous track keeps its own gain and time.
+  struct TrackMark {
+    size_t     at;
+    uint32_t   start_frame;
+    ReplayGain replaygain;
+  };
+  TrackMark         track_marks[UTA_TRACK_MARKS];
+  volatile uint32_t track_marks_head    = 0;      // under player_mutex
+  volatile uint32_t track_marks_tail    = 0;      // writer task
+  ReplayGain        playing_replaygain;           // writer task
+  uint32_t          loudness_gain       = GAIN_UNITY;
+  OutputGain        output_gain;                  // writer task, ramps changes
+  volatile uint32_t volume_gain         = GAIN_UNITY;
+  volatile uint8_t  rg_mode             = UTA_REPLAYGAIN_MODE;   // ReplayGainMode
+  volatile bool     loudness_dirty      = false;
+
+  Resampler         resampler;                    // decode task
+  volatile uint8_t  rs_mode             = UTA_RESAMPLE_MODE;     // ResampleMode
+
+  PlaybackClock           clock;
+  PlaybackClock::Snapshot clock_state;            // writer task
+  size_t                  dma_bytes       = 0;    // I2S DMA queue depth
 
   MultiDecoder      decoder;
   FLACDecoderFoxen  flac_decoder;
@@ -98,39 +310,32 @@ protected:
   AACDecoderHelix   aac_decoder;
   WAVDecoder        wav_decoder;
 
+  // Hands MultiDecoder the probed format so it never runs its own detector
+  class ProbedMime : public MimeSource {
+  public:
+    const char* mime() override { return probe_mime(current_track.format); }
+  };
+  ProbedMime        probed_mime;
+
+
+  static ReadAheadFile* file_to_stream(const char* path, ReadAheadFile& old_file) {
+    SdLock lock;
 
-  static FsFile* file_to_stream(const char* path, FsFile& old_file) {
+    audio_stream.close();
 
     if (old_file.isOpen()) {
       old_file.close();
     }
+    if (audio_file.isOpen()) {
+      audio_file.close();
+    }
 
-    i2s.resetBytesWritten();
-    reset_current_time();
     current_duration = 0.0f;
+    frames_left      = UINT64_MAX;
+    skip_frames      = 0;
 
-    current_track.artist.clear();
-    current_track.title.clear();
-    current_track.album.clear();
-
-    String fullPath = String(path);
-    String filename = fullPath.substring(fullPath.lastIndexOf('/') + 1);
-    filename.toLowerCase();
-
-    const char* supported[] = { ".mp3", ".flac", ".wav" };
-    bool isSupported = false;
-    for (const char* ext : supported) {
-      if (filename.endsWith(ext)) {
-        isSupported = true;
-        break;
-      }
-    }
-
-    if (!isSupported) {
-      Serial.printf(" Skipping non-audio: %s\n", filename.c_str());
-      audio_file.open("");
-      return &audio_file;
-    }
+    const char* filename = strrchr(path, '/');
+    filename = filename ? filename + 1 : path;
 
     if (played) {
       Serial.println();
@@ -145,372 +350,639 @@ protected:
       played = true;
     }
 
-    Serial.printf(" File: %s\n", filename.c_str());
+    Serial.printf(" File: %s\n", filename);
 
-    FsFile meta_file;
-    bool metadata_ok = false;
+    // Gapless: the decode task already opened and parsed this one.
+    // Otherwise the one handle is parsed and then given to the decoder.
+    bool from_stage = staged.ready && strcmp(staged.path, path) == 0;
+    if (from_stage) {
+      audio_file    = std::move(staged.file);
+      current_track = staged.meta;
+      Serial.println(" Pre-opened (gapless)");
+    } else if (!audio_file.open(path)) {
+      Serial.println();
+      Serial.println(F(" ERROR: Cannot open audio file!"));
+      Serial.println(F("        File may be unsupported."));
+      Serial.println(F("══════════════════════════════════════════════════════════════\n"));
 
-    if (meta_file.open(path)) {
-      extract_metadata(meta_file, path);
-      meta_file.close();
+      // Trick the player to automatically skip stuff
+      return &audio_stream;
+    } else if (lookup_cached(path, audio_file, current_track)) {
+      Serial.println(" Metadata from cache");
     } else {
-      Serial.println(" Failed to open file for metadata");
+      current_track = Metadata{};
+      extract_metadata(audio_file, current_track);
+      remember_cached(path, audio_file, current_track);
+    }
+    discard_staged();
+
+    if (!probe_playable(current_track.format)) {
+      Serial.printf(" Skipping unsupported format: %s\n", probe_name(current_track.format));
+      Serial.println(F("══════════════════════════════════════════════════════════════\n"));
+      audio_file.close();
+      return &audio_stream;
+    }
+
+    audio_stream.attach(&audio_file, decoder_offset(current_track));
+
+    current_duration = current_track.duration;
+    next_replaygain    = current_track.replaygain;
+    track_mark_pending = true;
+    if (current_track.needs_scan) request_mp3_scan(path);
+    if (gapless && current_track.total_samples > 0) {
+      frames_left = current_track.total_samples;
     }
 
     // Fallback: use filename if no title
-    if (current_track.title.isEmpty())  current_track.title   = getFileStem(path);
-    if (current_track.artist.isEmpty()) current_track.artist  = "Unknown Artist";
-    if (current_track.album.isEmpty())  current_track.album   = "Unknown Album";
+    TrackText& text = current_track.text;
+    if (text.empty(TrackText::TITLE))  text.set(TrackText::TITLE, getFileStem(path));
+    if (text.empty(TrackText::ARTIST)) text.set(TrackText::ARTIST, "Unknown Artist");
+    if (text.empty(TrackText::ALBUM))  text.set(TrackText::ALBUM, "Unknown Album");
 
     Serial.println(F("──────────────────────────────────────────────────────────────"));
-    Serial.printf(" Title  : %s\n", current_track.title.c_str());
-    Serial.printf(" Artist : %s\n", current_track.artist.c_str());
-    Serial.printf(" Album  : %s\n", current_track.album.c_str());
+    Serial.printf(" Title  : %s\n", current_track.title());
+    Serial.printf(" Artist : %s\n", current_track.artist());
+    Serial.printf(" Album  : %s\n", current_track.album());
+    if (current_track.duration > 0) {
+      char duration_str[12];
+      formatDuration(current_track.duration, duration_str, sizeof(duration_str));
+      Serial.printf(" Length : %s\n", duration_str);
+    }
+    const ReplayGain& rg = current_track.replaygain;
+    if (rg.flags & RG_HAS_TRACK) Serial.printf(" Gain   : %+.2f dB track\n", rg.track_cdb / 100.0f);
+    if (rg.flags & RG_HAS_ALBUM) Serial.printf(" Gain   : %+.2f dB album\n", rg.album_cdb / 100.0f);
     Serial.println(F("──────────────────────────────────────────────────────────────"));
 
-    display.display_text(current_track.title.c_str(), 0, TITLE_Y);
-    display.display_text(current_track.artist.c_str(), 0, ARTIST_Y);
+    display.display_text(current_track.title(), 0, TITLE_Y);
+    display.display_text(current_track.artist(), 0, ARTIST_Y);
+    album_art.show(path, current_track.art);
 
-    if (!audio_file.open(path)) {
-      Serial.println();
-      Serial.println(F(" ERROR: Cannot open audio file!"));
-      Serial.println(F("        File may be unsupported."));
-      Serial.println(F("══════════════════════════════════════════════════════════════\n"));
+    Serial.printf(" Format: %s\n", probe_name(current_track.format));
 
-      // Trick the player to automatically skip stuff
-      audio_file.open("");
-      return &audio_file;
+    Serial.println(F("══════════════════════════════════════════════════════════════\n"));
+
+    return &audio_stream;
+  }
+
+  // Opens and parses the track after the current one while the current one
+  // is still playing, so the boundary only costs a decoder restart which the
+  // PCM ring covers.
+  void stage_next_track() {
+    SdLock lock;
+    int current = source.index();
+    if (staged.for_index == current) return;
+
+    discard_staged();
+    staged.for_index = current;
+
+    const char* path = tracks.path(current + 1);
+    if (!path || !staged.file.open(path)) return;
+
+    if (!lookup_cached(path, staged.file, staged.meta)) {
+      extract_metadata(staged.file, staged.meta);
+      remember_cached(path, staged.file, staged.meta);
+    }
+    if (!probe_playable(staged.meta.format)) {
+      discard_staged();
+      staged.for_index = current;
+      return;
     }
 
+    // Pull the first audio sectors in now rather than at the boundary
+    uint64_t start = decoder_offset(staged.meta);
+    uint8_t preroll[512];
+    staged.file.seekSet(start);
+    staged.file.read(preroll, sizeof(preroll));
+    staged.file.seekSet(start);
 
-    if      (filename.endsWith(".flac"))  Serial.println(" Format: FLAC (Lossless)");
-    else if (filename.endsWith(".mp3"))   Serial.println(" Format: MP3");
-    else if (filename.endsWith(".wav"))   Serial.println(" Format: WAV (Uncompressed)");
+    copy_path(staged.path, path);
+    staged.ready = true;
+  }
 
-    Serial.println(F("══════════════════════════════════════════════════════════════\n"));
+  // FAT date << 16 | time of the last write
+  static uint32_t file_modified(FsFile& file) {
+    uint16_t date = 0, time = 0;
+    file.getModifyDateTime(&date, &time);
+    return ((uint32_t)date << 16) | time;
+  }
+
+  // `file` is the open track; an entry parsed from a different size or
+  // modification time of it (retagged, replaced) counts as a miss
+  static bool lookup_cached(const char* path, FsFile& file, Metadata& track) {
+    if (!meta_cache_ready) return false;
+
+    const MetaCacheEntry* e = meta_cache.find(meta_path_hash(path), (uint32_t)file.fileSize(),
+                                              file_modified(file));
+    if (!e) return false;
+
+    track.text.set(TrackText::TITLE, e->title);
+    track.text.set(TrackText::ARTIST, e->artist);
+    track.text.set(TrackText::ALBUM, e->album);
+    track.duration      = e->duration_ms / 1000.0f;
+    track.total_samples = e->total_samples;
+    track.audio_offset  = e->audio_offset;
+    track.stream_start  = e->stream_start;
+    track.stream_bytes  = e->stream_bytes;
+    track.has_toc       = e->flags & META_CACHE_HAS_TOC;
+    track.needs_scan    = e->flags & META_CACHE_NEEDS_SCAN;
+    track.format        = (AudioFormat)e->format;
+    track.art           = MetaPicture{};
+    if ((e->flags & (META_CACHE_ART_JPEG | META_CACHE_ART_PNG)) && e->art_length > 0) {
+      track.art.offset = e->art_offset;
+      track.art.length = e->art_length;
+      track.art.format = (e->flags & META_CACHE_ART_JPEG) ? META_PICTURE_JPEG : META_PICTURE_PNG;
+    }
+    track.replaygain            = ReplayGain{};
+    track.replaygain.track_cdb  = e->rg_track_cdb;
+    track.replaygain.album_cdb  = e->rg_album_cdb;
+    track.replaygain.track_peak = e->rg_track_peak;
+    track.replaygain.album_peak = e->rg_album_peak;
+    if (e->flags & META_CACHE_RG_TRACK) track.replaygain.flags |= RG_HAS_TRACK;
+    if (e->flags & META_CACHE_RG_ALBUM) track.replaygain.flags |= RG_HAS_ALBUM;
+    if (track.has_toc) memcpy(track.toc, e->toc, MP3_TOC_ENTRIES);
+    return true;
+  }
 
-    return &audio_file;
+  static void remember_cached(const char* path, FsFile& file, const Metadata& track) {
+    if (!meta_cache_ready) return;
+
+    MetaCacheEntry* e = meta_cache.insert(meta_path_hash(path));
+    e->file_size     = (uint32_t)file.fileSize();
+    e->file_modified = file_modified(file);
+    e->set_title(track.title());
+    e->set_artist(track.artist());
+    e->set_album(track.album());
+    e->duration_ms   = (uint32_t)(track.duration * 1000.0f);
+    e->total_samples = track.total_samples;
+    e->audio_offset  = (uint32_t)track.audio_offset;
+    e->stream_start  = (uint32_t)track.stream_start;
+    e->stream_bytes  = track.stream_bytes;
+    e->format        = track.format;
+    e->flags         = (track.has_toc ? META_CACHE_HAS_TOC : 0) | (track.needs_scan ? META_CACHE_NEEDS_SCAN : 0);
+    e->art_offset    = (uint32_t)track.art.offset;
+    e->art_length    = track.art.length;
+    if      (track.art.format == META_PICTURE_JPEG) e->flags |= META_CACHE_ART_JPEG;
+    else if (track.art.format == META_PICTURE_PNG)  e->flags |= META_CACHE_ART_PNG;
+    e->rg_track_cdb  = track.replaygain.track_cdb;
+    e->rg_album_cdb  = track.replaygain.album_cdb;
+    e->rg_track_peak = track.replaygain.track_peak;
+    e->rg_album_peak = track.replaygain.album_peak;
+    if (track.replaygain.flags & RG_HAS_TRACK) e->flags |= META_CACHE_RG_TRACK;
+    if (track.replaygain.flags & RG_HAS_ALBUM) e->flags |= META_CACHE_RG_ALBUM;
+    if (track.has_toc) memcpy(e->toc, track.toc, MP3_TOC_ENTRIES);
+    meta_cache_dirty++;
   }
 
-  static void get_vorbis_data(FsFile& file, uint32_t size) {
-    uint32_t vendor_len;
-    if (file.read(&vendor_len, 4) != 4) return;
+  static void copy_path(char (&dst)[UTA_PATH_BYTES], const char* src) {
+    strncpy(dst, src, UTA_PATH_BYTES - 1);
+    dst[UTA_PATH_BYTES - 1] = '\0';
+  }
 
-    file.seek(file.position() + vendor_len);
+  static void discard_staged() {
+    SdLock lock;
+    if (staged.file.isOpen()) staged.file.close();
+    staged.meta  = Metadata{};
+    staged.path[0] = '\0';
+    staged.ready   = false;
+    staged.for_index = -1;
+  }
 
-    uint32_t comment_count;
-    if (file.read(&comment_count, 4) != 4) return;
+  // Feeds the parser from an open file
+  class FsMetaReader : public MetaReader {
+  public:
+    explicit FsMetaReader(FsFile& file) : file(file) {}
 
-    const size_t max_buffer_size = 256;
-    for (uint32_t i = 0; i < comment_count; i++) {
-      uint32_t len;
-      if (file.read(&len, 4) != 4) break;
+    size_t read_at(uint64_t offset, uint8_t* dst, size_t len) override {
+      if (!file.seekSet(offset)) return 0;
+      int n = file.read(dst, len);
+      return n > 0 ? n : 0;
+    }
 
-      size_t read_len = min(len, max_buffer_size);
-      char buf[read_len + 1];
-      if (file.read(buf, read_len) != read_len) break;
-      buf[read_len] = '\0';
+    uint64_t size() override { return file.fileSize(); }
 
-      String entry = String(buf);
-      if      (entry.startsWith("TITLE=")) current_track.title = entry.substring(6);
-      else if (entry.startsWith("title=")) current_track.title = entry.substring(6);
+  private:
+    FsFile& file;
+  };
 
-      if      (entry.startsWith("ARTIST=")) current_track.artist = entry.substring(7);
-      else if (entry.startsWith("artist=")) current_track.artist = entry.substring(7);
+  class TrackSink : public MetaSink {
+  public:
+    explicit TrackSink(Metadata& track) : track(track) {}
 
-      if      (entry.startsWith("ALBUM=")) current_track.album = entry.substring(6);
-      else if (entry.startsWith("album=")) current_track.album = entry.substring(6);
+    void on_tag(const char* key, const char* value, size_t len) override {
+      if      (strcmp(key, "TITLE") == 0)  track.text.set(TrackText::TITLE, value, len);
+      else if (strcmp(key, "ARTIST") == 0) track.text.set(TrackText::ARTIST, value, len);
+      else if (strcmp(key, "ALBUM") == 0)  track.text.set(TrackText::ALBUM, value, len);
+      else rg_parse_tag(key, value, len, track.replaygain);
     }
-  }
 
-  static bool get_flac_metadata(FsFile& file) {
-    file.seek(0);
-    char sig[4];
-    if (file.read(sig, 4) != 4 || strncmp(sig, "fLaC", 4) != 0) {
-      Serial.println("[WARN] Not a FLAC file");
-      return false;
+  private:
+    Metadata& track;
+  };
+
+  // Caller holds the SD lock, which also guards meta_window
+  static void extract_metadata(FsFile& file, Metadata& track) {
+    FsMetaReader reader(file);
+    MetaWindow   window(reader, meta_window, UTA_META_WINDOW_BYTES);
+    TrackSink    sink(track);
+    MetaResult   result;
+
+    ProbeResult probe  = probe_format(window);
+    track.format       = probe.format;
+    track.stream_start = probe.start;
+
+    bool ok = false;
+    switch (track.format) {
+      case AUDIO_FORMAT_FLAC: ok = meta_parse_flac(window, sink, result, probe.start); break;
+      case AUDIO_FORMAT_MP3:
+      case AUDIO_FORMAT_AAC:  ok = meta_parse_mp3(window, sink, result);  break;   // ID3 tags
+      case AUDIO_FORMAT_WAV:  ok = meta_parse_riff(window, sink, result, probe.start); break;
+      default: return;
     }
 
-    bool last_block = false;
-    while (!last_block) {
-      uint8_t header[4];
-      if (file.read(header, 4) != 4) break;
+    if (!ok) {
+      Serial.printf("[WARN] Could not parse %s header\n", probe_name(track.format));
+      return;
+    }
 
-      last_block = header[0] & 0x80;
-      uint8_t block_type = header[0] & 0x7F;
-      uint32_t block_size = (header[1] << 16) | (header[2] << 8) | header[3];
+    track.duration      = result.duration;
+    track.total_samples = result.total_samples;
+    track.audio_offset  = result.audio_offset;
+    track.art           = result.picture;
 
-      if (block_type == 0) {
-        uint8_t buf[34];
+    if (track.format == AUDIO_FORMAT_MP3) {
+      Mp3Info mp3;
+      if (mp3_analyse(window, result.audio_offset, mp3)) apply_mp3_info(mp3, track);
+    }
+  }
 
-        if (file.read(buf, 34) != 34) return false;
-        uint32_t sample_rate = ((uint32_t)buf[10] << 12) | (buf[11] << 4) | ((buf[12] >> 4) & 0x0F);
-        uint8_t channels = ((buf[12] & 0x0E) >> 1) + 1;
-        uint8_t bps = (((buf[12] & 0x01) << 4) | ((buf[13] >> 4) & 0x0F)) + 1;
-        uint64_t total_samples = ((uint64_t)(buf[13] & 0x0F) << 32) | ((uint64_t)buf[14] << 24) | ((uint64_t)buf[15] << 16) | ((uint64_t)buf[16] << 8) | buf[17];
+  static void apply_mp3_info(const Mp3Info& mp3, Metadata& track) {
+    track.duration     = mp3.duration;
+    track.audio_offset = mp3.first_frame;
+    track.stream_bytes = (uint32_t)mp3.stream_bytes;
+    track.has_toc      = mp3.has_toc;
+    track.needs_scan   = mp3.needs_scan();
+    memcpy(track.toc, mp3.toc, MP3_TOC_ENTRIES);
+  }
 
-        current_duration = (float)total_samples / sample_rate;
+  static Mp3Info mp3_info_of(const Metadata& track) {
+    Mp3Info mp3;
+    mp3.first_frame  = track.audio_offset;
+    mp3.stream_bytes = track.stream_bytes;
+    mp3.duration     = track.duration;
+    mp3.has_toc      = track.has_toc;
+    memcpy(mp3.toc, track.toc, MP3_TOC_ENTRIES);
+    return mp3;
+  }
 
-        static char duration_str[12] = { 0 };
-        formatDuration(current_duration, duration_str, 12);
-        Serial.printf("\n Duration: [%s]\n", duration_str);
+  // Reader for the scan task: locks the card per read, so playback and the
+  // library scanner are only held up for one window at a time
+  class LockedFsReader : public FsMetaReader {
+  public:
+    using FsMetaReader::FsMetaReader;
 
-      } else if (block_type == 4) {
-        get_vorbis_data(file, block_size);
-        return true;
-      } else {
-        file.seek(file.position() + block_size);
-      }
+    size_t read_at(uint64_t offset, uint8_t* dst, size_t len) override {
+      SdLock lock;
+      return FsMetaReader::read_at(offset, dst, len);
     }
-    return false;
+  };
+
+  // Hands a VBR MP3 without a Xing/VBRI header to the scan task
+  static void request_mp3_scan(const char* path) {
+    if (!mp3_scan_handle) return;
+    copy_path(mp3_scan_path, path);
+    mp3_scan_pending = true;
+    xTaskNotifyGive(mp3_scan_handle);
   }
 
-  static bool get_mp3_id3v1_fallback(FsFile& file) {
-    if (file.size() < 128) return false;
-    file.seek(file.size() - 128);
-    char tag[3];
-    if (file.read(tag, 3) != 3 || strncmp(tag, "TAG", 3)) return false;
+  // Counts every frame of the requested file at low priority, then stores
+  // the exact duration and TOC in the cache and in the playing track
+  static void mp3_scan_task(void* arg) {
+    auto* am = (AudioManager*)arg;
+    while (true) {
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+      char*  path = mp3_scan_file;
+      FsFile file;
+      {
+        SdLock lock;
+        copy_path(path, mp3_scan_path);
+        mp3_scan_pending = false;
+        if (!file.open(path, O_RDONLY)) continue;
+      }
+
+      LockedFsReader reader(file);
+      MetaWindow     window(reader, mp3_scan_window, UTA_META_WINDOW_BYTES);
+      MetaResult     result;
+      Mp3Info        mp3;
+      class : public MetaSink {
+      public:
+        void on_tag(const char*, const char*, size_t) override {}
+      } no_tags;
+
+      uint32_t t0 = millis();
+      bool ok = meta_parse_mp3(window, no_tags, result) &&
+                mp3_analyse(window, result.audio_offset, mp3) &&
+                mp3_scan(window, mp3, mp3_scan_marks, UTA_MP3_SCAN_MARKS, [] {
+                  vTaskDelay(1);
+                  return !mp3_scan_pending;    // a newer request wins
+                });
+
+      xSemaphoreTake(am->player_mutex, portMAX_DELAY);
+      {
+        SdLock lock;
+        if (ok) {
+          Metadata cached;
+          if (lookup_cached(path, file, cached)) {
+            apply_mp3_info(mp3, cached);
+            remember_cached(path, file, cached);
+          }
+          const char* playing = am->tracks.path(am->source.index());
+          if (playing && strcmp(path, playing) == 0) {
+            apply_mp3_info(mp3, current_track);
+            current_duration = current_track.duration;
+          }
+          if (strcmp(staged.path, path) == 0) apply_mp3_info(mp3, staged.meta);
+        }
+        file.close();
+      }
+      xSemaphoreGive(am->player_mutex);
+
+      if (ok) {
+        Serial.printf("[INFO] MP3 scan: %lu frames, %.1f s (%lu ms)\n",
+                      mp3.frames, mp3.duration, millis() - t0);
+      }
+    }
+  }
 
-    char buf[125] = { 0 };
-    file.read((uint8_t*)buf, 125);
+  // Where the decoder should start reading. Helix resyncs on MP3 and ADTS
+  // frames, so the ID3v2 tag can be skipped; FLAC and WAV decoders need
+  // their headers, which start after any ID3v2 tag in front of them.
+  static uint64_t decoder_offset(const Metadata& track) {
+    bool framed = track.format == AUDIO_FORMAT_MP3 || track.format == AUDIO_FORMAT_AAC;
+    return framed ? track.audio_offset : track.stream_start;
+  }
 
-    char title[31] = { 0 }, artist[31] = { 0 }, album[31] = { 0 };
-    strncpy(title, buf + 3, 30);
-    strncpy(artist, buf + 33, 30);
-    strncpy(album, buf + 63, 30);
+  // Called from the decode task; blocks until everything queued in the old
+  // format has been played, then the writer switches the I2S format.
+  void request_reconfigure(AudioInfo info) {
+    if (!writer_task_handle) {
+      i2s.setAudioInfo(info);
+      return;
+    }
+    // Same format as what is playing: nothing to drain or restart
+    if (info == i2s.audioInfo()) return;
 
-    if (title[0])   current_track.title = String(title);
-    if (artist[0])  current_track.artist = String(artist);
-    if (album[0])   current_track.album = String(album);
+    pending_info        = info;
+    reconfigure_pending = true;
+    while (reconfigure_pending) vTaskDelay(1);
+  }
 
-    Serial.printf("- [ID3v1] %s - %s (%s)\n", current_track.artist.c_str(), current_track.title.c_str(), current_track.album.c_str());
+  // The codec still holds input and frame state from the old position, so
+  // it is restarted and given the stream header again before it sees the
+  // frame the seek landed on. Helix needs no header on MP3 and ADTS.
+  bool restart_decoder(MetaWindow& window) {
+    decoder.end();
+    decoder.begin();
+
+    if (current_track.format == AUDIO_FORMAT_FLAC) {
+      // "fLaC" and STREAMINFO alone, marked as the last metadata block
+      uint64_t start = decoder_offset(current_track);
+      const uint8_t* info = window.get(start + 8, 34);
+      if (!info) return false;
+      uint8_t header[4 + 4 + 34] = { 'f', 'L', 'a', 'C', 0x80, 0x00, 0x00, 34 };
+      memcpy(header + 8, info, 34);
+      decoder.write(header, sizeof(header));
+    } else if (current_track.format == AUDIO_FORMAT_WAV) {
+      // Everything from "RIFF" up to the first sample
+      uint64_t end = current_track.audio_offset;
+      for (uint64_t off = current_track.stream_start; off < end; ) {
+        size_t n = end - off < 512 ? (size_t)(end - off) : 512;
+        const uint8_t* p = window.get(off, n);
+        if (!p) return false;
+        decoder.write(p, n);
+        off += n;
+      }
+    }
     return true;
   }
 
-  static void estimate_mp3_duration(FsFile& file) {
-    file.seek(0);
-    uint8_t buf[1024];
-    size_t read = file.read(buf, sizeof(buf));
-    int sample_rate = 44100;
-    int bitrate = 128000;
-
-    for (int i = 0; i < read - 4; i++) {
-      if (buf[i] == 0xFF && (buf[i + 1] & 0xE0) == 0xE0) {
-        int version = (buf[i + 1] & 0x18) >> 3;
-        int sr_idx = (buf[i + 2] & 0x0C) >> 2;
-        int br_idx = (buf[i + 2] & 0xF0) >> 4;
-
-        static const int sr_table[3][3] = { 
-          { 44100, 48000, 32000 }, 
-          { 22050, 24000, 16000 }, 
-          { 11025, 12000, 8000 } 
-        };
-
-        static const int br_table[2][15] = {
-          { 0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448 },
-          { 0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256 }
-        };
-
-        sample_rate = sr_table[version == 3 ? 0 : (version == 2 ? 1 : 2)][sr_idx];
-        bitrate = br_table[version == 3 ? 0 : 1][br_idx] * 1000;
-        break;
+  bool seek_locked(float seconds) {
+    const char* path = tracks.path(source.index());
+    AudioInfo   info = pcm_out.audioInfo();
+    if (!path || !audio_file.isOpen() || info.sample_rate == 0) return false;
+
+    if (seconds < 0) seconds = 0;
+    if (current_duration > 0 && seconds > current_duration) seconds = current_duration;
+    uint64_t target = (uint64_t)(seconds * info.sample_rate);
+
+    SeekTarget st;
+    uint32_t   reads;
+    {
+      SdLock lock;
+      FsMetaReader reader(audio_file);
+      MetaWindow   window(reader, meta_window, UTA_META_WINDOW_BYTES);
+
+      bool found = false;
+      uint64_t start = current_track.stream_start;
+      if      (current_track.format == AUDIO_FORMAT_FLAC) found = flac_seek(window, target, st, start);
+      else if (current_track.format == AUDIO_FORMAT_WAV)  found = riff_seek(window, target, st, start);
+      else if (current_track.format == AUDIO_FORMAT_MP3 && current_track.has_toc) {
+        // TOC resolution only, so no head trim: treat the frame as the target
+        Mp3Frame frame;
+        uint64_t guess = mp3_toc_offset(mp3_info_of(current_track), seconds);
+        found = mp3_find_frame(window, guess, window.size(), st.offset, frame);
+        st.sample = target;
       }
+      if (!found) return false;
+
+      if (!restart_decoder(window)) return false;
+      reads = window.reads();
+      audio_stream.seek(st.offset);
     }
 
-    if (bitrate > 0) {
-      current_duration = (float)file.size() * 8 / bitrate;
-      Serial.printf("- Estimated Duration: %.2f s\n", current_duration);
+    flush_pcm();
+    skip_frames = target - st.sample;
+    if (frames_left != UINT64_MAX) {
+      uint64_t total = current_track.total_samples;
+      frames_left = total > target ? total - target : 0;
     }
+    push_mark((uint32_t)resampler.output_frames(target), current_track.replaygain);
+
+    Serial.printf("[INFO] Seek %.1f s: byte %llu, +%llu frames, %lu reads\n",
+                  seconds, st.offset, target - st.sample, reads);
+    return true;
   }
 
-  // Idk what does it do exactly, but basically just extract metadata
-  static bool get_mp3_metadata(FsFile& file) {
-    file.seek(0);
-    char header[10];
-    if (file.read(header, 10) != 10 || strncmp(header, "ID3", 3)) {
-      estimate_mp3_duration(file);
-      return false;
+  // Drops whatever is still queued, e.g. on stop or track skip
+  void flush_pcm() {
+    resampler.reset();
+    if (!writer_task_handle) return;
+    flush_pending = true;
+    while (flush_pending) vTaskDelay(1);
+  }
+
+  static void decode_task(void* arg) {
+    auto* am = (AudioManager*)arg;
+
+    while (true) {
+      size_t copied = 0;
+
+      xSemaphoreTake(am->player_mutex, portMAX_DELAY);
+      bool active = am->player.isActive();
+      // No SD lock here: the decoder reads from the read-ahead buffers, and
+      // opening the next track locks on its own
+      if (active) copied = am->player.copy();
+      xSemaphoreGive(am->player_mutex);
+
+      am->producer_idle = !active;
+      // Once the ring is comfortably full, use the slack to pre-open the next
+      // track and to flush new cache entries to the card
+      if (active && am->ring.available() >= am->start_watermark) {
+        xSemaphoreTake(am->player_mutex, portMAX_DELAY);
+        if (gapless) am->stage_next_track();
+        if (meta_cache_dirty >= UTA_META_CACHE_SAVE_AFTER) am->save_meta_cache();
+        xSemaphoreGive(am->player_mutex);
+      }
+
+      if (!active)          vTaskDelay(pdMS_TO_TICKS(10));
+      else if (copied == 0) vTaskDelay(1);
     }
+  }
 
-    uint32_t tagsize = ((header[6] & 0x7F) << 21) | ((header[7] & 0x7F) << 14) | ((header[8] & 0x7F) << 7) | (header[9] & 0x7F);
+  static void writer_task(void* arg) {
+    auto* am = (AudioManager*)arg;
+    alignas(16) static uint8_t chunk[UTA_PCM_CHUNK_BYTES];   // PIE loads are 16-byte aligned
+    bool streaming = false;
+    bool below_low = false;
 
-    size_t pos = 10;
-    while (pos < tagsize + 10 && pos + 10 < file.size()) {
-      char frame[4];
-      if (file.read((uint8_t*)frame, 4) != 4 || frame[0] == 0) break;
+    while (true) {
+      if (am->flush_pending) {
+        am->ring.discard();
+        streaming = false;
+        am->flush_pending = false;
+      }
 
-      uint32_t fsize;
-      file.read(&fsize, 4);
-      fsize = __builtin_bswap32(fsize);
-      file.seek(file.position() + 2);  // skip flags
+      size_t fill = am->ring.available();
 
-      if (fsize > 512) {
-        pos += 10 + fsize;
-        file.seek(pos);
+      if (am->reconfigure_pending && fill == 0) {
+        i2s.setAudioInfo(am->pending_info);
+        am->clock_state.queued = 0;     // the driver restarts with an empty DMA queue
+        streaming = false;
+        am->reconfigure_pending = false;
         continue;
       }
 
-      char* data = new char[fsize + 1];
-      file.read((char*)data, fsize);
-      data[fsize] = 0;
-
-      uint8_t enc_byte = (uint8_t)data[0];
-      int enc = enc_byte;
-      char* text_start = data + 1;
-      size_t avail_bytes = fsize - 1;
-      bool little_endian = false;
-      if (enc == 1 && avail_bytes >= 2) {
-        uint8_t bom1 = (uint8_t)text_start[0];
-        uint8_t bom2 = (uint8_t)text_start[1];
-        if ((bom1 == 0xFF && bom2 == 0xFE) || (bom1 == 0xFE && bom2 == 0xFF)) {
-          little_endian = (bom2 == 0xFE);
-          text_start += 2;
-          avail_bytes -= 2;
+      if (!streaming) {
+        // Prefill up to the start watermark unless the decoder is done
+        bool drain = am->producer_idle || am->reconfigure_pending;
+        if (fill == 0 || (fill < am->start_watermark && !drain)) {
+          vTaskDelay(1);
+          continue;
         }
+        streaming = true;
       }
 
-      size_t text_bytes;
-      if (enc == 3) {
-        text_bytes = avail_bytes;
-      } else {
-        int unit_size = (enc == 0) ? 1 : 2;
-        size_t num_units = avail_bytes / unit_size;
-        size_t units_to_term = 0;
-        const uint8_t* p = (const uint8_t*)text_start;
-        if (unit_size == 1) {
-          while (units_to_term < num_units && p[units_to_term] != 0) ++units_to_term;
-        } else {
-          while (units_to_term < num_units && (p[2 * units_to_term] != 0 || p[2 * units_to_term + 1] != 0)) ++units_to_term;
-        }
-        text_bytes = units_to_term * unit_size;
+      if (fill == 0) {
+        if (!am->producer_idle) am->underruns++;
+        streaming = false;
+        continue;
       }
 
-      String value;
-      if (enc == 3) {
-        value = String(text_start, text_bytes);
-      } else if (enc == 0) {
-        value = "";
-        const uint8_t* p = (const uint8_t*)text_start;
-        for (size_t i = 0; i < text_bytes; ++i) {
-          uint32_t ch = p[i];
-          if (ch == 0) break;
-          if (ch < 128) {
-            value += (char)ch;
-          } else {
-            value += (char)(0xC0 | (ch >> 6));
-            value += (char)(0x80 | (ch & 0x3F));
-          }
-        }
-      } else {  // UTF-16 (enc 1 or 2)
-        value = "";
-        const uint8_t* p = (const uint8_t*)text_start;
-        for (size_t i = 0; i < text_bytes / 2; ++i) {
-          uint8_t b1 = p[2 * i];
-          uint8_t b2 = p[2 * i + 1];
-          uint16_t ch = little_endian ? (b2 << 8 | b1) : (b1 << 8 | b2);
-          if (ch == 0) break;
-          if (ch < 0x80) {
-            value += (char)ch;
-          } else if (ch < 0x800) {
-            value += (char)(0xC0 | (ch >> 6));
-            value += (char)(0x80 | (ch & 0x3F));
-          } else {
-            value += (char)(0xE0 | (ch >> 12));
-            value += (char)(0x80 | ((ch >> 6) & 0x3F));
-            value += (char)(0x80 | (ch & 0x3F));
-          }
-        }
+      if (fill < am->min_fill) am->min_fill = fill;
+      if (fill < am->low_watermark) {
+        if (!below_low) am->low_water_hits++;
+        below_low = true;
+      } else {
+        below_low = false;
       }
 
-      if      (strncmp(frame, "TIT2", 4) == 0) current_track.title  = value;
-      else if (strncmp(frame, "TPE1", 4) == 0) current_track.artist = value;
-      else if (strncmp(frame, "TALB", 4) == 0) current_track.album  = value;
-
-      delete[] data;
-      pos += 10 + fsize;
-      file.seek(pos);
+      // Whole frames only, so a gain switch never splits a sample
+      AudioInfo info  = i2s.audioInfo();
+      size_t    frame = info.channels * pcm_sample_bytes(info.bits_per_sample);
+      size_t    want  = min(fill, sizeof(chunk));
+      if (frame > 0 && want >= frame) want -= want % frame;
+
+      size_t pos = am->ring.read_position();
+      size_t n   = am->ring.read(chunk, want);
+      am->process_chunk(chunk, n, pos, info);
+      i2s.write(chunk, n);
+      am->publish_clock(info, frame > 0 ? n / frame : 0);
     }
-
-    estimate_mp3_duration(file);
-    return true;
   }
 
-  static bool get_wav_metadata(FsFile& file) {
-    file.seek(0);
-    char riff[4];
-    if (file.read(riff, 4) != 4 || strncmp(riff, "RIFF", 4)) return false;
-
-    file.seek(20);
-    uint16_t format;
-    file.read(&format, 2);
-    if (format != 1) return false;  // PCM only
-
-    uint16_t channels;
-    file.read(&channels, 2);
-    uint32_t sample_rate;
-    file.read(&sample_rate, 4);
-    uint32_t byte_rate;
-    file.read(&byte_rate, 4);
-    file.seek(file.position() + 6);
-    uint16_t bits;
-    file.read(&bits, 2);
-
-    // Find data chunk
-    while (true) {
-      char chunk[4];
-      if (file.read(chunk, 4) != 4) break;
-      uint32_t size;
-      file.read(&size, 4);
-
-      if (strncmp(chunk, "data", 4) == 0) {
-        current_duration = size / (float)byte_rate;
-        Serial.printf("- Duration: %.2f s\n", current_duration);
-        break;
-      } else if (strncmp(chunk, "LIST", 4) == 0) {
-        char type[4];
-        file.read(type, 4);
-        if (strncmp(type, "INFO", 4) == 0) {
-          size_t end = file.position() + size - 4;
-          while (file.position() + 8 < end) {
-            char id[4];
-            file.read(id, 4);
-            uint32_t len;
-            file.read(&len, 4);
-            char* buf = new char[len + 1];
-            file.read((uint8_t*)buf, len);
-            buf[len && buf[len - 1] == 0 ? len - 1 : len] = 0;
-            String val = buf;
-            delete[] buf;
-
-            if (strncmp(id, "INAM", 4) == 0) current_track.title = val;
-            else if (strncmp(id, "IART", 4) == 0) current_track.artist = val;
-            else if (strncmp(id, "IPRD", 4) == 0) current_track.album = val;
-
-            if (len % 2) file.seek(file.position() + 1);
-          }
-        } else file.seek(file.position() + size - 4);
-      } else {
-        file.seek(file.position() + size);
-      }
+  // Decode task, before the first sample of a newly opened track is queued
+  // Producer side (decode task or a seek, both under player_mutex): the
+  // next byte queued is frame `start_frame` of a track. A mark at the same
+  // position as the previous one replaces it, e.g. repeated seeks while
+  // the ring is empty. When the queue is full the newest pending mark is
+  // overwritten, so the audio between it and this one keeps the gain and
+  // clock of the mark before it.
+  void push_mark(uint32_t start_frame, const ReplayGain& replaygain) {
+    size_t at = ring.write_position();
+    uint32_t head = track_marks_head;
+    if (head != track_marks_tail && track_marks[(head - 1) % UTA_TRACK_MARKS].at == at) {
+      head--;
+    } else if (head - track_marks_tail >= UTA_TRACK_MARKS) {
+      head--;
+      Serial.printf("[WARN] %d track starts pending; replacing the one at frame %lu\n",
+                    UTA_TRACK_MARKS, (unsigned long)track_marks[head % UTA_TRACK_MARKS].start_frame);
     }
-    return true;
+    TrackMark& m  = track_marks[head % UTA_TRACK_MARKS];
+    m.at          = at;
+    m.start_frame = start_frame;
+    m.replaygain  = replaygain;
+    track_marks_head = head + 1;
   }
 
+  // Writer task: volume and loudness gain as one fixed-point multiply,
+  // switching gain and restarting the clock exactly where a track or seek
+  // begins, and ramping gain on volume or mode changes
+  void process_chunk(uint8_t* pcm, size_t len, size_t pos, const AudioInfo& info) {
+    size_t frame_bytes = info.channels * pcm_sample_bytes(info.bits_per_sample);
 
-  static void extract_metadata(FsFile& file, const char* path) {
-    String ext = String(path);
-    ext.toLowerCase();
-    ext = ext.substring(ext.lastIndexOf('.') + 1);
+    if (loudness_dirty) {
+      loudness_dirty = false;
+      loudness_gain  = rg_gain(playing_replaygain, (ReplayGainMode)rg_mode, UTA_REPLAYGAIN_PREAMP);
+    }
 
-    if (ext == "flac") {
-      get_flac_metadata(file);
-    } else if (ext == "mp3") {
-      get_mp3_metadata(file);
-    } else if (ext == "wav") {
-      get_wav_metadata(file);
+    size_t done = 0;
+    while (done < len) {
+      size_t span = len - done;
+      if (track_marks_tail != track_marks_head) {
+        const TrackMark& m = track_marks[track_marks_tail % UTA_TRACK_MARKS];
+        ptrdiff_t until    = (ptrdiff_t)(m.at - (pos + done));
+        if (until <= 0) {
+          playing_replaygain = m.replaygain;
+          loudness_gain      = rg_gain(playing_replaygain, (ReplayGainMode)rg_mode, UTA_REPLAYGAIN_PREAMP);
+          output_gain.jump(gain_mul(volume_gain, loudness_gain));
+          clock_state.frame = clock_state.start = m.start_frame;
+          track_marks_tail++;
+          continue;
+        }
+        if ((size_t)until < span) span = until;
+      }
+      output_gain.ramp_to(gain_mul(volume_gain, loudness_gain));
+      output_gain.process(pcm + done, span, info.bits_per_sample, info.channels);
+      if (frame_bytes > 0) clock_state.frame += span / frame_bytes;
+      done += span;
     }
   }
 
+  // Writer task, after each I2S write. The write blocks while the DMA queue
+  // is full, so the queue is modelled as draining at the sample rate since
+  // the last write and topped up by this one, capped at its depth.
+  void publish_clock(const AudioInfo& info, size_t frames) {
+    size_t   frame_bytes = info.channels * pcm_sample_bytes(info.bits_per_sample);
+    uint32_t depth       = frame_bytes > 0 ? dma_bytes / frame_bytes : 0;
+    uint32_t now         = micros();
+
+    uint32_t queued = PlaybackClock::queued_at(clock_state, now) + frames;
+    clock_state.queued   = queued < depth ? queued : depth;
+    clock_state.rate     = info.sample_rate;
+    clock_state.stamp_us = now;
+    clock.publish(clock_state);
+  }
+
   static inline size_t min(size_t x, size_t y) {
     return (x < y) ? x : y;
   }
@@ -519,20 +991,87 @@ protected:
   }
 
 public:
-  static struct Metadata {
-    String title;
-    String artist;
-    String album;
-  } current_track;
+  static Metadata current_track;
 
   static float current_duration;
 
-  AudioSourceVector<FsFile> source;
+  // Mirrors the paths handed to the source so the next track can be looked up.
+  // All paths share one character arena, so the list grows only while a
+  // playlist is built and looking a path up never allocates.
+  class TrackList : public PathNamesRegistry {
+  public:
+    explicit TrackList(AudioSourceVector<ReadAheadFile>& source) : source(source) {}
+
+    void addName(const char* path) override {
+      starts.push_back(names.size());
+      names.insert(names.end(), path, path + strlen(path) + 1);
+      source.addName(path);
+    }
+
+    void clear() {
+      starts.clear();
+      names.clear();
+      source.clear();
+    }
+
+    int size() const { return starts.size(); }
+
+    const char* path(int index) const {
+      return (index >= 0 && index < size()) ? names.data() + starts[index] : nullptr;
+    }
+
+  private:
+    AudioSourceVector<ReadAheadFile>& source;
+    std::vector<uint32_t> starts;   // offset of each path in names
+    std::vector<char>     names;    // NUL-terminated paths back to back
+  };
+
+  AudioSourceVector<ReadAheadFile> source;
   AudioPlayer               player;
+  TrackList                 tracks;
+
+  // Cheap name filter for directory listings. Playback itself goes by the
+  // probed content, so a mislabeled file still plays or is skipped cleanly.
+  static bool is_supported(const char* path) {
+    const char* ext = strrchr(path, '.');
+    if (!ext || strchr(ext, '/')) return false;
+
+    const char* supported[] = { ".mp3", ".flac", ".wav", ".aac" };
+    for (const char* s : supported) {
+      if (strcasecmp(ext, s) == 0) return true;
+    }
+    return false;
+  }
+
+  // Parses tags and duration from an already open file (used by the library scanner)
+  static void read_metadata(FsFile& file, Metadata& track) {
+    extract_metadata(file, track);
+    file.seek(0);
+  }
+
+  struct MetaCacheStats {
+    uint16_t size;
+    uint16_t capacity;
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t evictions;
+  };
+
+  struct PcmStats {
+    size_t   capacity;
+    size_t   fill;
+    size_t   start_watermark;
+    size_t   low_watermark;
+    size_t   min_fill;
+    uint32_t underruns;
+    uint32_t low_water_hits;
+    uint32_t producer_stalls;
+  };
 
   AudioManager()
     : source(&AudioManager::file_to_stream)
-    , player(source, i2s, decoder) {}
+    , player(source, pcm_out, decoder)
+    , tracks(source) {}
 
   bool begin() {
     AudioLogger::instance().begin(Serial, AudioLogger::Warning);
@@ -542,23 +1081,229 @@ public:
     config.pin_ws           = 17;
     config.pin_data         = 18;
 
-    decoder.addDecoder(mp3_decoder, "audio/mpeg");
-    decoder.addDecoder(aac_decoder, "audio/aac");
-    decoder.addDecoder(wav_decoder, "audio/wav");
-    decoder.addDecoder(flac_decoder, "audio/flac");
+    decoder.addDecoder(mp3_decoder, probe_mime(AUDIO_FORMAT_MP3));
+    decoder.addDecoder(aac_decoder, probe_mime(AUDIO_FORMAT_AAC));
+    decoder.addDecoder(wav_decoder, probe_mime(AUDIO_FORMAT_WAV));
+    decoder.addDecoder(flac_decoder, probe_mime(AUDIO_FORMAT_FLAC));
+    decoder.setMimeSource(probed_mime);
 
     if (!i2s.begin(config)) {
       return false;
     }
+    dma_bytes = config.buffer_count * config.buffer_size;
+
+    player_mutex = xSemaphoreCreateMutex();
+    if (!player_mutex) {
+      Serial.println("[ERROR] Player mutex failed");
+      return false;
+    }
+
+    ring_storage = (uint8_t*)heap_caps_malloc(UTA_PCM_RING_BYTES, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!ring_storage || !ring.begin(ring_storage, UTA_PCM_RING_BYTES)) {
+      Serial.println("[ERROR] PCM ring allocation failed");
+      return false;
+    }
+
+    auto* cache_entries = (MetaCacheEntry*)heap_caps_malloc(UTA_META_CACHE_ENTRIES * sizeof(MetaCacheEntry),
+                                                            MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    auto* cache_buckets = (uint16_t*)heap_caps_malloc(UTA_META_CACHE_ENTRIES * sizeof(uint16_t),
+                                                      MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!cache_entries || !cache_buckets) {
+      Serial.println("[WARN] Metadata cache disabled (no PSRAM)");
+    } else {
+      meta_cache_ready = meta_cache.begin(cache_entries, UTA_META_CACHE_ENTRIES,
+                                          cache_buckets, UTA_META_CACHE_ENTRIES);
+      if (!meta_cache_ready) Serial.println("[WARN] Metadata cache disabled (configuration rejected)");
+    }
+    if (!meta_cache_ready) {
+      heap_caps_free(cache_entries);
+      heap_caps_free(cache_buckets);
+    }
+
+    if (!audio_stream.begin()) {
+      return false;
+    }
+
+    mp3_scan_window = (uint8_t*)heap_caps_malloc(UTA_META_WINDOW_BYTES, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    mp3_scan_marks  = (uint32_t*)heap_caps_malloc(UTA_MP3_SCAN_MARKS * sizeof(uint32_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (mp3_scan_window && mp3_scan_marks) {
+      xTaskCreatePinnedToCore(mp3_scan_task, "Mp3Scan", UTA_MP3_SCAN_STACK, this,
+                              UTA_MP3_SCAN_PRIORITY, &mp3_scan_handle, UTA_MP3_SCAN_CORE);
+    } else {
+      Serial.println("[WARN] MP3 frame scan disabled (no PSRAM)");
+    }
+
+    xTaskCreatePinnedToCore(writer_task, "PcmWriter", 4096, this,
+                            UTA_WRITER_PRIORITY, &writer_task_handle, UTA_WRITER_CORE);
+    xTaskCreatePinnedToCore(decode_task, "Decoder", 16384, this,
+                            UTA_DECODE_PRIORITY, &decode_task_handle, UTA_DECODE_CORE);
 
     return true;
   }
 
-  static void reset_current_time() {
-    i2s.resetBytesWritten();
+  // Player control. The decode task calls player.copy() under the same
+  // mutex, so everything touching the player from the UI goes through here.
+  bool start() {
+    xSemaphoreTake(player_mutex, portMAX_DELAY);
+    bool ok = player.begin();
+    player.setVolume(1.0f);     // volume is applied by the writer, see set_volume()
+    xSemaphoreGive(player_mutex);
+    return ok;
+  }
+
+  void play() {
+    xSemaphoreTake(player_mutex, portMAX_DELAY);
+    player.play();
+    xSemaphoreGive(player_mutex);
+  }
+
+  void stop() {
+    xSemaphoreTake(player_mutex, portMAX_DELAY);
+    player.stop();
+    flush_pcm();
+    xSemaphoreGive(player_mutex);
+  }
+
+  void next() {
+    xSemaphoreTake(player_mutex, portMAX_DELAY);
+    flush_pcm();
+    player.next();
+    xSemaphoreGive(player_mutex);
+  }
+
+  void previous() {
+    xSemaphoreTake(player_mutex, portMAX_DELAY);
+    flush_pcm();
+    player.previous();
+    xSemaphoreGive(player_mutex);
+  }
+
+  // Folded into the writer's gain multiply, so it takes effect within one
+  // chunk instead of after everything already queued in the ring
+  void set_volume(float volume) {
+    volume_gain = gain_from_level(volume);
+  }
+
+  void set_replaygain_mode(ReplayGainMode mode) {
+    rg_mode        = mode;
+    loudness_dirty = true;
+  }
+
+  ReplayGainMode replaygain_mode() {
+    return (ReplayGainMode)rg_mode;
+  }
+
+  // Takes effect with the next track (the next decoder format change)
+  void set_resample_mode(ResampleMode mode) {
+    rs_mode = mode;
+  }
+
+  ResampleMode resample_mode() {
+    return (ResampleMode)rs_mode;
+  }
+
+  bool is_active() {
+    return player.isActive();
+  }
+
+  void set_gapless(bool enabled) {
+    xSemaphoreTake(player_mutex, portMAX_DELAY);
+    gapless = enabled;
+    if (!enabled) discard_staged();
+    xSemaphoreGive(player_mutex);
+  }
+
+  bool is_gapless() {
+    return gapless;
   }
+
+  PcmStats pcm_stats() {
+    return PcmStats{
+      ring.capacity(), ring.available(), start_watermark, low_watermark,
+      min_fill, underruns, low_water_hits, producer_stalls
+    };
+  }
+
+  ReadAheadFile::Stats read_ahead_stats() {
+    return audio_stream.stats();
+  }
+
+  size_t read_ahead_buffered() {
+    return audio_stream.buffered();
+  }
+
+  MetaCacheStats meta_cache_stats() {
+    return MetaCacheStats{
+      meta_cache.size(), meta_cache.capacity(),
+      meta_cache.hits, meta_cache.misses, meta_cache.evictions
+    };
+  }
+
+  // Needs the card, so this runs after sdcard_begin()
+  bool load_meta_cache() {
+    if (!meta_cache_ready) return false;
+    SdLock lock;
+
+    FsFile file = sd.open(UTA_META_CACHE_PATH, O_RDONLY);
+    if (!file) return false;
+
+    bool ok = meta_cache.load([&](void* data, size_t len) {
+      return file.read(data, len) == (int)len;
+    });
+    file.close();
+
+    if (!ok) meta_cache.clear();
+    meta_cache.hits = meta_cache.misses = meta_cache.evictions = 0;
+    meta_cache_dirty = 0;
+    Serial.printf("[INFO] Metadata cache: %u entries restored\n", meta_cache.size());
+    return ok;
+  }
+
+  bool save_meta_cache() {
+    if (!meta_cache_ready || meta_cache_dirty == 0) return true;
+    SdLock lock;
+
+    if (!sd.exists("/.uta")) sd.mkdir("/.uta");
+    FsFile file = sd.open(UTA_META_CACHE_PATH, O_WRONLY | O_CREAT | O_TRUNC);
+    if (!file) return false;
+
+    bool ok = meta_cache.save([&](const void* data, size_t len) {
+      return file.write((const uint8_t*)data, len) == len;
+    });
+    file.close();
+
+    if (ok) meta_cache_dirty = 0;
+    return ok;
+  }
+
+  void set_pcm_watermarks(size_t start_bytes, size_t low_bytes) {
+    start_watermark = min(start_bytes, ring.capacity());
+    low_watermark   = min(low_bytes, start_watermark);
+  }
+
+  void reset_pcm_stats() {
+    min_fill        = ring.capacity();
+    underruns       = 0;
+    low_water_hits  = 0;
+    producer_stalls = 0;
+  }
+
+  // Position heard at the DAC; lock-free, safe from any task
   float get_current_time() {
-    return i2s.getAudioCurrentTime();
+    return clock.seconds(micros());
+  }
+
+  // Jumps within the current track. FLAC and WAV land on the exact sample,
+  // MP3 on the frame its TOC points at; otherwise returns false.
+  bool seek(float seconds) {
+    xSemaphoreTake(player_mutex, portMAX_DELAY);
+    bool ok = seek_locked(seconds);
+    xSemaphoreGive(player_mutex);
+    return ok;
+  }
+
+  bool seek_relative(float delta) {
+    return seek(get_current_time() + delta);
   }
   float get_audio_duration() {
     return current_duration;
@@ -570,8 +1315,24 @@ public:
 };
 
 AudioManager::Metadata    AudioManager::current_track;
-AudioManager::UtaI2S      AudioManager::i2s;
+I2SStream                 AudioManager::i2s;
 FsFile                    AudioManager::audio_file;
-FsFile                    AudioManager::meta_file;
+ReadAheadFile             AudioManager::audio_stream;
 bool                      AudioManager::played = false;
+AudioManager::StagedTrack AudioManager::staged;
+bool                      AudioManager::gapless = UTA_GAPLESS;
+uint64_t                  AudioManager::frames_left = UINT64_MAX;
+uint64_t                  AudioManager::skip_frames = 0;
+ReplayGain                AudioManager::next_replaygain;
+volatile bool             AudioManager::track_mark_pending = false;
+MetaCache                 AudioManager::meta_cache;
+bool                      AudioManager::meta_cache_ready = false;
+uint32_t                  AudioManager::meta_cache_dirty = 0;
+uint8_t                   AudioManager::meta_window[UTA_META_WINDOW_BYTES];
+TaskHandle_t              AudioManager::mp3_scan_handle = nullptr;
+char                      AudioManager::mp3_scan_path[UTA_PATH_BYTES];
+char                      AudioManager::mp3_scan_file[UTA_PATH_BYTES];
+volatile bool             AudioManager::mp3_scan_pending = false;
+uint8_t*                  AudioManager::mp3_scan_window = nullptr;
+uint32_t*                 AudioManager::mp3_scan_marks = nullptr;
 float                     AudioManager::current_duration = 0.0f;
\ No newline at end of file
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+
+/// Playback position as heard at the DAC, in frames of the current track:
+/// the last written position minus what is still queued in DMA.
+class PlaybackClock {
+public:
+  struct Snapshot {
+    uint32_t frame    = 0;   // track position of the next frame to write
+    uint32_t start    = 0;   // first frame of this run
+    uint32_t queued   = 0;   // frames in DMA when `stamp_us` was taken
+    uint32_t rate     = 0;   // frames per second
+    uint32_t stamp_us = 0;
+  };
+
+  // Writer side: a seqlock, so neither side ever blocks. Fields are 32-bit
+  // (27 h at 44.1 kHz) so no 64-bit atomics are needed on the ESP32.
+  void publish(const Snapshot& s) {
+    uint32_t q = seq.load(std::memory_order_relaxed);
+    seq.store(q + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    frame.store(s.frame, std::memory_order_relaxed);
+    start.store(s.start, std::memory_order_relaxed);
+    queued.store(s.queued, std::memory_order_relaxed);
+    rate.store(s.rate, std::memory_order_relaxed);
+    stamp_us.store(s.stamp_us, std::memory_order_relaxed);
+    seq.store(q + 2, std::memory_order_release);
+  }
+
+  // Any task; retries only while a publish is in flight
+  Snapshot snapshot() const {
+    Snapshot s;
+    uint32_t before, after;
+    do {
+      before     = seq.load(std::memory_order_acquire);
+      s.frame    = frame.load(std::memory_order_relaxed);
+      s.start    = start.load(std::memory_order_relaxed);
+      s.queued   = queued.load(std::memory_order_relaxed);
+      s.rate     = rate.load(std::memory_order_relaxed);
+      s.stamp_us = stamp_us.load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      after      = seq.load(std::memory_order_relaxed);
+    } while ((before & 1) || before != after);
+    return s;
+  }
+
+  // Frames still ahead of the DAC at `now_us`
+  static uint32_t queued_at(const Snapshot& s, uint32_t now_us) {
+    uint64_t drained = (uint64_t)(now_us - s.stamp_us) * s.rate / 1000000;
+    return drained >= s.queued ? 0 : s.queued - (uint32_t)drained;
+  }
+
+  static uint32_t position(const Snapshot& s, uint32_t now_us) {
+    uint32_t q = queued_at(s, now_us);
+    return s.frame - s.start > q ? s.frame - q : s.start;
+  }
+
+  uint32_t position(uint32_t now_us) const {
+    return position(snapshot(), now_us);
+  }
+
+  float seconds(uint32_t now_us) const {
+    Snapshot s = snapshot();
+    return s.rate ? (float)position(s, now_us) / s.rate : 0.0f;
+  }
+
+private:
+  std::atomic<uint32_t> seq{0};
+  std::atomic<uint32_t> frame{0};
+  std::atomic<uint32_t> start{0};
+  std::atomic<uint32_t> queued{0};
+  std::atomic<uint32_t> rate{0};
+  std::atomic<uint32_t> stamp_us{0};
+};
@@ -0,0 +1,242 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+/// Retained-mode compositor for the panel: a background under a stack of
+/// layers, rebuilt only in the tiles that changed.
+
+#define COMP_TILE_W        32
+#define COMP_TILE_H        16
+#define COMP_MAX_TILE_ROWS 32    // up to 512 rows; a tile row is one uint32_t
+#define COMP_MAX_LAYERS    12
+
+enum LayerKind : uint8_t { LAYER_FILL, LAYER_MASK, LAYER_IMAGE };
+
+struct Layer {
+  int16_t  x = 0, y = 0, w = 0, h = 0;   // screen rectangle
+  uint8_t  kind    = LAYER_FILL;
+  bool     visible = false;
+  uint16_t color   = 0;                  // FILL and MASK
+  const uint8_t*  mask   = nullptr;      // MASK: coverage 0..255
+  const uint16_t* pixels = nullptr;      // IMAGE
+  int16_t  stride = 0;                   // source row length
+  int16_t  src_x  = 0;                   // source column shown at x, may be negative
+  int16_t  src_w  = 0;                   // source columns outside [0, src_w) are clear
+};
+
+struct CompositorStats {
+  uint32_t frames;         // compose() calls that pushed anything
+  uint32_t last_pixels;    // pushed by the most recent of those
+  uint32_t last_spans;
+  uint64_t total_pixels;
+};
+
+inline uint16_t comp_swap(uint16_t c) {
+  return (uint16_t)((c >> 8) | (c << 8));
+}
+
+// fg over bg with 8-bit coverage; both plain RGB565. The three channels are
+// spread out with gaps so they blend in one multiply.
+inline uint16_t comp_blend(uint16_t fg, uint16_t bg, uint8_t alpha) {
+  uint32_t a = ((uint32_t)alpha + 4) >> 3;
+  uint32_t f = (fg | ((uint32_t)fg << 16)) & 0x07E0F81Fu;
+  uint32_t b = (bg | ((uint32_t)bg << 16)) & 0x07E0F81Fu;
+  uint32_t r = (b + (((f - b) * a) >> 5)) & 0x07E0F81Fu;
+  return (uint16_t)(r | (r >> 16));
+}
+
+// Coverage of white text rendered on black, from panel-order pixels (the
+// layout of a 16-bit TFT_eSprite), taken from the 6-bit green channel
+inline void comp_coverage(const uint16_t* px, int16_t n, uint8_t* out) {
+  for (int16_t i = 0; i < n; i++) {
+    uint8_t g = (comp_swap(px[i]) >> 5) & 0x3F;
+    out[i] = (uint8_t)((g << 2) | (g >> 4));
+  }
+}
+
+class Compositor {
+public:
+  Compositor(int16_t width, int16_t height)
+    : width(width), height(height),
+      tiles_x((width + COMP_TILE_W - 1) / COMP_TILE_W),
+      tiles_y((height + COMP_TILE_H - 1) / COMP_TILE_H) {}
+
+  // `pixels` holds full-width screen rows from `y0`, `rows` of them (to
+  // the bottom by default), or nullptr for black. Rows outside are black.
+  void set_background(const uint16_t* pixels, int16_t y0 = 0, int16_t rows = INT16_MAX) {
+    background = pixels;
+    background_y0 = y0;
+    background_rows = rows;
+  }
+
+  const Layer& layer(uint8_t i) const { return layers[i]; }
+
+  // For changes to part of a layer (a scrolled mask, a longer bar); the
+  // caller invalidates what changed
+  Layer& edit(uint8_t i) { return layers[i]; }
+
+  // Replaces layer `i`, marking what it covered before and covers now
+  void set_layer(uint8_t i, const Layer& l) {
+    if (layers[i].visible) invalidate(layers[i]);
+    layers[i] = l;
+    if (l.visible) invalidate(l);
+  }
+
+  void hide(uint8_t i) {
+    if (!layers[i].visible) return;
+    invalidate(layers[i]);
+    layers[i].visible = false;
+  }
+
+  void invalidate(const Layer& l) { invalidate(l.x, l.y, l.w, l.h); }
+
+  void invalidate(int16_t x, int16_t y, int16_t w, int16_t h) {
+    int16_t x1 = x + w, y1 = y + h;
+    if (x < 0) x = 0;
+    if (y < 0) y = 0;
+    if (x1 > width)  x1 = width;
+    if (y1 > height) y1 = height;
+    if (x1 <= x || y1 <= y) return;
+
+    uint32_t bits = run_bits(x / COMP_TILE_W, (x1 - 1) / COMP_TILE_W);
+    for (int16_t ty = y / COMP_TILE_H; ty <= (y1 - 1) / COMP_TILE_H; ty++) dirty[ty] |= bits;
+  }
+
+  void invalidate_all() { invalidate(0, 0, width, height); }
+
+  void invalidate_layers() {
+    for (const Layer& l : layers) {
+      if (l.visible) invalidate(l);
+    }
+  }
+
+  bool is_dirty() const {
+    for (int16_t ty = 0; ty < tiles_y; ty++) {
+      if (dirty[ty]) return true;
+    }
+    return false;
+  }
+
+  // Top of the first tile row with anything dirty, or -1
+  int16_t first_dirty_row() const {
+    for (int16_t ty = 0; ty < tiles_y; ty++) {
+      if (dirty[ty]) return ty * COMP_TILE_H;
+    }
+    return -1;
+  }
+
+  // Rebuilds every dirty span into bufs[half] and calls push(x, y, w, h,
+  // pixels) for each, flipping `half` after every span so the previous one
+  // can still be in flight while the next is composed. `half` is the
+  // caller's, so it carries over between calls sharing the buffers. Each
+  // buffer must hold at least one full-width tile row. Only tile rows that
+  // end by `y_end` are composed, the rest stay dirty. Returns the pixels
+  // pushed.
+  template <typename Push>
+  uint32_t compose(uint16_t* const bufs[2], uint32_t buf_pixels, Push push, uint8_t& half,
+                   int16_t y_end = INT16_MAX) {
+    uint32_t pixels = 0, spans = 0;
+    int16_t rows = tiles_y;
+    while (rows > 0 && (rows - 1) * COMP_TILE_H + row_height(rows - 1) > y_end) rows--;
+
+    for (int16_t ty = 0; ty < rows; ty++) {
+      while (dirty[ty]) {
+        uint32_t m = dirty[ty];
+        int16_t tx0 = __builtin_ctz(m), tx1 = tx0;
+        while (tx1 + 1 < tiles_x && (m >> (tx1 + 1) & 1)) tx1++;
+        uint32_t run = run_bits(tx0, tx1);
+        dirty[ty] &= ~run;
+
+        int16_t x = tx0 * COMP_TILE_W;
+        int16_t w = ((tx1 + 1) * COMP_TILE_W < width ? (tx1 + 1) * COMP_TILE_W : width) - x;
+        int16_t y = ty * COMP_TILE_H;
+        int16_t h = row_height(ty);
+        for (int16_t next = ty + 1; next < rows && (dirty[next] & run) == run &&
+                                    (uint32_t)w * (h + row_height(next)) <= buf_pixels; next++) {
+          dirty[next] &= ~run;
+          h += row_height(next);
+        }
+
+        compose_rect(x, y, w, h, bufs[half]);
+        push(x, y, w, h, bufs[half]);
+        half ^= 1;
+        pixels += (uint32_t)w * h;
+        spans++;
+      }
+    }
+
+    if (spans) {
+      stats.frames++;
+      stats.last_pixels   = pixels;
+      stats.last_spans    = spans;
+      stats.total_pixels += pixels;
+    }
+    return pixels;
+  }
+
+  // Background plus every visible layer, for one rectangle
+  void compose_rect(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t* out) const {
+    for (int16_t r = 0; r < h; r++) {
+      int16_t sy = y + r;
+      uint16_t* row = out + r * w;
+      int16_t by = sy - background_y0;
+      if (background && by >= 0 && by < background_rows) {
+        memcpy(row, background + by * width + x, w * sizeof(uint16_t));
+      } else {
+        memset(row, 0, w * sizeof(uint16_t));
+      }
+
+      for (const Layer& l : layers) {
+        if (!l.visible || sy < l.y || sy >= l.y + l.h) continue;
+
+        int16_t c0 = x > l.x ? x : l.x;
+        int16_t c1 = x + w < l.x + l.w ? x + w : l.x + l.w;
+        if (l.kind != LAYER_FILL) {
+          int16_t s0 = l.x - l.src_x;                // screen column of source column 0
+          if (c0 < s0) c0 = s0;
+          if (c1 > s0 + l.src_w) c1 = s0 + l.src_w;
+        }
+        if (c1 <= c0) continue;
+
+        uint16_t* dst = row + (c0 - x);
+        int16_t n  = c1 - c0;
+        int32_t src = (int32_t)(sy - l.y) * l.stride + l.src_x + (c0 - l.x);
+
+        if (l.kind == LAYER_FILL) {
+          uint16_t c = comp_swap(l.color);
+          for (int16_t i = 0; i < n; i++) dst[i] = c;
+        } else if (l.kind == LAYER_MASK) {
+          const uint8_t* a = l.mask + src;
+          uint16_t solid = comp_swap(l.color);
+          for (int16_t i = 0; i < n; i++) {
+            if (a[i] == 0) continue;
+            dst[i] = a[i] == 255 ? solid : comp_swap(comp_blend(l.color, comp_swap(dst[i]), a[i]));
+          }
+        } else {
+          memcpy(dst, l.pixels + src, n * sizeof(uint16_t));
+        }
+      }
+    }
+  }
+
+  CompositorStats statistics() const { return stats; }
+
+private:
+  static uint32_t run_bits(int16_t tx0, int16_t tx1) {
+    int16_t n = tx1 - tx0 + 1;
+    return (n >= 32 ? 0xFFFFFFFFu : ((1u << n) - 1)) << tx0;
+  }
+
+  int16_t row_height(int16_t ty) const {
+    int16_t y = ty * COMP_TILE_H;
+    return height - y < COMP_TILE_H ? height - y : COMP_TILE_H;
+  }
+
+  const int16_t width, height, tiles_x, tiles_y;
+  const uint16_t* background = nullptr;
+  int16_t background_y0 = 0, background_rows = INT16_MAX;
+  Layer layers[COMP_MAX_LAYERS];
+  uint32_t dirty[COMP_MAX_TILE_ROWS] = {0};
+  CompositorStats stats = {0, 0, 0, 0};
+};
@@ -7,8 +7,10 @@
 
 #include "Koruri-Regular24.h"
 #include "BootBg.h"
+#include "uta_Compositor.h"
 
 #define MAX_IMAGE_WIDTH 320
+#define MAX_IMAGE_HEIGHT 480
 #define FONT Koruri_Regular24
 #define SMOOTH_FONT
 
@@ -23,20 +25,44 @@
 #define VOLUME_Y (PROGRESS_Y + 15)
 #define VOLUME_W 70
 #define VOLUME_H 30
+#define VOLUME_SHOW_MS 2000
 
 #define MAX_TEXT_LEN 128
 
+// Text is rendered once into a coverage mask; long strings scroll by
+// moving the window the compositor reads, so the font rasteriser only runs
+// on a change
+#define SCROLL_H   38
+#define SCROLL_GAP 100
+#define TIME_H     16
+
+// Bounce buffer for DMA pushes: two halves, each at least one tile row of
+// the compositor
+#define DMA_BUF_PIXELS (MAX_IMAGE_WIDTH * SCROLL_H)
+
+// PNG rows are batched into one half of the DMA buffer while the other half
+// is on the wire. The decoder lets other tasks run once it has held the CPU
+// for PNG_YIELD_US.
+#define PNG_BATCH_ROWS (DMA_BUF_PIXELS / 2 / MAX_IMAGE_WIDTH)
+#define PNG_YIELD_US   8000
+
+// Without the PSRAM background cache, compose() decodes the background
+// again down to the last dirty row, this many rows (internal RAM) at a time
+#define BG_BAND_ROWS (2 * COMP_TILE_H)
+
 #define TFT_BL_PIN 3
 
 class DisplayManager {
 public:
-  DisplayManager() : tft(TFT_eSPI()) {}
+  DisplayManager() : tft(TFT_eSPI()), comp(MAX_IMAGE_WIDTH, MAX_IMAGE_HEIGHT) {}
 
   bool begin() {
     tft.init();
     tft.setRotation(0);
     tft.setAttribute(UTF8_SWITCH, true);
     tft.setAttribute(PSRAM_ENABLE, true);
+    dma_ready = tft.initDMA();
+    if (!dma_ready) Serial.println("[WARN] TFT DMA unavailable; using blocking pushes");
 
     tft_mutex = xSemaphoreCreateMutex();
     if (!tft_mutex) {
@@ -44,6 +70,12 @@ public:
       return false;
     }
 
+    dma_buf = (uint16_t*)heap_caps_malloc(DMA_BUF_PIXELS * sizeof(uint16_t), MALLOC_CAP_DMA);
+    if (!dma_buf) {
+      Serial.println("[ERROR] Display DMA buffer failed");
+      return false;
+    }
+
     cmd_queue = xQueueCreate(32, sizeof(DisplayCommand));
     if (!cmd_queue) {
       Serial.println("[ERROR] Display queue failed");
@@ -55,6 +87,7 @@ public:
 
     Serial.println("Loading boot image...");
     display_png_blocking(BootBg, sizeof(BootBg));
+    Serial.printf("[INFO] First frame %lu ms after boot\n", millis());
     display_text("おかえり~~~ :3", 0, 0);
     vTaskDelay(pdMS_TO_TICKS(1000));
 
@@ -75,13 +108,67 @@ public:
     auto* p = new Params{image, size, this};
     xTaskCreatePinnedToCore([](void* arg) {
       auto* pp = (Params*)arg;
-      pp->dm->decode_png_yielding(pp->img, pp->sz);
+      auto* dm = pp->dm;
+      uint32_t t0 = millis();
+      bool cached = dm->bg_cached == pp->img;
+      if (cached) {
+        xSemaphoreTake(dm->tft_mutex, portMAX_DELAY);
+        dm->comp.set_background(dm->bg_cache);
+        dm->comp.invalidate_all();
+        dm->compose();
+        xSemaphoreGive(dm->tft_mutex);
+      } else {
+        dm->decode_png_yielding(pp->img, pp->sz);
+      }
+      Serial.printf("[INFO] Background %s in %lu ms\n",
+                    cached ? "pushed from cache" : "decoded", millis() - t0);
       delete pp;
       vTaskDelete(nullptr);
     }, "PNGDecode", 12000, p, 1, nullptr, 1);
     return true;
   }
 
+  // Shows an RGB565 (big-endian) image in the art layer, replacing the
+  // previous one. The pixels are copied. Called from the album art task.
+  void draw_image(int16_t x, int16_t y, int16_t w, int16_t h, const uint16_t* pixels) {
+    size_t n = (size_t)w * h;
+    xSemaphoreTake(tft_mutex, portMAX_DELAY);
+    if (n > art_capacity) {
+      comp.hide(UI_ART);
+      heap_caps_free(art_pixels);
+      art_pixels   = (uint16_t*)heap_caps_malloc(n * sizeof(uint16_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+      art_capacity = art_pixels ? n : 0;
+    }
+    if (art_pixels) {
+      memcpy(art_pixels, pixels, n * sizeof(uint16_t));
+      Layer l;
+      l.kind = LAYER_IMAGE;
+      l.x = x; l.y = y; l.w = w; l.h = h;
+      l.pixels  = art_pixels;
+      l.stride  = w;
+      l.src_w   = w;
+      l.visible = true;
+      comp.set_layer(UI_ART, l);
+      compose();
+    } else {
+      Serial.println("[WARN] No memory for the art layer");
+    }
+    xSemaphoreGive(tft_mutex);
+  }
+
+  // Redraws one rectangle of the background, dropping an image that lies
+  // inside it
+  void restore_background(int16_t x, int16_t y, int16_t w, int16_t h) {
+    xSemaphoreTake(tft_mutex, portMAX_DELAY);
+    const Layer& art = comp.layer(UI_ART);
+    if (art.x >= x && art.y >= y && art.x + art.w <= x + w && art.y + art.h <= y + h) {
+      comp.hide(UI_ART);
+    }
+    comp.invalidate(x, y, w, h);
+    compose();
+    xSemaphoreGive(tft_mutex);
+  }
+
   void display_text(const char* text, uint8_t x = 0, uint8_t y = 0) {
     DisplayCommand cmd{};
     cmd.type = CMD_TEXT;
@@ -96,48 +183,131 @@ public:
     xQueueSend(cmd_queue, &cmd, 0);
   }
 
+  // Only the latest value matters: a burst of presses queues one command
+  // and the worker draws whatever value is current when it gets to it
   void show_volume(float vol) {
-    DisplayCommand cmd{CMD_VOLUME, {}, 0, 0, 0, 0, vol};
-    xQueueSend(cmd_queue, &cmd, 0);
+    pending_volume = vol;
+    if (volume_queued) return;
+    volume_queued = true;
+    DisplayCommand cmd{};
+    cmd.type = CMD_VOLUME;
+    if (xQueueSend(cmd_queue, &cmd, 0) != pdPASS) volume_queued = false;
   }
 
+  struct ScrollStats {
+    uint32_t frame_us;      // average time holding the panel per frame
+    uint32_t max_frame_us;
+    uint32_t fps;
+    float    busy_percent;  // share of the scroller's wall time spent drawing
+  };
+
+  ScrollStats scroll_stats() const {
+    ScrollStats s{ scroll_frame_us, scroll_max_us, scroll_fps, scroll_busy_permille / 10.0f };
+    return s;
+  }
+
+  CompositorStats compositor_stats() const { return comp.statistics(); }
+
   ~DisplayManager() {
     stop_worker = true;
-    for (auto& f : scroll_fields) f.active = false;
+    for (auto& f : text_fields) f.active = false;
 
     vTaskDelay(pdMS_TO_TICKS(50));
     if (smooth_scroll_task_handle) vTaskDelete(smooth_scroll_task_handle);
     if (worker_task_handle) vTaskDelete(worker_task_handle);
     if (cmd_queue) vQueueDelete(cmd_queue);
     if (tft_mutex) vSemaphoreDelete(tft_mutex);
+    for (auto& f : text_fields) free_mask(f);
+    heap_caps_free(dma_buf);
+    heap_caps_free(bg_cache);
+    heap_caps_free(bg_band);
+    heap_caps_free(art_pixels);
   }
 
 private:
   TFT_eSPI tft;
   PNG png;
 
+  // Everything on screen is a layer over the background; see compose()
+  enum UiLayer {
+    UI_ART,
+    UI_TITLE, UI_ARTIST, UI_ALBUM, UI_MESSAGE,    // same order as text_fields
+    UI_BAR_TRACK, UI_BAR_FILL, UI_TIME,
+    UI_VOLUME_BOX, UI_VOLUME_TEXT,
+    UI_LAYERS
+  };
+  static_assert(UI_LAYERS <= COMP_MAX_LAYERS, "compositor layer table too small");
+  Compositor comp;
+  TFT_eSprite* font_spr = nullptr;   // Koruri, owned by the worker task
+  TFT_eSprite* glcd_spr = nullptr;   // built-in font, owned by the worker task
+
+  uint16_t* art_pixels   = nullptr;
+  size_t    art_capacity = 0;
+  uint8_t   time_mask[MAX_IMAGE_WIDTH * TIME_H];
+  uint8_t   volume_mask[VOLUME_W * 8];
+
+  int16_t clip_x = 0, clip_y = 0, clip_w = MAX_IMAGE_WIDTH, clip_h = MAX_IMAGE_HEIGHT;
+
+  // Full-screen RGB565 copy (panel byte order) of the last background that
+  // was decoded whole. Filled as a side effect of that decode, so redraws
+  // and partial restores after it never touch PNGdec.
+  uint16_t*      bg_cache   = nullptr;
+  const uint8_t* bg_cached  = nullptr;   // image bg_cache holds, if complete
+  bool           bg_filling = false;
+
+  // Last background decoded whole, and the band compose() decodes it into
+  // when bg_cache does not hold it; see compose_decoded()
+  const uint8_t* bg_image  = nullptr;
+  size_t         bg_size   = 0;
+  uint16_t*      bg_band   = nullptr;
+  int16_t        band_y0   = 0, band_rows = 0;
+  bool           band_mode = false;
+  bool           band_warned = false;
+
+  // Rows of the current PNG batch, see queue_row()
+  int16_t  batch_x = 0, batch_y = 0, batch_w = 0, batch_rows = 0;
+  uint32_t yield_at = 0;
+
   SemaphoreHandle_t tft_mutex = nullptr;
   TaskHandle_t worker_task_handle = nullptr;
   TaskHandle_t smooth_scroll_task_handle = nullptr;
   QueueHandle_t cmd_queue = nullptr;
   volatile bool stop_worker = false;
+  bool dma_ready = false;
+  uint16_t* dma_buf = nullptr;   // DMA_BUF_PIXELS, internal RAM
+  uint8_t   dma_half = 0;         // half to fill next; the other may be on the wire
 
-  bool progress_bar_initialized = false;
-  int last_bar_width = 0;
   char last_time_str[20] = {0};
-  float last_volume = -1;
 
-  struct ScrollText {
-    char text[MAX_TEXT_LEN] = {0};
-    uint8_t x = 0, y = 0;
-    int16_t offset = 0;
+  volatile float pending_volume = 0;
+  volatile bool  volume_queued  = false;
+
+  // Popups over the regular UI, each a run of layers. The worker hides
+  // them when their deadline passes, so showing one never holds up other
+  // commands.
+  enum OverlayId { OVERLAY_VOLUME, OVERLAY_COUNT };
+  struct Overlay {
+    uint8_t    first_layer, layers;
+    TickType_t expires;
+    bool       visible;
+  };
+  Overlay overlays[OVERLAY_COUNT] = {
+    { UI_VOLUME_BOX, 2, 0, false },
+  };
+
+  struct TextField {
+    uint8_t* mask = nullptr;    // width x SCROLL_H coverage, PSRAM
+    int16_t offset = 0;         // screen column of the first text column
     int16_t width = 0;
-    bool active = false;
+    bool active = false;        // scrolling
     TickType_t pause_until = 0;
   };
-  ScrollText scroll_fields[3];  // title, artist, album
+  TextField text_fields[4];     // title, artist, album, any other row
   volatile bool scroll_task_running = false;
 
+  volatile uint32_t scroll_frame_us = 0, scroll_max_us = 0, scroll_fps = 0;
+  volatile uint32_t scroll_busy_permille = 0;
+
   enum CommandType { CMD_TEXT, CMD_PROGRESS, CMD_VOLUME };
   struct DisplayCommand {
     CommandType type = CMD_TEXT;
@@ -145,47 +315,246 @@ private:
     uint8_t x = 0, y = 0;
     float current_time = 0;
     float duration = 0;
-    float volume = 0;
   };
 
-  void decode_png_yielding(const uint8_t* image, size_t size) {
+  void decode_png_yielding(const uint8_t* image, size_t size,
+                           int16_t x = 0, int16_t y = 0,
+                           int16_t w = MAX_IMAGE_WIDTH, int16_t h = MAX_IMAGE_HEIGHT) {
     xSemaphoreTake(tft_mutex, portMAX_DELAY);
+    clip_x = x; clip_y = y; clip_w = w; clip_h = h;
+    bool whole = x == 0 && y == 0 && w == MAX_IMAGE_WIDTH && h == MAX_IMAGE_HEIGHT;
     tft.startWrite();
+    yield_at = micros();
     int rc = png.openFLASH((uint8_t*)image, size, png_draw_callback);
-    if (rc == PNG_SUCCESS) png.decode(this, 0);
+    if (rc == PNG_SUCCESS) {
+      if (whole) begin_cache_fill();
+      rc = png.decode(this, 0);
+      flush_rows();
+      if (whole) end_cache_fill(image, size, rc == PNG_SUCCESS);
+    }
     png.close();
     tft.endWrite();
+    clip_x = 0; clip_y = 0; clip_w = MAX_IMAGE_WIDTH; clip_h = MAX_IMAGE_HEIGHT;
+    if (whole) repaint_layers();
     xSemaphoreGive(tft_mutex);
   }
 
   static int png_draw_callback(PNGDRAW* p_draw) {
     uint16_t line[MAX_IMAGE_WIDTH];
     auto* dm = (DisplayManager*)p_draw->pUser;
+    if (dm->band_mode) return dm->band_row(p_draw, line);
+    if (p_draw->y < dm->clip_y) return 1;
+    if (p_draw->y >= dm->clip_y + dm->clip_h) return 0;   // rest is outside the clip
+
     dm->png.getLineAsRGB565(p_draw, line, PNG_RGB565_BIG_ENDIAN, 0xffffffff);
-    dm->tft.pushImage(0, p_draw->y, p_draw->iWidth, 1, line);
+    if (dm->bg_filling && p_draw->y < MAX_IMAGE_HEIGHT) {
+      int16_t n = p_draw->iWidth < MAX_IMAGE_WIDTH ? p_draw->iWidth : MAX_IMAGE_WIDTH;
+      memcpy(dm->bg_cache + p_draw->y * MAX_IMAGE_WIDTH, line, n * sizeof(uint16_t));
+    }
+    int16_t w = p_draw->iWidth - dm->clip_x;
+    if (w > dm->clip_w) w = dm->clip_w;
+    if (w > 0) dm->queue_row(dm->clip_x, p_draw->y, w, line + dm->clip_x);
+    return 1;
+  }
+
+  // Adds one decoded row to the current batch. Caller holds tft_mutex
+  // inside startWrite() and calls flush_rows() once the decode is done.
+  void queue_row(int16_t x, int16_t y, int16_t w, const uint16_t* pixels) {
+    if (batch_rows && (x != batch_x || w != batch_w || y != batch_y + batch_rows)) flush_rows();
+    if (!batch_rows) {
+      batch_x = x; batch_y = y; batch_w = w;
+    }
+    uint16_t* buf = dma_buf + dma_half * (DMA_BUF_PIXELS / 2);
+    memcpy(buf + batch_rows * w, pixels, w * sizeof(uint16_t));
+    if (++batch_rows == PNG_BATCH_ROWS) flush_rows();
+  }
+
+  // pushImageDMA waits for the previous transfer before queuing this one
+  // and returns without waiting for it, so the next batch decodes into the
+  // other half while this one is sent
+  void flush_rows() {
+    if (!batch_rows) return;
+    uint16_t* buf = dma_buf + dma_half * (DMA_BUF_PIXELS / 2);
+    if (dma_ready) {
+      tft.pushImageDMA(batch_x, batch_y, batch_w, batch_rows, buf);
+      dma_half ^= 1;
+    } else {
+      tft.pushImage(batch_x, batch_y, batch_w, batch_rows, buf);
+    }
+    batch_rows = 0;
 
-    if (p_draw->y % 16 == 15) {
-      dm->tft.endWrite();
+    if (micros() - yield_at >= PNG_YIELD_US) {
+      tft.endWrite();     // waits for the transfer in flight
       vTaskDelay(1);
-      dm->tft.startWrite();
+      tft.startWrite();
+      yield_at = micros();
     }
-    return 1;
   }
 
   bool display_png_blocking(const uint8_t image[], size_t size) {
     xSemaphoreTake(tft_mutex, portMAX_DELAY);
     tft.startWrite();
+    yield_at = micros();
     bool ok = (png.openFLASH((uint8_t*)image, size, png_draw_callback) == PNG_SUCCESS);
     if (ok) {
       tft.fillScreen(TFT_BLACK);
-      png.decode(this, 0);
+      begin_cache_fill();
+      bool decoded = png.decode(this, 0) == PNG_SUCCESS;
+      flush_rows();
+      end_cache_fill(image, size, decoded);
     }
     png.close();
     tft.endWrite();
+    if (ok) repaint_layers();
     xSemaphoreGive(tft_mutex);
     return ok;
   }
 
+  // Caller holds tft_mutex
+  void begin_cache_fill() {
+    if (!bg_cache) {
+      bg_cache = (uint16_t*)heap_caps_malloc(MAX_IMAGE_WIDTH * MAX_IMAGE_HEIGHT * sizeof(uint16_t),
+                                             MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+      if (!bg_cache) {
+        Serial.println("[WARN] No PSRAM for the background cache; decoding on every draw");
+        return;
+      }
+    }
+    memset(bg_cache, 0, MAX_IMAGE_WIDTH * MAX_IMAGE_HEIGHT * sizeof(uint16_t));
+    bg_cached  = nullptr;
+    bg_filling = true;
+  }
+
+  void end_cache_fill(const uint8_t* image, size_t size, bool ok) {
+    if (bg_filling && ok) bg_cached = image;
+    bg_filling = false;
+    bg_image = ok ? image : nullptr;
+    bg_size  = size;
+  }
+
+  // The decode painted straight to the panel; put the layers back on top
+  // of it. Caller holds tft_mutex.
+  void repaint_layers() {
+    comp.set_background(bg_cached ? bg_cache : nullptr);
+    comp.invalidate_layers();
+    compose();
+  }
+
+  // Pushes every dirty tile. Spans alternate between the two halves of
+  // dma_buf: pushImageDMA waits for the previous span before queuing the
+  // next, so composing one overlaps sending the other. PNG batches and
+  // every compose pass share dma_half, so a half still being sent is never
+  // refilled. Caller holds tft_mutex.
+  void compose() {
+    if (!comp.is_dirty()) return;
+    tft.startWrite();
+    if (!bg_cached && bg_image && band_buffer()) compose_decoded();
+    compose_spans();   // whatever the background decode did not reach, over black
+    tft.endWrite();
+  }
+
+  void compose_spans(int16_t y_end = INT16_MAX) {
+    uint16_t* const halves[2] = { dma_buf, dma_buf + DMA_BUF_PIXELS / 2 };
+    comp.compose(halves, DMA_BUF_PIXELS / 2, [this](int16_t x, int16_t y, int16_t w, int16_t h, uint16_t* px) {
+      if (dma_ready) tft.pushImageDMA(x, y, w, h, px);
+      else           tft.pushImage(x, y, w, h, px);
+    }, dma_half, y_end);
+  }
+
+  bool band_buffer() {
+    if (!bg_band && !band_warned) {
+      bg_band = (uint16_t*)heap_caps_malloc(MAX_IMAGE_WIDTH * BG_BAND_ROWS * sizeof(uint16_t),
+                                            MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+      if (!bg_band) {
+        Serial.println("[WARN] No memory to redecode the background; layers go over black");
+        band_warned = true;
+      }
+    }
+    return bg_band;
+  }
+
+  // compose() when bg_cache does not hold the background: decodes bg_image
+  // again, composing each band of dirty rows as soon as it is filled, and
+  // stops at the last dirty row. Caller holds tft_mutex inside startWrite().
+  void compose_decoded() {
+    next_band();
+    if (png.openFLASH((uint8_t*)bg_image, bg_size, png_draw_callback) == PNG_SUCCESS) {
+      band_mode = true;
+      png.decode(this, 0);
+      band_mode = false;
+      if (band_rows) compose_band();   // image shorter than the screen, or corrupt
+    }
+    png.close();
+    comp.set_background(nullptr);
+  }
+
+  // png_draw_callback in band mode. Returns 0 to end the decode once
+  // nothing is left dirty.
+  int band_row(PNGDRAW* p_draw, uint16_t* line) {
+    int16_t y = p_draw->y;
+    if (y < band_y0) return 1;
+    png.getLineAsRGB565(p_draw, line, PNG_RGB565_BIG_ENDIAN, 0xffffffff);
+    int16_t n = p_draw->iWidth < MAX_IMAGE_WIDTH ? p_draw->iWidth : MAX_IMAGE_WIDTH;
+    memcpy(bg_band + (y - band_y0) * MAX_IMAGE_WIDTH, line, n * sizeof(uint16_t));
+    if (y + 1 == band_y0 + band_rows) compose_band();
+    return band_rows ? 1 : 0;
+  }
+
+  void compose_band() {
+    comp.set_background(bg_band, band_y0, band_rows);
+    compose_spans(band_y0 + band_rows);
+    next_band();
+  }
+
+  // Starts a band at the first dirty tile row; band_rows is 0 when none is
+  void next_band() {
+    band_y0   = comp.first_dirty_row();
+    band_rows = 0;
+    if (band_y0 < 0) return;
+    band_rows = MAX_IMAGE_HEIGHT - band_y0 < BG_BAND_ROWS ? MAX_IMAGE_HEIGHT - band_y0 : BG_BAND_ROWS;
+    memset(bg_band, 0, MAX_IMAGE_WIDTH * band_rows * sizeof(uint16_t));
+  }
+
+  // Rasterises `text` as white on black, one sprite-wide slice at a time,
+  // and keeps the coverage. `out` is tw x th.
+  void render_mask(TFT_eSprite* spr, const char* text, int16_t tw, int16_t th,
+                   int16_t y0, uint8_t* out) {
+    int16_t sw = spr->width();
+    const uint16_t* src = (const uint16_t*)spr->getPointer();
+    spr->setTextDatum(TL_DATUM);
+    spr->setTextColor(TFT_WHITE);
+
+    for (int16_t x0 = 0; x0 < tw; x0 += sw) {
+      int16_t n = (tw - x0 < sw) ? tw - x0 : sw;
+      spr->fillSprite(TFT_BLACK);
+      spr->drawString(text, -x0, y0);
+      for (int16_t row = 0; row < th; row++) {
+        comp_coverage(src + row * sw, n, out + row * tw + x0);
+      }
+    }
+  }
+
+  static Layer mask_layer(int16_t x, int16_t y, int16_t w, int16_t h,
+                          const uint8_t* mask, int16_t mask_w, uint16_t color) {
+    Layer l;
+    l.kind = LAYER_MASK;
+    l.x = x; l.y = y; l.w = w; l.h = h;
+    l.mask    = mask;
+    l.stride  = mask_w;
+    l.src_w   = mask_w;
+    l.color   = color;
+    l.visible = true;
+    return l;
+  }
+
+  static Layer fill_layer(int16_t x, int16_t y, int16_t w, int16_t h, uint16_t color) {
+    Layer l;
+    l.x = x; l.y = y; l.w = w; l.h = h;
+    l.color   = color;
+    l.visible = true;
+    return l;
+  }
+
   static void display_worker_task(void* pv) {
     auto* dm = (DisplayManager*)pv;
     TFT_eSprite spr(&dm->tft);
@@ -193,58 +562,75 @@ private:
     spr.loadFont(FONT);
     spr.createSprite(MAX_IMAGE_WIDTH + 120, 40);
 
+    TFT_eSprite glcd(&dm->tft);
+    glcd.setColorDepth(16);
+    glcd.createSprite(MAX_IMAGE_WIDTH, TIME_H);
+
+    xSemaphoreTake(dm->tft_mutex, portMAX_DELAY);
+    dm->font_spr = &spr;
+    dm->glcd_spr = &glcd;
+    xSemaphoreGive(dm->tft_mutex);
+
     DisplayCommand cmd;
     while (!dm->stop_worker) {
-      if (xQueueReceive(dm->cmd_queue, &cmd, pdMS_TO_TICKS(100)) == pdPASS) {
+      // Sleep until a command arrives or the next overlay is due to go
+      if (xQueueReceive(dm->cmd_queue, &cmd, dm->overlay_wait(pdMS_TO_TICKS(100))) == pdPASS) {
         switch (cmd.type) {
-          case CMD_TEXT:     dm->handle_text(&spr, cmd.text, cmd.x, cmd.y); break;
+          case CMD_TEXT:     dm->handle_text(cmd.text, cmd.y); break;
           case CMD_PROGRESS: dm->handle_progress(cmd.current_time, cmd.duration); break;
-          case CMD_VOLUME:   dm->handle_volume(cmd.volume); break;
+          case CMD_VOLUME:   dm->handle_volume(); break;
         }
       }
+      dm->expire_overlays();
+
+      xSemaphoreTake(dm->tft_mutex, portMAX_DELAY);
+      dm->compose();
+      xSemaphoreGive(dm->tft_mutex);
       vTaskDelay(1);
     }
 
+    xSemaphoreTake(dm->tft_mutex, portMAX_DELAY);
+    dm->font_spr = dm->glcd_spr = nullptr;
+    xSemaphoreGive(dm->tft_mutex);
+    glcd.deleteSprite();
     spr.deleteSprite();
     spr.unloadFont();
     vTaskDelete(nullptr);
   }
 
-void handle_text(TFT_eSprite* spr, const char* text, uint8_t x, uint8_t y) {
-    int16_t tw = spr->textWidth(text);
-    int field_idx = (y == TITLE_Y ? 0 : y == ARTIST_Y ? 1 : y == ALBUM_Y ? 2 : -1);
+  // Text rows are mask layers. Centred if the string fits, otherwise the
+  // scroller moves the layer's window across the mask.
+  void handle_text(const char* text, uint8_t y) {
+    int idx = (y == TITLE_Y ? 0 : y == ARTIST_Y ? 1 : y == ALBUM_Y ? 2 : 3);
+    auto& f = text_fields[idx];
 
     xSemaphoreTake(tft_mutex, portMAX_DELAY);
-
-    tft.fillRect(0, y, MAX_IMAGE_WIDTH, 40, TFT_BLACK);
-
-    if (tw <= MAX_IMAGE_WIDTH || field_idx == -1) {
-      // No Carousel-ing
-      spr->fillSprite(TFT_BLACK);
-      spr->setTextDatum(MC_DATUM);
-      spr->setTextColor(TFT_WHITE);
-      spr->drawString(text, MAX_IMAGE_WIDTH / 2, 20);
-      spr->pushSprite(0, y);
-      
-      if (field_idx >= 0) 
-        scroll_fields[field_idx].active = false;
-
-    } else {
-      spr->fillSprite(TFT_BLACK);
-      spr->setTextDatum(TL_DATUM);
-      spr->setTextColor(TFT_WHITE);
-
-      // Setup scrolling field
-      auto& f = scroll_fields[field_idx];
-      strncpy(f.text, text, MAX_TEXT_LEN - 1);
-      f.text[MAX_TEXT_LEN - 1] = '\0';
-      f.x = 0;
-      f.y = y;
+    int16_t tw = font_spr->textWidth(text);
+    f.active = false;
+    free_mask(f);
+    comp.hide(UI_TITLE + idx);
+
+    if (tw > 0) {
+      f.mask = (uint8_t*)heap_caps_malloc((size_t)tw * SCROLL_H, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+      if (!f.mask) Serial.printf("[WARN] No memory for a %dpx text mask\n", tw);
+    }
+    if (f.mask) {
       f.width = tw;
-      f.offset = MAX_IMAGE_WIDTH;
-      f.active = true;
-      f.pause_until = 0;
-      start_smooth_scroller();
+      render_mask(font_spr, text, tw, SCROLL_H, (40 - font_spr->fontHeight()) / 2, f.mask);
+
+      if (tw <= MAX_IMAGE_WIDTH || idx == 3) {
+        // No Carousel-ing
+        comp.set_layer(UI_TITLE + idx, mask_layer((MAX_IMAGE_WIDTH - tw) / 2, y, tw, SCROLL_H,
+                                                  f.mask, tw, TFT_WHITE));
+      } else {
+        f.offset = MAX_IMAGE_WIDTH;
+        f.pause_until = 0;
+        Layer l = mask_layer(0, y, MAX_IMAGE_WIDTH, SCROLL_H, f.mask, tw, TFT_WHITE);
+        l.src_x = -f.offset;
+        comp.set_layer(UI_TITLE + idx, l);
+        f.active = true;
+        start_smooth_scroller();
+      }
     }
     xSemaphoreGive(tft_mutex);
   }
@@ -258,106 +644,148 @@ void handle_text(TFT_eSprite* spr, const char* text, uint8_t x, uint8_t y) {
     }, "SmoothScroll", 7168, this, 0, &smooth_scroll_task_handle, 1);
   }
 
-  void smooth_scroll_loop() {
-    TFT_eSprite spr(&tft);
-    if (!spr.createSprite(MAX_IMAGE_WIDTH + 120, 40-2)) {
-      return;
-    }
-    spr.loadFont(FONT);
-    spr.setColorDepth(8);  // Move up for safety
-    spr.setTextWrap(false, true);
+  void free_mask(TextField& f) {
+    heap_caps_free(f.mask);
+    f.mask  = nullptr;
+    f.width = 0;
+  }
 
-    int y_center = (40 - spr.fontHeight()) / 2;
-    spr.setTextDatum(TL_DATUM);
-    spr.setTextColor(TFT_WHITE);
+  void smooth_scroll_loop() {
+    uint32_t window_start = micros(), window_busy = 0, window_frames = 0, window_max = 0;
 
     while (true) {
       bool any_active = false;
       TickType_t now = xTaskGetTickCount();
 
       xSemaphoreTake(tft_mutex, portMAX_DELAY);
-      for (auto& f : scroll_fields) {
+      uint32_t t0 = micros();
+      for (uint8_t i = 0; i < sizeof(text_fields) / sizeof(text_fields[0]); i++) {
+        auto& f = text_fields[i];
         if (!f.active || now < f.pause_until) continue;
         any_active = true;
 
+        int16_t old = f.offset;
         f.offset--;
-        if (f.offset <= -(f.width + 100)) {
+        if (f.offset <= -(f.width + SCROLL_GAP)) {
           f.offset = MAX_IMAGE_WIDTH;
           f.pause_until = now + pdMS_TO_TICKS(1400);
-          // No continue; draw off-right if desired (invisible)
         }
 
-        spr.fillSprite(TFT_BLACK);
-        spr.drawString(f.text, f.offset, y_center);
-        spr.pushSprite(f.x, f.y);
+        // Only the columns the text covered or covers now change
+        Layer& l = comp.edit(UI_TITLE + i);
+        l.src_x = -f.offset;
+        comp.invalidate(old, l.y, f.width, l.h);
+        comp.invalidate(f.offset, l.y, f.width, l.h);
       }
+      compose();
+      uint32_t busy = micros() - t0;
       xSemaphoreGive(tft_mutex);
 
       if (!any_active) {
+        scroll_fps = scroll_busy_permille = 0;
         scroll_task_running = false;
         break; 
       }
 
+      window_busy += busy;
+      window_frames++;
+      if (busy > window_max) window_max = busy;
+      uint32_t elapsed = t0 - window_start;
+      if (elapsed >= 1000000) {
+        scroll_frame_us      = window_busy / window_frames;
+        scroll_max_us        = window_max;
+        scroll_fps           = (uint64_t)window_frames * 1000000 / elapsed;
+        scroll_busy_permille = (uint64_t)window_busy * 1000 / elapsed;
+        window_start = t0;
+        window_busy = window_frames = window_max = 0;
+      }
+
       vTaskDelay(pdMS_TO_TICKS(33)); // 30 fps
     }
-    spr.deleteSprite();
-    spr.unloadFont();
   }
 
+  // Worker task only
   void handle_progress(float cur, float dur) {
     if (dur <= 0) return;
     float prog = constrain(cur / dur, 0.0f, 1.0f);
-    int bar_w = (int)(prog * (MAX_IMAGE_WIDTH - 20) + 0.5f);
+    int16_t bar_w = (int16_t)(prog * (MAX_IMAGE_WIDTH - 20) + 0.5f);
 
     char time_str[20];
     snprintf(time_str, sizeof(time_str), "%02d:%02d / %02d:%02d",
              (int)cur / 60, (int)cur % 60,
              (int)dur / 60, (int)dur % 60);
 
-    bool update_bar = (bar_w != last_bar_width) || !progress_bar_initialized;
-    bool update_txt = strcmp(time_str, last_time_str) != 0;
+    xSemaphoreTake(tft_mutex, portMAX_DELAY);
+    if (!comp.layer(UI_BAR_TRACK).visible) {
+      comp.set_layer(UI_BAR_TRACK, fill_layer(10, PROGRESS_Y, MAX_IMAGE_WIDTH - 20, 10,
+                                              tft.color565(220, 200, 240)));
+    }
 
-    if (update_bar || update_txt) {
-      xSemaphoreTake(tft_mutex, portMAX_DELAY);
-      if (update_bar) {
-        tft.fillRect(10, PROGRESS_Y, MAX_IMAGE_WIDTH - 20, 10, tft.color565(220, 200, 240));
-        tft.fillRect(10, PROGRESS_Y, bar_w, 10, tft.color565(180, 150, 220));
-        last_bar_width = bar_w;
-        progress_bar_initialized = true;
-      }
-      if (update_txt) {
-        tft.fillRect(0, PROGRESS_Y + 15, MAX_IMAGE_WIDTH, 16, TFT_BLACK);
-        tft.setTextSize(2);
-        tft.setTextColor(tft.color565(240, 230, 255));
-        tft.setCursor((MAX_IMAGE_WIDTH - tft.textWidth(time_str)) / 2, PROGRESS_Y + 15);
-        tft.print(time_str);
-        strcpy(last_time_str, time_str);
-      }
-      xSemaphoreGive(tft_mutex);
+    // A growing bar only dirties the columns it gained
+    Layer& bar = comp.edit(UI_BAR_FILL);
+    if (!bar.visible || bar.w != bar_w) {
+      int16_t was = bar.visible ? bar.w : 0;
+      bar = fill_layer(10, PROGRESS_Y, bar_w, 10, tft.color565(180, 150, 220));
+      comp.invalidate(10 + (was < bar_w ? was : bar_w), PROGRESS_Y, abs(bar_w - was), 10);
     }
+
+    if (strcmp(time_str, last_time_str) != 0) {
+      glcd_spr->setTextSize(2);
+      int16_t tw = glcd_spr->textWidth(time_str);
+      if (tw > MAX_IMAGE_WIDTH) tw = MAX_IMAGE_WIDTH;
+      render_mask(glcd_spr, time_str, tw, TIME_H, 0, time_mask);
+      comp.set_layer(UI_TIME, mask_layer((MAX_IMAGE_WIDTH - tw) / 2, PROGRESS_Y + 15, tw, TIME_H,
+                                         time_mask, tw, tft.color565(240, 230, 255)));
+      strcpy(last_time_str, time_str);
+    }
+    xSemaphoreGive(tft_mutex);
   }
 
-  void handle_volume(float vol) {
+  void handle_volume() {
+    volume_queued = false;
+    float vol = pending_volume;
     if (vol < 0 || vol > 100) return;
-    char buf[8];
-    snprintf(buf, sizeof(buf), "%.0f%%", vol);
+
+    char text[8];
+    snprintf(text, sizeof(text), "%.0f%%", vol);
 
     xSemaphoreTake(tft_mutex, portMAX_DELAY);
-    tft.fillRect(VOLUME_X, VOLUME_Y, VOLUME_W, VOLUME_H, TFT_BLACK);
-    tft.setTextSize(1);
-    tft.setTextColor(TFT_WHITE);
-    tft.setCursor(VOLUME_X + 8, VOLUME_Y + 6);
-    tft.print(buf);
+    glcd_spr->setTextSize(1);
+    int16_t tw = glcd_spr->textWidth(text);
+    if (tw > VOLUME_W - 8) tw = VOLUME_W - 8;
+    render_mask(glcd_spr, text, tw, 8, 0, volume_mask);
+    comp.set_layer(UI_VOLUME_BOX, fill_layer(VOLUME_X, VOLUME_Y, VOLUME_W, VOLUME_H, TFT_BLACK));
+    comp.set_layer(UI_VOLUME_TEXT, mask_layer(VOLUME_X + 8, VOLUME_Y + 6, tw, 8,
+                                              volume_mask, tw, TFT_WHITE));
     xSemaphoreGive(tft_mutex);
 
-    last_volume = vol;
-    vTaskDelay(pdMS_TO_TICKS(2000));
+    Overlay& o = overlays[OVERLAY_VOLUME];
+    o.expires = xTaskGetTickCount() + pdMS_TO_TICKS(VOLUME_SHOW_MS);
+    o.visible = true;
+  }
+
+  // Ticks until the earliest overlay deadline, at most `limit`
+  TickType_t overlay_wait(TickType_t limit) {
+    TickType_t now = xTaskGetTickCount();
+    for (const Overlay& o : overlays) {
+      if (!o.visible) continue;
+      int32_t left = (int32_t)(o.expires - now);
+      if (left <= 0) return 0;
+      if ((TickType_t)left < limit) limit = left;
+    }
+    return limit;
+  }
 
-    if (last_volume == vol) {
+  // Hides overlays past their deadline; the next compose brings back
+  // whatever they covered
+  void expire_overlays() {
+    TickType_t now = xTaskGetTickCount();
+    for (Overlay& o : overlays) {
+      if (!o.visible || (int32_t)(o.expires - now) > 0) continue;
+      o.visible = false;
       xSemaphoreTake(tft_mutex, portMAX_DELAY);
-      tft.fillRect(VOLUME_X, VOLUME_Y, VOLUME_W, VOLUME_H, TFT_BLACK);
+      for (uint8_t i = 0; i < o.layers; i++) comp.hide(o.first_layer + i);
       xSemaphoreGive(tft_mutex);
-      last_volume = -1;
     }
   }
-};
\ No newline at end of file
+};
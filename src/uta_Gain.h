@@ -0,0 +1,275 @@
+#pragma once
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ReplayGain / EBU R128 tags, and the fixed-point output gain that applies
+// loudness normalisation and volume as one factor.
+
+// ESP32-S3 only: 16-bit attenuation on the PIE vector unit. Off until it is
+// checked on hardware against gain_scalar_s16(), which test_gain covers.
+#ifndef GAIN_PIE
+#define GAIN_PIE 0
+#endif
+
+#define GAIN_UNITY          0x10000u            // Q16.16
+#define GAIN_MAX            (4 * GAIN_UNITY)    // +12 dB
+#define RG_PEAK_UNITY       0x4000u             // Q2.14 full scale
+#define RG_LIMIT_CDB        6000                // tags beyond +-60 dB are junk
+#define RG_R128_OFFSET_CDB  500                 // R128 targets -23 LUFS, ReplayGain about -18
+#define GAIN_RAMP_FRAMES    512                 // about 11 ms at 44.1 kHz
+
+#define RG_HAS_TRACK  0x01
+#define RG_HAS_ALBUM  0x02
+
+enum ReplayGainMode : uint8_t {
+  REPLAYGAIN_OFF,
+  REPLAYGAIN_TRACK,
+  REPLAYGAIN_ALBUM,
+  REPLAYGAIN_MODES,
+};
+
+struct ReplayGain {
+  int16_t  track_cdb  = 0;    // gain in 1/100 dB
+  int16_t  album_cdb  = 0;
+  uint16_t track_peak = 0;    // Q2.14, 0 = unknown
+  uint16_t album_peak = 0;
+  uint8_t  flags      = 0;    // RG_HAS_*
+};
+
+inline const char* replaygain_mode_name(ReplayGainMode mode) {
+  switch (mode) {
+    case REPLAYGAIN_TRACK: return "TRACK";
+    case REPLAYGAIN_ALBUM: return "ALBUM";
+    default:               return "OFF";
+  }
+}
+
+// Bytes one sample occupies in the PCM stream. 24-bit audio travels in
+// 32-bit containers, sign-extended.
+inline size_t pcm_sample_bytes(uint8_t bits) {
+  return bits == 24 ? 4 : bits / 8;
+}
+
+inline bool rg_parse_number(const char* value, size_t len, float& out) {
+  char buf[24];
+  if (len >= sizeof(buf)) len = sizeof(buf) - 1;
+  memcpy(buf, value, len);
+  buf[len] = '\0';
+
+  char* end;
+  out = strtof(buf, &end);
+  return end != buf && isfinite(out);
+}
+
+inline int16_t rg_clamp_cdb(long cdb) {
+  if (cdb >  RG_LIMIT_CDB) return  RG_LIMIT_CDB;
+  if (cdb < -RG_LIMIT_CDB) return -RG_LIMIT_CDB;
+  return (int16_t)cdb;
+}
+
+inline uint16_t rg_peak_q14(float peak) {
+  if (!(peak > 0.0f)) return 0;
+  float q = peak * RG_PEAK_UNITY + 0.5f;
+  return q >= 65535.0f ? 65535 : (uint16_t)q;
+}
+
+// Takes one upper-cased tag. REPLAYGAIN_*_GAIN ("-6.20 dB") always wins
+// over R128_*_GAIN (Q7.8 dB relative to -23 LUFS, as in Opus): it replaces
+// an R128 value seen earlier, and a later R128 tag is ignored. Returns false
+// for unrelated keys.
+inline bool rg_parse_tag(const char* key, const char* value, size_t len, ReplayGain& rg) {
+  float v;
+  if (strncmp(key, "REPLAYGAIN_", 11) == 0) {
+    const char* k = key + 11;
+    if      (strcmp(k, "TRACK_GAIN") == 0) { if (rg_parse_number(value, len, v)) { rg.track_cdb = rg_clamp_cdb(lroundf(v * 100)); rg.flags |= RG_HAS_TRACK; } }
+    else if (strcmp(k, "ALBUM_GAIN") == 0) { if (rg_parse_number(value, len, v)) { rg.album_cdb = rg_clamp_cdb(lroundf(v * 100)); rg.flags |= RG_HAS_ALBUM; } }
+    else if (strcmp(k, "TRACK_PEAK") == 0) { if (rg_parse_number(value, len, v)) rg.track_peak = rg_peak_q14(v); }
+    else if (strcmp(k, "ALBUM_PEAK") == 0) { if (rg_parse_number(value, len, v)) rg.album_peak = rg_peak_q14(v); }
+    else return false;
+    return true;
+  }
+  if (strncmp(key, "R128_", 5) == 0) {
+    bool track = strcmp(key + 5, "TRACK_GAIN") == 0;
+    bool album = strcmp(key + 5, "ALBUM_GAIN") == 0;
+    if (!track && !album) return false;
+
+    uint8_t flag = track ? RG_HAS_TRACK : RG_HAS_ALBUM;
+    if (rg.flags & flag) return true;
+    if (!rg_parse_number(value, len, v)) return true;
+
+    int16_t cdb = rg_clamp_cdb(lroundf(v * 100 / 256) + RG_R128_OFFSET_CDB);
+    if (track) rg.track_cdb = cdb;
+    else       rg.album_cdb = cdb;
+    rg.flags |= flag;
+    return true;
+  }
+  return false;
+}
+
+inline uint32_t gain_from_db(float db) {
+  float g = powf(10.0f, db / 20.0f) * GAIN_UNITY + 0.5f;
+  return g >= (float)GAIN_MAX ? GAIN_MAX : (uint32_t)g;
+}
+
+// Volume knob position (0..1) on an audio taper
+inline uint32_t gain_from_level(float level) {
+  if (level <= 0.0f) return 0;
+  if (level >= 1.0f) return GAIN_UNITY;
+  return (uint32_t)(level * level * GAIN_UNITY + 0.5f);
+}
+
+inline uint32_t gain_mul(uint32_t a, uint32_t b) {
+  uint64_t g = ((uint64_t)a * b) >> 16;
+  return g > GAIN_MAX ? GAIN_MAX : (uint32_t)g;
+}
+
+// Loudness gain for one track. A missing track gain falls back to the
+// album gain and vice versa; untagged tracks play at unity. The tagged
+// peak caps the gain so normalisation alone never clips.
+inline uint32_t rg_gain(const ReplayGain& rg, ReplayGainMode mode, int preamp_cdb = 0) {
+  if (mode == REPLAYGAIN_OFF || !(rg.flags & (RG_HAS_TRACK | RG_HAS_ALBUM))) return GAIN_UNITY;
+
+  bool album = mode == REPLAYGAIN_ALBUM ? (rg.flags & RG_HAS_ALBUM) : !(rg.flags & RG_HAS_TRACK);
+  int      cdb  = (album ? rg.album_cdb : rg.track_cdb) + preamp_cdb;
+  uint16_t peak = album ? rg.album_peak : rg.track_peak;
+
+  uint32_t gain = gain_from_db(cdb / 100.0f);
+  if (peak > 0) {
+    uint64_t limit = ((uint64_t)GAIN_UNITY * RG_PEAK_UNITY) / peak;
+    if (gain > limit) gain = (uint32_t)limit;
+  }
+  return gain;
+}
+
+inline int32_t gain_saturate(int64_t v, int32_t lo, int32_t hi) {
+  return v < lo ? lo : v > hi ? hi : (int32_t)v;
+}
+
+// A Q16.16 gain as a mantissa and a left shift 0..2, so the multiply stays
+// in Q15 (16-bit PCM) or Q31 (24/32-bit PCM) for gains up to GAIN_MAX
+inline uint8_t gain_exponent(uint32_t g) {
+  return g < GAIN_UNITY ? 0 : g < 2 * GAIN_UNITY ? 1 : 2;
+}
+inline uint32_t gain_clamp(uint32_t g) {
+  return g >= GAIN_MAX ? GAIN_MAX - 1 : g;
+}
+
+// out = sat(s * m15 * 2^e / 2^15)
+inline int16_t gain_q15(int16_t s, int32_t m15, uint8_t e) {
+  int32_t v = ((int32_t)s * m15) >> (15 - e);
+  return e ? (int16_t)gain_saturate(v, INT16_MIN, INT16_MAX) : (int16_t)v;
+}
+
+// out = sat(s * m31 * 2^e / 2^31)
+inline int32_t gain_q31(int32_t s, int64_t m31, uint8_t e, int32_t lo, int32_t hi) {
+  return gain_saturate(((int64_t)s * m31) >> (31 - e), lo, hi);
+}
+
+inline void gain_scalar_s16(int16_t* s, size_t n, uint32_t g) {
+  g = gain_clamp(g);
+  uint8_t e   = gain_exponent(g);
+  int32_t m15 = (int32_t)(g >> (1 + e));
+  for (size_t i = 0; i < n; i++) s[i] = gain_q15(s[i], m15, e);
+}
+
+#if GAIN_PIE
+// Attenuation only (e == 0): |s * m15| >> 15 always fits, so the vector
+// multiply needs no saturation and matches gain_q15() bit for bit.
+// Eight lanes per EE.VMUL.S16, result shifted right by SAR.
+inline void gain_pie_s16(int16_t* s, size_t n, int16_t m15) {
+  while (n > 0 && ((uintptr_t)s & 15)) {
+    *s = gain_q15(*s, m15, 0);
+    s++;
+    n--;
+  }
+  uint32_t blocks = n / 8;
+  if (blocks > 0) {
+    int16_t* p = s;
+    asm volatile(
+      "wsr.sar        %[shift]          \n"
+      "ee.vldbc.16    q7, %[gain]       \n"
+      "1:                               \n"
+      "ee.vld.128.ip  q0, %[p], 0       \n"
+      "ee.vmul.s16    q1, q0, q7        \n"
+      "ee.vst.128.ip  q1, %[p], 16      \n"
+      "addi           %[blocks], %[blocks], -1 \n"
+      "bnez           %[blocks], 1b     \n"
+      : [p] "+r"(p), [blocks] "+r"(blocks)
+      : [gain] "r"(&m15), [shift] "r"(15)
+      : "memory");
+  }
+  for (size_t i = n & ~(size_t)7; i < n; i++) s[i] = gain_q15(s[i], m15, 0);
+}
+#endif
+
+inline void gain_s16(int16_t* s, size_t n, uint32_t g) {
+#if GAIN_PIE
+  if (g < GAIN_UNITY) {
+    gain_pie_s16(s, n, (int16_t)(g >> 1));
+    return;
+  }
+#endif
+  gain_scalar_s16(s, n, g);
+}
+
+// 32-bit samples, or 24-bit ones sign-extended in 32-bit containers
+inline void gain_s32(int32_t* s, size_t n, uint32_t g, uint8_t bits) {
+  g = gain_clamp(g);
+  uint8_t e   = gain_exponent(g);
+  int64_t m31 = (int64_t)g << (15 - e);
+  int32_t hi  = bits == 24 ? 0x7FFFFF : INT32_MAX;
+  int32_t lo  = -hi - 1;
+  for (size_t i = 0; i < n; i++) s[i] = gain_q31(s[i], m31, e, lo, hi);
+}
+
+// Scales whole samples in place by a Q16.16 gain, saturating to the
+// sample width. Trailing bytes of a partial sample are left alone.
+inline void gain_apply(uint8_t* pcm, size_t bytes, uint8_t bits, uint32_t gain) {
+  if (gain == GAIN_UNITY) return;
+  if (bits == 16)                   gain_s16((int16_t*)pcm, bytes / 2, gain);
+  else if (bits == 24 || bits == 32) gain_s32((int32_t*)pcm, bytes / 4, gain, bits);
+}
+
+// Output gain with a linear per-frame ramp, so volume and mode changes do
+// not step the waveform (zipper noise). Track boundaries jump instead: the
+// first sample of a track should already have that track's gain.
+class OutputGain {
+public:
+  void jump(uint32_t gain) {
+    current = target = gain;
+    ramp_left = 0;
+  }
+
+  void ramp_to(uint32_t gain, uint32_t frames = GAIN_RAMP_FRAMES) {
+    if (gain == target) return;
+    target    = gain;
+    ramp_left = frames;
+    step      = ((int64_t)target - (int64_t)current) / (int64_t)frames;
+  }
+
+  uint32_t gain() const { return current; }
+
+  void process(uint8_t* pcm, size_t bytes, uint8_t bits, uint8_t channels) {
+    size_t sample = pcm_sample_bytes(bits);
+    size_t frame  = sample * channels;
+    if (frame == 0 || (bits != 16 && bits != 24 && bits != 32)) return;
+
+    while (ramp_left > 0 && bytes >= frame) {
+      current = --ramp_left == 0 ? target : (uint32_t)((int64_t)current + step);
+      gain_apply(pcm, frame, bits, current);
+      pcm   += frame;
+      bytes -= frame;
+    }
+    gain_apply(pcm, bytes, bits, current);
+  }
+
+private:
+  uint32_t current   = GAIN_UNITY;
+  uint32_t target    = GAIN_UNITY;
+  uint32_t ramp_left = 0;
+  int64_t  step      = 0;
+};
@@ -0,0 +1,434 @@
+#pragma once
+
+#include "uta_SDCard.h"
+#include "uta_Audio.h"
+#include "uta_LibraryIndex.h"
+
+#define LIBRARY_DIR         "/.uta"
+#define LIBRARY_INDEX_PATH  "/.uta/library.idx"
+#define LIBRARY_INDEX_TMP   "/.uta/library.tmp"
+#define LIBRARY_MAX_PATH    512
+
+// Background rescan runs below the decoder and writer on the audio core
+#define LIBRARY_SCAN_CORE      0
+#define LIBRARY_SCAN_PRIORITY  1
+
+/// Albums and tracks under ROOT, backed by the binary index on the card.
+/// The index is read into PSRAM once and used in place; the card is only
+/// walked when there is no usable index or a rescan is requested.
+///
+/// Rescans are incremental: every album folder gets a cheap directory-only
+/// signature (newest modify stamp and entry count over its whole tree). Only
+/// albums whose signature differs from the stored one are re-walked and have
+/// their files parsed; the rest are copied over from the previous index.
+class Library {
+public:
+  struct ScanStatus {
+    volatile bool     running;
+    volatile bool     ok;
+    volatile uint32_t albums_total;
+    volatile uint32_t albums_done;
+    volatile uint32_t albums_rescanned;
+    volatile uint32_t entries_visited;
+    volatile uint32_t files_parsed;
+    unsigned long     started_ms;
+    unsigned long     finished_ms;
+  };
+
+  bool begin(const char* root) {
+    char wanted[LIBRARY_MAX_PATH];
+    normalize_dir(root, wanted, sizeof(wanted));
+
+    if (load() && strcmp(view.root(), wanted) == 0) {
+      // Usable index: pick up card changes quietly while we play
+      start_background_rescan(root);
+      return true;
+    }
+
+    Serial.println("[INFO] Library index missing or stale, scanning card...");
+    return rebuild(root);
+  }
+
+  bool load() {
+    SdLock lock;
+    unsigned long t0 = micros();
+    release();
+
+    FsFile file = sd.open(LIBRARY_INDEX_PATH, O_RDONLY);
+    if (!file) return false;
+
+    size_t size = file.fileSize();
+    image = (uint8_t*)heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!image) {
+      file.close();
+      Serial.println("[ERROR] No memory for library index");
+      return false;
+    }
+
+    bool ok = file.read(image, size) == (int)size;
+    file.close();
+
+    if (!ok || !view.attach(image, size)) {
+      Serial.println("[WARN] Library index is corrupt or from another version");
+      release();
+      return false;
+    }
+
+    image_size = size;
+    Serial.printf("[INFO] Library index: %lu albums, %lu tracks, %u KB in %lu us\n",
+                  view.album_count(), view.track_count(), image_size / 1024, micros() - t0);
+    return true;
+  }
+
+  // Blocking full scan, used when there is no index to start from
+  bool rebuild(const char* root) {
+    if (status.running) return false;
+    if (!scan(root, nullptr, false)) return false;
+    return load();
+  }
+
+  // Incremental scan in a low-priority task. The new index is swapped in
+  // by poll() from the UI loop once the task has written it.
+  bool start_background_rescan(const char* root) {
+    if (status.running) return false;
+
+    normalize_dir(root, scan_root, sizeof(scan_root));
+    status.running = true;
+    if (xTaskCreatePinnedToCore(rescan_task, "LibScan", 12288, this,
+                                LIBRARY_SCAN_PRIORITY, &scan_task_handle,
+                                LIBRARY_SCAN_CORE) != pdPASS) {
+      status.running = false;
+      return false;
+    }
+    return true;
+  }
+
+  // Returns true when a rescanned index has just been loaded
+  bool poll() {
+    if (!reload_pending || status.running) return false;
+    reload_pending = false;
+    return load();
+  }
+
+  const ScanStatus& scan_status() const { return status; }
+
+  uint32_t album_count() const { return view.album_count(); }
+  uint32_t track_count() const { return view.track_count(); }
+
+  const char* album_path(uint32_t i) const {
+    return i < album_count() ? view.str(view.album(i).path_str) : "";
+  }
+
+  const char* album_name(uint32_t i) const {
+    return i < album_count() ? view.str(view.album(i).name_str) : "";
+  }
+
+  int find_album(const char* path) const {
+    return find_album(view, path);
+  }
+
+  // Hands the album's tracks to the player's queue, no card access needed
+  uint32_t queue_album(uint32_t i, PathNamesRegistry& queue) const {
+    if (i >= album_count()) return 0;
+
+    const auto& a = view.album(i);
+    char path[LIBRARY_MAX_PATH];
+    for (uint32_t t = 0; t < a.track_count; t++) {
+      const auto& tr = view.track(a.first_track + t);
+      snprintf(path, sizeof(path), "%s%s", view.str(a.path_str), view.str(tr.path_str));
+      queue.addName(path);
+    }
+    return a.track_count;
+  }
+
+  void print_album(uint32_t i) const {
+    if (i >= album_count()) return;
+
+    const auto& a = view.album(i);
+    char duration[12];
+    for (uint32_t t = 0; t < a.track_count; t++) {
+      const auto& tr = view.track(a.first_track + t);
+      formatDuration(tr.duration_ms / 1000.0f, duration, sizeof(duration));
+      const char* title = *view.str(tr.title_str) ? view.str(tr.title_str) : view.str(tr.path_str);
+      Serial.printf("  %2lu. %-44s %8s\n", t + 1, title, duration);
+    }
+  }
+
+  ~Library() { release(); }
+
+private:
+  uint8_t*         image      = nullptr;
+  size_t           image_size = 0;
+  LibraryIndexView view;
+
+  ScanStatus       status{};
+  TaskHandle_t     scan_task_handle = nullptr;
+  volatile bool    reload_pending   = false;
+  char             scan_root[LIBRARY_MAX_PATH] = {0};
+
+  void release() {
+    view.attach(nullptr, 0);
+    if (image) heap_caps_free(image);
+    image      = nullptr;
+    image_size = 0;
+  }
+
+  static void rescan_task(void* arg) {
+    auto* lib = (Library*)arg;
+    bool changed = false;
+    bool ok = lib->scan(lib->scan_root, lib->view.valid() ? &lib->view : nullptr, true, &changed);
+
+    lib->reload_pending = ok && changed;
+    lib->scan_task_handle = nullptr;
+    vTaskDelete(nullptr);
+  }
+
+  static void normalize_dir(const char* in, char* out, size_t size) {
+    size_t len = strlen(in);
+    bool slash = len > 0 && in[len - 1] == '/';
+    snprintf(out, size, slash ? "%s" : "%s/", in);
+  }
+
+  static int find_album(const LibraryIndexView& v, const char* path) {
+    for (uint32_t i = 0; i < v.album_count(); i++) {
+      if (strcmp(v.str(v.album(i).path_str), path) == 0) return i;
+    }
+    return -1;
+  }
+
+  static uint32_t modify_stamp(FsFile& file) {
+    uint16_t date = 0, time = 0;
+    file.getModifyDateTime(&date, &time);
+    return ((uint32_t)date << 16) | time;
+  }
+
+  // Walks `root`, reusing unchanged albums from `previous` when given.
+  // Card access is locked per entry so playback keeps its share of the bus.
+  bool scan(const char* root, const LibraryIndexView* previous, bool background, bool* changed = nullptr) {
+    char root_dir[LIBRARY_MAX_PATH];
+    normalize_dir(root, root_dir, sizeof(root_dir));
+
+    status.running          = true;
+    status.ok               = false;
+    status.albums_total     = 0;
+    status.albums_done      = 0;
+    status.albums_rescanned = 0;
+    status.entries_visited  = 0;
+    status.files_parsed     = 0;
+    status.started_ms       = millis();
+    status.finished_ms      = 0;
+
+    sd_lock();
+    FsFile dir = sd.open(root_dir, O_RDONLY);
+    bool is_dir = dir && dir.isDir();
+    if (is_dir) status.albums_total = count_albums(dir);
+    sd_unlock();
+
+    if (!is_dir) {
+      Serial.printf("[ERROR] Cannot open library root: %s\n", root_dir);
+      status.running = false;
+      return false;
+    }
+
+    LibraryIndexBuilder builder;
+    builder.set_root(root_dir);
+
+    FsFile entry;
+    char name[256];
+    char path[LIBRARY_MAX_PATH];
+    uint32_t reused = 0;
+
+    while (true) {
+      sd_lock();
+      bool more = entry.openNext(&dir, O_RDONLY);
+      bool album = more && entry.isDir() && !entry.isHidden();
+      if (album) {
+        entry.getName(name, sizeof(name));
+        snprintf(path, sizeof(path), "%s%s/", root_dir, name);
+      }
+      sd_unlock();
+      if (!more) break;
+
+      if (album) {
+        uint32_t stamp = 0, entries = 0;
+        album_signature(entry, stamp, entries, background);
+
+        int old = previous ? find_album(*previous, path) : -1;
+        const LibraryAlbumRecord* rec = old >= 0 ? &previous->album(old) : nullptr;
+
+        if (rec && rec->modify_time == stamp && rec->entry_count == entries) {
+          copy_album(builder, *previous, *rec);
+          reused++;
+        } else {
+          builder.begin_album(path, name, stamp, entries);
+          scan_tree(builder, entry, name_buf(), 0, background);
+          builder.drop_empty_album();
+          status.albums_rescanned++;
+          Serial.printf("  [scan] %s%s\n", name, rec ? " (changed)" : " (new)");
+        }
+        status.albums_done++;
+      }
+
+      sd_lock();
+      entry.close();
+      sd_unlock();
+      if (background) vTaskDelay(1);
+    }
+
+    sd_lock();
+    dir.close();
+    sd_unlock();
+
+    // Anything rescanned, added or removed means the index on the card is stale
+    bool dirty = !previous || status.albums_rescanned > 0 || reused != previous->album_count();
+    if (changed) *changed = dirty;
+
+    bool ok = true;
+    if (dirty) {
+      sd_lock();
+      ok = write_index(builder);
+      sd_unlock();
+      if (!ok) Serial.println("[ERROR] Failed to write library index");
+    }
+
+    status.finished_ms = millis();
+    status.ok          = ok;
+    status.running     = false;
+
+    Serial.printf("[INFO] Library scan: %lu albums (%lu rescanned), %lu files parsed in %lu ms\n",
+                  builder.album_count(), status.albums_rescanned, status.files_parsed,
+                  status.finished_ms - status.started_ms);
+    return ok;
+  }
+
+  // Shared scratch for relative paths; only one scan runs at a time
+  static char* name_buf() {
+    static char rel[LIBRARY_MAX_PATH];
+    rel[0] = '\0';
+    return rel;
+  }
+
+  static uint32_t count_albums(FsFile& dir) {
+    FsFile entry;
+    uint32_t count = 0;
+    dir.rewindDirectory();
+    while (entry.openNext(&dir, O_RDONLY)) {
+      if (entry.isDir() && !entry.isHidden()) count++;
+      entry.close();
+    }
+    dir.rewindDirectory();
+    return count;
+  }
+
+  // Newest modify stamp and total entry count over an album's tree. Only
+  // directory entries are read; no file data is touched.
+  void album_signature(FsFile& dir, uint32_t& stamp, uint32_t& entries, bool background) {
+    FsFile entry;
+
+    sd_lock();
+    stamp = max(stamp, modify_stamp(dir));
+    dir.rewindDirectory();
+    sd_unlock();
+
+    while (true) {
+      sd_lock();
+      bool more = entry.openNext(&dir, O_RDONLY);
+      bool sub  = more && entry.isDir();
+      if (more) {
+        entries++;
+        status.entries_visited++;
+        stamp = max(stamp, modify_stamp(entry));
+      }
+      sd_unlock();
+      if (!more) break;
+
+      if (sub) album_signature(entry, stamp, entries, background);
+
+      sd_lock();
+      entry.close();
+      sd_unlock();
+    }
+    if (background) vTaskDelay(1);
+  }
+
+  static void copy_album(LibraryIndexBuilder& builder, const LibraryIndexView& v, const LibraryAlbumRecord& a) {
+    builder.begin_album(v.str(a.path_str), v.str(a.name_str), a.modify_time, a.entry_count);
+    for (uint32_t t = 0; t < a.track_count; t++) {
+      const auto& tr = v.track(a.first_track + t);
+      builder.add_track(v.str(tr.path_str), v.str(tr.title_str), v.str(tr.artist_str), v.str(tr.album_str),
+                        tr.duration_ms, tr.total_samples, tr.file_size);
+    }
+  }
+
+  void scan_tree(LibraryIndexBuilder& builder, FsFile& dir, char* rel, size_t rel_len, bool background) {
+    FsFile entry;
+    char name[256];
+    AudioManager::Metadata meta;
+
+    sd_lock();
+    dir.rewindDirectory();
+    sd_unlock();
+
+    while (true) {
+      sd_lock();
+      if (!entry.openNext(&dir, O_RDONLY)) {
+        sd_unlock();
+        break;
+      }
+
+      bool descend = false;
+      entry.getName(name, sizeof(name));
+      size_t name_len = strlen(name);
+
+      if (!entry.isHidden() && rel_len + name_len + 2 < LIBRARY_MAX_PATH) {
+        memcpy(rel + rel_len, name, name_len + 1);
+
+        if (entry.isDir()) {
+          rel[rel_len + name_len]     = '/';
+          rel[rel_len + name_len + 1] = '\0';
+          descend = true;
+        } else if (AudioManager::is_supported(name)) {
+          meta = AudioManager::Metadata{};
+          AudioManager::read_metadata(entry, meta);
+          if (probe_playable(meta.format)) {
+            builder.add_track(rel, meta.title(), meta.artist(), meta.album(),
+                              (uint32_t)(meta.duration * 1000.0f), meta.total_samples, entry.fileSize());
+          }
+          status.files_parsed++;
+        }
+      }
+      sd_unlock();
+
+      if (descend) scan_tree(builder, entry, rel, rel_len + name_len + 1, background);
+
+      sd_lock();
+      rel[rel_len] = '\0';
+      entry.close();
+      sd_unlock();
+
+      if (background) vTaskDelay(1);
+    }
+  }
+
+  static bool write_index(const LibraryIndexBuilder& builder) {
+    if (!sd.exists(LIBRARY_DIR) && !sd.mkdir(LIBRARY_DIR)) return false;
+    if (sd.exists(LIBRARY_INDEX_TMP)) sd.remove(LIBRARY_INDEX_TMP);
+
+    FsFile file = sd.open(LIBRARY_INDEX_TMP, O_WRONLY | O_CREAT | O_TRUNC);
+    if (!file) return false;
+
+    size_t written = builder.serialize([&](const void* data, size_t len) {
+      return file.write((const uint8_t*)data, len) == len;
+    });
+    file.close();
+    if (written == 0) return false;
+
+    // Swap in only once the new index is completely on the card
+    if (sd.exists(LIBRARY_INDEX_PATH)) sd.remove(LIBRARY_INDEX_PATH);
+    return sd.rename(LIBRARY_INDEX_TMP, LIBRARY_INDEX_PATH);
+  }
+
+  static uint32_t max(uint32_t a, uint32_t b) { return a > b ? a : b; }
+};
+
+Library library;
@@ -0,0 +1,217 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+// On-card library index (/.uta/library.idx): header, album records, track
+// records, then a string table, all little-endian and usable in place.
+
+#define LIBRARY_INDEX_MAGIC    0x49415455u  // "UTAI"
+#define LIBRARY_INDEX_VERSION  1   // bump when a record changes shape; old files are rebuilt
+#define LIBRARY_NO_STRING      0xFFFFFFFFu
+
+struct LibraryIndexHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t header_size;
+  uint32_t album_count;
+  uint32_t track_count;
+  uint32_t albums_offset;
+  uint32_t tracks_offset;
+  uint32_t strings_offset;
+  uint32_t strings_size;
+  uint32_t root_str;
+  uint32_t checksum;      // FNV-1a over everything after the header
+};
+
+struct LibraryAlbumRecord {
+  uint32_t path_str;      // absolute directory path, with trailing '/'
+  uint32_t name_str;      // last path component, for display
+  uint32_t first_track;
+  uint32_t track_count;
+  uint32_t modify_time;   // FAT date << 16 | FAT time of the directory
+  uint32_t entry_count;   // directory entries seen when it was scanned
+};
+
+struct LibraryTrackRecord {
+  uint32_t path_str;      // relative to the album directory
+  uint32_t title_str;
+  uint32_t artist_str;
+  uint32_t album_str;
+  uint32_t album;
+  uint32_t duration_ms;
+  uint64_t total_samples;
+  uint64_t file_size;
+};
+
+static_assert(sizeof(LibraryIndexHeader) == 40, "index header layout changed");
+static_assert(sizeof(LibraryAlbumRecord) == 24, "album record layout changed");
+static_assert(sizeof(LibraryTrackRecord) == 40, "track record layout changed");
+
+inline uint32_t library_fnv1a(const uint8_t* data, size_t len, uint32_t hash = 2166136261u) {
+  for (size_t i = 0; i < len; i++) {
+    hash ^= data[i];
+    hash *= 16777619u;
+  }
+  return hash;
+}
+
+/// Read-only view over a loaded index image. Does not own the memory.
+class LibraryIndexView {
+public:
+  bool attach(const uint8_t* data, size_t size) {
+    image = nullptr;
+    if (!data || size < sizeof(LibraryIndexHeader)) return false;
+
+    const auto* h = (const LibraryIndexHeader*)data;
+    if (h->magic != LIBRARY_INDEX_MAGIC || h->version != LIBRARY_INDEX_VERSION) return false;
+    if (h->header_size != sizeof(LibraryIndexHeader)) return false;
+
+    uint64_t albums_end  = (uint64_t)h->albums_offset + (uint64_t)h->album_count * sizeof(LibraryAlbumRecord);
+    uint64_t tracks_end  = (uint64_t)h->tracks_offset + (uint64_t)h->track_count * sizeof(LibraryTrackRecord);
+    uint64_t strings_end = (uint64_t)h->strings_offset + h->strings_size;
+    if (albums_end > size || tracks_end > size || strings_end > size) return false;
+    if (h->strings_size == 0 || data[strings_end - 1] != '\0') return false;
+
+    uint32_t sum = library_fnv1a(data + sizeof(LibraryIndexHeader), size - sizeof(LibraryIndexHeader));
+    if (sum != h->checksum) return false;
+
+    image      = data;
+    image_size = size;
+    return true;
+  }
+
+  bool valid() const { return image != nullptr; }
+
+  const LibraryIndexHeader& header() const { return *(const LibraryIndexHeader*)image; }
+
+  uint32_t album_count() const { return valid() ? header().album_count : 0; }
+  uint32_t track_count() const { return valid() ? header().track_count : 0; }
+
+  const LibraryAlbumRecord& album(uint32_t i) const {
+    return ((const LibraryAlbumRecord*)(image + header().albums_offset))[i];
+  }
+
+  const LibraryTrackRecord& track(uint32_t i) const {
+    return ((const LibraryTrackRecord*)(image + header().tracks_offset))[i];
+  }
+
+  // Returns "" for missing or out-of-range strings
+  const char* str(uint32_t offset) const {
+    if (!valid() || offset == LIBRARY_NO_STRING || offset >= header().strings_size) return "";
+    return (const char*)(image + header().strings_offset + offset);
+  }
+
+  const char* root() const { return str(header().root_str); }
+
+private:
+  const uint8_t* image      = nullptr;
+  size_t         image_size = 0;
+};
+
+/// Accumulates albums and tracks, then serialises a complete index image.
+class LibraryIndexBuilder {
+public:
+  void clear() {
+    albums.clear();
+    tracks.clear();
+    strings.clear();
+    root_str = LIBRARY_NO_STRING;
+    last_artist = last_album = LIBRARY_NO_STRING;
+  }
+
+  void set_root(const char* root) { root_str = intern(root); }
+
+  uint32_t album_count() const { return albums.size(); }
+  uint32_t track_count() const { return tracks.size(); }
+
+  void begin_album(const char* path, const char* name, uint32_t modify_time, uint32_t entry_count) {
+    LibraryAlbumRecord a{};
+    a.path_str    = intern(path);
+    a.name_str    = intern(name);
+    a.first_track = tracks.size();
+    a.track_count = 0;
+    a.modify_time = modify_time;
+    a.entry_count = entry_count;
+    albums.push_back(a);
+  }
+
+  void add_track(const char* rel_path, const char* title, const char* artist, const char* album,
+                 uint32_t duration_ms, uint64_t total_samples, uint64_t file_size) {
+    if (albums.empty()) return;
+
+    LibraryTrackRecord t{};
+    t.path_str      = intern(rel_path);
+    t.title_str     = intern(title);
+    t.artist_str    = intern_repeat(artist, last_artist);
+    t.album_str     = intern_repeat(album, last_album);
+    t.album         = albums.size() - 1;
+    t.duration_ms   = duration_ms;
+    t.total_samples = total_samples;
+    t.file_size     = file_size;
+    tracks.push_back(t);
+    albums.back().track_count++;
+  }
+
+  // Drops an album that turned out to contain no playable files
+  void drop_empty_album() {
+    if (!albums.empty() && albums.back().track_count == 0) albums.pop_back();
+  }
+
+  // Streams the finished image through `sink(data, len)`, which returns
+  // false on a short write. Returns the total size, or 0 on failure.
+  template <typename Sink>
+  size_t serialize(Sink sink) const {
+    if (strings.empty()) return 0;
+
+    LibraryIndexHeader h{};
+    h.magic          = LIBRARY_INDEX_MAGIC;
+    h.version        = LIBRARY_INDEX_VERSION;
+    h.header_size    = sizeof(LibraryIndexHeader);
+    h.album_count    = albums.size();
+    h.track_count    = tracks.size();
+    h.albums_offset  = sizeof(LibraryIndexHeader);
+    h.tracks_offset  = h.albums_offset + albums.size() * sizeof(LibraryAlbumRecord);
+    h.strings_offset = h.tracks_offset + tracks.size() * sizeof(LibraryTrackRecord);
+    h.strings_size   = strings.size();
+    h.root_str       = root_str;
+
+    uint32_t sum = 2166136261u;
+    sum = library_fnv1a((const uint8_t*)albums.data(), albums.size() * sizeof(LibraryAlbumRecord), sum);
+    sum = library_fnv1a((const uint8_t*)tracks.data(), tracks.size() * sizeof(LibraryTrackRecord), sum);
+    sum = library_fnv1a(strings.data(), strings.size(), sum);
+    h.checksum = sum;
+
+    if (!sink(&h, sizeof(h))) return 0;
+    if (!albums.empty() && !sink(albums.data(), albums.size() * sizeof(LibraryAlbumRecord))) return 0;
+    if (!tracks.empty() && !sink(tracks.data(), tracks.size() * sizeof(LibraryTrackRecord))) return 0;
+    if (!sink(strings.data(), strings.size())) return 0;
+
+    return h.strings_offset + h.strings_size;
+  }
+
+private:
+  std::vector<LibraryAlbumRecord> albums;
+  std::vector<LibraryTrackRecord> tracks;
+  std::vector<uint8_t>            strings;
+  uint32_t root_str    = LIBRARY_NO_STRING;
+  uint32_t last_artist = LIBRARY_NO_STRING;
+  uint32_t last_album  = LIBRARY_NO_STRING;
+
+  uint32_t intern(const char* s) {
+    if (!s || !*s) return LIBRARY_NO_STRING;
+    uint32_t off = strings.size();
+    strings.insert(strings.end(), (const uint8_t*)s, (const uint8_t*)s + strlen(s) + 1);
+    return off;
+  }
+
+  // Tracks of one album nearly always share artist and album strings
+  uint32_t intern_repeat(const char* s, uint32_t& last) {
+    if (!s || !*s) return LIBRARY_NO_STRING;
+    if (last != LIBRARY_NO_STRING && strcmp((const char*)strings.data() + last, s) == 0) return last;
+    last = intern(s);
+    return last;
+  }
+};
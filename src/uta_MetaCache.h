@@ -0,0 +1,257 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Track metadata cache keyed by a 64-bit path hash: fixed-size plain-data
+// entries with a chained hash index and LRU list, saved to the card as-is.
+
+#define META_CACHE_MAGIC    0x434D5455u  // "UTMC"
+#define META_CACHE_VERSION  8
+#define META_CACHE_NONE     0xFFFFu
+
+#define META_CACHE_TITLE_LEN   96
+#define META_CACHE_ARTIST_LEN  64
+#define META_CACHE_ALBUM_LEN   96
+#define META_CACHE_TOC_LEN     100
+
+#define META_CACHE_HAS_TOC     0x0001  // toc[] holds a seek table
+#define META_CACHE_NEEDS_SCAN  0x0002  // duration is an estimate
+#define META_CACHE_ART_JPEG    0x0004  // art_offset/art_length hold a picture
+#define META_CACHE_ART_PNG     0x0008
+#define META_CACHE_RG_TRACK    0x0010  // rg_track_* hold a loudness tag
+#define META_CACHE_RG_ALBUM    0x0020
+
+inline uint64_t meta_path_hash(const char* path) {
+  uint64_t hash = 14695981039346656037ull;
+  while (*path) {
+    hash ^= (uint8_t)*path++;
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+struct MetaCacheEntry {
+  uint64_t key;
+  uint64_t total_samples;
+  uint32_t duration_ms;
+  uint32_t audio_offset;  // first byte the decoder needs
+  uint32_t stream_start;  // container start, past leading ID3v2 tags
+  uint16_t prev;          // LRU neighbours
+  uint16_t next;
+  uint16_t chain;         // next entry in the same hash bucket
+  uint8_t  flags;
+  uint8_t  format;        // AudioFormat from the content probe
+  uint32_t stream_bytes;  // audio payload, for TOC seeks
+  uint32_t file_size;     // the file this was parsed from; a different
+  uint32_t file_modified; // size or FAT date << 16 | time is a miss
+  uint32_t art_offset;    // embedded cover image
+  uint32_t art_length;
+  int16_t  rg_track_cdb;  // ReplayGain in 1/100 dB
+  int16_t  rg_album_cdb;
+  uint16_t rg_track_peak; // Q2.14
+  uint16_t rg_album_peak;
+  uint8_t  toc[META_CACHE_TOC_LEN];
+  char     title[META_CACHE_TITLE_LEN];
+  char     artist[META_CACHE_ARTIST_LEN];
+  char     album[META_CACHE_ALBUM_LEN];
+
+  void set_title(const char* s)  { copy(title, s, sizeof(title)); }
+  void set_artist(const char* s) { copy(artist, s, sizeof(artist)); }
+  void set_album(const char* s)  { copy(album, s, sizeof(album)); }
+
+private:
+  static void copy(char* dst, const char* src, size_t size) {
+    size_t len = src ? strlen(src) : 0;
+    if (len >= size) {
+      len = size - 1;
+      // Never leave half a UTF-8 sequence at the cut
+      while (len > 0 && ((uint8_t)src[len] & 0xC0) == 0x80) len--;
+    }
+    memcpy(dst, src, len);
+    dst[len] = '\0';
+  }
+};
+
+struct MetaCacheFileHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t entry_size;
+  uint32_t count;
+  uint32_t reserved;
+};
+
+class MetaCache {
+public:
+  // `storage` must hold `capacity` entries; `buckets` must hold `bucket_count`
+  // uint16_t heads (a power of two, ideally >= capacity).
+  bool begin(MetaCacheEntry* storage, uint16_t capacity, uint16_t* buckets, uint16_t bucket_count) {
+    if (!storage || !buckets || capacity == 0 || capacity >= META_CACHE_NONE) return false;
+    if (bucket_count == 0 || (bucket_count & (bucket_count - 1)) != 0) return false;
+
+    entries  = storage;
+    cap      = capacity;
+    heads    = buckets;
+    nbuckets = bucket_count;
+    clear();
+    return true;
+  }
+
+  void clear() {
+    used = 0;
+    mru = lru = META_CACHE_NONE;
+    for (uint16_t i = 0; i < nbuckets; i++) heads[i] = META_CACHE_NONE;
+  }
+
+  uint16_t size() const     { return used; }
+  uint16_t capacity() const { return cap; }
+
+  uint32_t hits      = 0;
+  uint32_t misses    = 0;
+  uint32_t evictions = 0;
+
+  // Looks up and promotes to most-recently-used. Counts a hit or a miss.
+  const MetaCacheEntry* find(uint64_t key) {
+    uint16_t i = locate(key);
+    if (i == META_CACHE_NONE) {
+      misses++;
+      return nullptr;
+    }
+    hits++;
+    touch(i);
+    return &entries[i];
+  }
+
+  // As find(), but an entry parsed from another version of the file (a
+  // different size or modification time) is a miss
+  const MetaCacheEntry* find(uint64_t key, uint32_t file_size, uint32_t file_modified) {
+    uint16_t i = locate(key);
+    if (i == META_CACHE_NONE || entries[i].file_size != file_size ||
+        entries[i].file_modified != file_modified) {
+      misses++;
+      return nullptr;
+    }
+    hits++;
+    touch(i);
+    return &entries[i];
+  }
+
+  // Returns the slot for `key`, reusing an existing one or evicting the
+  // least-recently-used entry. The caller fills in the payload.
+  MetaCacheEntry* insert(uint64_t key) {
+    uint16_t i = locate(key);
+    if (i == META_CACHE_NONE) {
+      if (used < cap) {
+        i = used++;
+      } else {
+        i = lru;
+        unlink_bucket(i);
+        unlink_lru(i);
+        evictions++;
+      }
+
+      MetaCacheEntry& e = entries[i];
+      memset(&e, 0, sizeof(e));
+      e.key   = key;
+      e.prev  = e.next = META_CACHE_NONE;
+      uint16_t b = bucket(key);
+      e.chain  = heads[b];
+      heads[b] = i;
+      push_front(i);
+    } else {
+      touch(i);
+    }
+    return &entries[i];
+  }
+
+  // Serialises LRU-first, so loading back in order rebuilds the same recency
+  template <typename Sink>
+  bool save(Sink sink) const {
+    MetaCacheFileHeader h{META_CACHE_MAGIC, META_CACHE_VERSION, sizeof(MetaCacheEntry), used, 0};
+    if (!sink(&h, sizeof(h))) return false;
+    for (uint16_t i = lru; i != META_CACHE_NONE; i = entries[i].prev) {
+      if (!sink(&entries[i], sizeof(MetaCacheEntry))) return false;
+    }
+    return true;
+  }
+
+  template <typename Source>
+  bool load(Source source) {
+    MetaCacheFileHeader h{};
+    if (!source(&h, sizeof(h))) return false;
+    if (h.magic != META_CACHE_MAGIC || h.version != META_CACHE_VERSION ||
+        h.entry_size != sizeof(MetaCacheEntry)) return false;
+
+    clear();
+    MetaCacheEntry tmp;
+    for (uint32_t n = 0; n < h.count; n++) {
+      if (!source(&tmp, sizeof(tmp))) return false;
+      MetaCacheEntry* e = insert(tmp.key);
+
+      // Whole record, then the links that belong to this cache
+      uint16_t prev = e->prev, next = e->next, chain = e->chain;
+      memcpy(e, &tmp, sizeof(tmp));
+      e->prev  = prev;
+      e->next  = next;
+      e->chain = chain;
+      e->title[sizeof(e->title) - 1]   = '\0';
+      e->artist[sizeof(e->artist) - 1] = '\0';
+      e->album[sizeof(e->album) - 1]   = '\0';
+    }
+    return true;
+  }
+
+private:
+  MetaCacheEntry* entries  = nullptr;
+  uint16_t*       heads    = nullptr;
+  uint16_t        cap      = 0;
+  uint16_t        nbuckets = 0;
+  uint16_t        used     = 0;
+  uint16_t        mru      = META_CACHE_NONE;
+  uint16_t        lru      = META_CACHE_NONE;
+
+  uint16_t bucket(uint64_t key) const {
+    return (uint16_t)((key ^ (key >> 32)) & (nbuckets - 1));
+  }
+
+  uint16_t locate(uint64_t key) const {
+    for (uint16_t i = heads[bucket(key)]; i != META_CACHE_NONE; i = entries[i].chain) {
+      if (entries[i].key == key) return i;
+    }
+    return META_CACHE_NONE;
+  }
+
+  void unlink_bucket(uint16_t i) {
+    uint16_t* link = &heads[bucket(entries[i].key)];
+    while (*link != META_CACHE_NONE) {
+      if (*link == i) {
+        *link = entries[i].chain;
+        return;
+      }
+      link = &entries[*link].chain;
+    }
+  }
+
+  void unlink_lru(uint16_t i) {
+    MetaCacheEntry& e = entries[i];
+    if (e.prev != META_CACHE_NONE) entries[e.prev].next = e.next; else mru = e.next;
+    if (e.next != META_CACHE_NONE) entries[e.next].prev = e.prev; else lru = e.prev;
+    e.prev = e.next = META_CACHE_NONE;
+  }
+
+  void push_front(uint16_t i) {
+    MetaCacheEntry& e = entries[i];
+    e.prev = META_CACHE_NONE;
+    e.next = mru;
+    if (mru != META_CACHE_NONE) entries[mru].prev = i;
+    mru = i;
+    if (lru == META_CACHE_NONE) lru = i;
+  }
+
+  void touch(uint16_t i) {
+    if (mru == i) return;
+    unlink_lru(i);
+    push_front(i);
+  }
+};
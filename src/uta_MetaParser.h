@@ -0,0 +1,424 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "uta_Utf.h"
+
+// Tag and stream-info parsers for FLAC, MP3 (ID3v2/ID3v1) and RIFF/WAVE,
+// working out of one sector-aligned window read instead of per-field reads.
+
+#define META_WINDOW_ALIGN   512
+#define META_MAX_FIELD      512   // bytes of a single tag value we look at
+#define META_TEXT_BYTES     1024  // worst case UTF-8 for META_MAX_FIELD input
+
+/// Random-access byte source: an FsFile on the device, a file or a memory
+/// buffer on the host.
+class MetaReader {
+public:
+  virtual size_t   read_at(uint64_t offset, uint8_t* dst, size_t len) = 0;
+  virtual uint64_t size() = 0;
+  virtual ~MetaReader() {}
+};
+
+/// Receives tags as they are found. Keys are upper-case ASCII
+/// ("TITLE", "ARTIST", "ALBUM", or a Vorbis comment / TXXX name).
+class MetaSink {
+public:
+  virtual void on_tag(const char* key, const char* value, size_t len) = 0;
+  virtual ~MetaSink() {}
+};
+
+enum MetaPictureFormat : uint8_t {
+  META_PICTURE_NONE,
+  META_PICTURE_JPEG,
+  META_PICTURE_PNG,
+};
+
+/// Where an embedded cover image sits in the file; the image itself is
+/// never read by the parser.
+struct MetaPicture {
+  uint64_t offset = 0;
+  uint32_t length = 0;
+  uint8_t  format = META_PICTURE_NONE;
+  uint8_t  type   = 0;          // ID3 / FLAC picture type, 3 = front cover
+};
+
+struct MetaResult {
+  uint32_t sample_rate   = 0;
+  uint8_t  channels      = 0;
+  uint8_t  bits          = 0;
+  uint64_t total_samples = 0;
+  float    duration      = 0.0f;
+  uint64_t audio_offset  = 0;   // first byte after all tag / header data
+  MetaPicture picture;
+  uint32_t reads         = 0;   // window refills, for benchmarking
+};
+
+/// Sliding window over a MetaReader. It only moves when a block runs past
+/// its end.
+class MetaWindow {
+public:
+  MetaWindow(MetaReader& reader, uint8_t* buffer, size_t capacity)
+    : reader(reader), buf(buffer), cap(capacity), file_size(reader.size()) {}
+
+  uint64_t size() const { return file_size; }
+  uint32_t reads() const { return refills; }
+
+  // Pointer to [offset, offset + len) or nullptr if that range is past the
+  // end of the file or larger than the window.
+  const uint8_t* get(uint64_t offset, size_t len) {
+    if (offset + len > file_size || len > cap) return nullptr;
+    if (offset >= base && offset + len <= base + filled) return buf + (offset - base);
+
+    uint64_t start = offset - (offset % META_WINDOW_ALIGN);
+    if (offset + len > start + cap) start = offset;
+
+    size_t want = cap;
+    if (start + want > file_size) want = file_size - start;
+
+    filled = reader.read_at(start, buf, want);
+    base   = start;
+    refills++;
+
+    if (offset + len > base + filled) return nullptr;
+    return buf + (offset - base);
+  }
+
+private:
+  MetaReader& reader;
+  uint8_t*    buf;
+  size_t      cap;
+  uint64_t    file_size;
+  uint64_t    base    = 0;
+  size_t      filled  = 0;
+  uint32_t    refills = 0;
+};
+
+inline uint32_t meta_be32(const uint8_t* p) { return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3]; }
+inline uint32_t meta_be24(const uint8_t* p) { return ((uint32_t)p[0] << 16) | ((uint32_t)p[1] << 8) | p[2]; }
+inline uint32_t meta_le32(const uint8_t* p) { return ((uint32_t)p[3] << 24) | ((uint32_t)p[2] << 16) | ((uint32_t)p[1] << 8) | p[0]; }
+inline uint16_t meta_le16(const uint8_t* p) { return (uint16_t)(p[1] << 8 | p[0]); }
+inline uint32_t meta_syncsafe(const uint8_t* p) {
+  return ((uint32_t)(p[0] & 0x7F) << 21) | ((uint32_t)(p[1] & 0x7F) << 14) | ((uint32_t)(p[2] & 0x7F) << 7) | (p[3] & 0x7F);
+}
+
+// ID3v2 text payload (encoding byte first) to UTF-8. Returns bytes written.
+inline size_t meta_id3_text(const uint8_t* data, size_t len, char* out, size_t cap) {
+  if (len == 0) return 0;
+  uint8_t enc = data[0];
+  const uint8_t* p = data + 1;
+  size_t avail = len - 1;
+
+  if (enc == 0) return latin1_to_utf8(p, avail, out, cap);
+  if (enc == 3) return utf8_copy(p, avail, out, cap);
+  if (enc > 3)  return 0;
+
+  // UTF-16 with BOM (1) or big-endian without (2)
+  bool little_endian = false;
+  if (enc == 1 && avail >= 2) {
+    if ((p[0] == 0xFF && p[1] == 0xFE) || (p[0] == 0xFE && p[1] == 0xFF)) {
+      little_endian = (p[1] == 0xFE);
+      p += 2;
+      avail -= 2;
+    }
+  }
+  return utf16_to_utf8(p, avail, little_endian, out, cap);
+}
+
+// Emits `key` upper-cased (bounded) with `value`
+inline void meta_emit(MetaSink& sink, const char* key, size_t key_len, const char* value, size_t len) {
+  char k[48];
+  if (key_len >= sizeof(k)) key_len = sizeof(k) - 1;
+  for (size_t i = 0; i < key_len; i++) {
+    char c = key[i];
+    k[i] = (c >= 'a' && c <= 'z') ? c - 32 : c;
+  }
+  k[key_len] = '\0';
+  sink.on_tag(k, value, len);
+}
+
+inline void meta_parse_vorbis_comments(MetaWindow& win, uint64_t off, uint64_t end, MetaSink& sink) {
+  const uint8_t* p = win.get(off, 4);
+  if (!p) return;
+  off += 4 + meta_le32(p);                       // vendor string
+
+  if (!(p = win.get(off, 4))) return;
+  uint32_t count = meta_le32(p);
+  off += 4;
+
+  for (uint32_t i = 0; i < count && off + 4 <= end; i++) {
+    if (!(p = win.get(off, 4))) return;
+    uint32_t len = meta_le32(p);
+    off += 4;
+
+    size_t take = len < META_MAX_FIELD ? len : META_MAX_FIELD;
+    const char* c = (const char*)win.get(off, take);
+    off += len;
+    if (!c) continue;
+
+    const char* eq = (const char*)memchr(c, '=', take);
+    if (!eq) continue;
+    meta_emit(sink, c, eq - c, eq + 1, take - (eq - c) - 1);
+  }
+}
+
+inline uint8_t meta_picture_format(const uint8_t* mime, size_t len) {
+  char m[24];
+  if (len >= sizeof(m)) len = sizeof(m) - 1;
+  for (size_t i = 0; i < len; i++) m[i] = (mime[i] >= 'A' && mime[i] <= 'Z') ? mime[i] + 32 : mime[i];
+  m[len] = '\0';
+  if (strstr(m, "jpeg") || strstr(m, "jpg")) return META_PICTURE_JPEG;
+  if (strstr(m, "png"))                      return META_PICTURE_PNG;
+  return META_PICTURE_NONE;   // includes "-->" (linked, not embedded)
+}
+
+// Keeps the front cover, otherwise the first usable picture
+inline void meta_offer_picture(MetaPicture& pic, uint64_t offset, uint32_t length, uint8_t format, uint8_t type) {
+  if (format == META_PICTURE_NONE || length == 0) return;
+  if (pic.format != META_PICTURE_NONE && (pic.type == 3 || type != 3)) return;
+  pic.offset = offset;
+  pic.length = length;
+  pic.format = format;
+  pic.type   = type;
+}
+
+// FLAC PICTURE block body at `off`
+inline void meta_parse_flac_picture(MetaWindow& win, uint64_t off, uint32_t size, MetaPicture& pic) {
+  const uint8_t* p = win.get(off, 8);
+  if (!p) return;
+  uint8_t  type     = (uint8_t)meta_be32(p);
+  uint32_t mime_len = meta_be32(p + 4);
+  if (8 + (uint64_t)mime_len + 4 > size) return;
+
+  const uint8_t* mime = win.get(off + 8, mime_len);
+  if (!mime) return;
+  uint8_t format = meta_picture_format(mime, mime_len);
+
+  uint64_t at = off + 8 + mime_len;
+  if (!(p = win.get(at, 4))) return;
+  at += 4 + meta_be32(p) + 16;                  // description, width/height/depth/colours
+  if (at + 4 > off + size || !(p = win.get(at, 4))) return;
+
+  uint32_t length = meta_be32(p);
+  if (at + 4 + length > off + size) return;
+  meta_offer_picture(pic, at + 4, length, format, type);
+}
+
+// `start` is where "fLaC" sits, past any ID3v2 tag the probe skipped
+inline bool meta_parse_flac(MetaWindow& win, MetaSink& sink, MetaResult& res, uint64_t start = 0) {
+  const uint8_t* p = win.get(start, 4);
+  if (!p || memcmp(p, "fLaC", 4) != 0) return false;
+
+  uint64_t off = start + 4;
+  bool last = false;
+  while (!last) {
+    if (!(p = win.get(off, 4))) return false;
+    last          = p[0] & 0x80;
+    uint8_t type  = p[0] & 0x7F;
+    uint32_t size = meta_be24(p + 1);
+    off += 4;
+
+    if (type == 0 && size >= 34) {
+      const uint8_t* b = win.get(off, 34);
+      if (!b) return false;
+      res.sample_rate   = ((uint32_t)b[10] << 12) | (b[11] << 4) | ((b[12] >> 4) & 0x0F);
+      res.channels      = ((b[12] & 0x0E) >> 1) + 1;
+      res.bits          = (((b[12] & 0x01) << 4) | ((b[13] >> 4) & 0x0F)) + 1;
+      res.total_samples = ((uint64_t)(b[13] & 0x0F) << 32) | ((uint64_t)b[14] << 24) |
+                          ((uint64_t)b[15] << 16) | ((uint64_t)b[16] << 8) | b[17];
+      if (res.sample_rate) res.duration = (float)res.total_samples / res.sample_rate;
+    } else if (type == 4) {
+      meta_parse_vorbis_comments(win, off, off + size, sink);
+    } else if (type == 6) {
+      meta_parse_flac_picture(win, off, size, res.picture);
+    }
+    off += size;
+  }
+
+  res.audio_offset = off;
+  return true;
+}
+
+// APIC frame body: encoding, MIME\0, picture type, description, data
+inline void meta_parse_apic(const uint8_t* d, size_t n, uint64_t off, uint32_t size, MetaPicture& pic) {
+  if (n < 4) return;
+  uint8_t enc = d[0];
+  size_t  i   = 1;
+  size_t  mime_start = i;
+  while (i < n && d[i] != 0) i++;
+  uint8_t format = meta_picture_format(d + mime_start, i - mime_start);
+  i++;
+  if (i >= n) return;
+  uint8_t type = d[i++];
+
+  if (enc == 1 || enc == 2) {
+    while (i + 1 < n && (d[i] != 0 || d[i + 1] != 0)) i += 2;
+    i += 2;
+  } else {
+    while (i < n && d[i] != 0) i++;
+    i += 1;
+  }
+  if (i > n || i >= size) return;               // description longer than we looked at
+  meta_offer_picture(pic, off + i, size - i, format, type);
+}
+
+// Returns the offset just past the tag (0 when there is none)
+inline uint64_t meta_parse_id3v2(MetaWindow& win, MetaSink& sink, MetaPicture* picture = nullptr) {
+  const uint8_t* h = win.get(0, 10);
+  if (!h || memcmp(h, "ID3", 3) != 0) return 0;
+
+  uint8_t  version = h[3];
+  uint8_t  flags   = h[5];
+  uint64_t end     = 10 + meta_syncsafe(h + 6) + ((flags & 0x10) ? 10 : 0);
+  uint64_t off     = 10;
+
+  if (version < 3 || version > 4) return end;   // v2.2 frames are not read
+
+  if (flags & 0x40) {                           // extended header
+    const uint8_t* e = win.get(off, 4);
+    if (!e) return end;
+    off += (version == 4) ? meta_syncsafe(e) : meta_be32(e) + 4;
+  }
+
+  char text[META_TEXT_BYTES];
+  while (off + 10 <= end) {
+    const uint8_t* f = win.get(off, 10);
+    if (!f || f[0] == 0) break;
+
+    uint32_t size = (version == 4) ? meta_syncsafe(f + 4) : meta_be32(f + 4);
+    uint8_t  frame_flags = f[9];
+    char frame[4];
+    memcpy(frame, f, 4);
+    off += 10;
+
+    if (picture && memcmp(frame, "APIC", 4) == 0 && size > 0 && !(flags & 0x80)) {
+      // Unsynchronised, compressed or encrypted pictures cannot be streamed
+      // to a decoder as they are; a v2.4 data length indicator is skipped.
+      bool plain = (version == 4) ? !(frame_flags & 0x4E) : !(frame_flags & 0xE0);
+      uint32_t dli = (version == 4 && (frame_flags & 0x01)) ? 4 : 0;
+      if (plain && size > dli) {
+        size_t look = size - dli < 256 ? size - dli : 256;
+        const uint8_t* d = win.get(off + dli, look);
+        if (d) meta_parse_apic(d, look, off + dli, size - dli, *picture);
+      }
+    }
+
+    if (size > 0 && size <= META_MAX_FIELD && frame[0] == 'T') {
+      const uint8_t* d = win.get(off, size);
+      if (d) {
+        if (memcmp(frame, "TXXX", 4) == 0) {
+          // description \0 value, both in the frame's encoding
+          size_t n   = meta_id3_text(d, size, text, sizeof(text));
+          size_t key = strnlen(text, n);
+          size_t skip = (d[0] == 1 || d[0] == 2) ? 2 : 1;
+          size_t desc_bytes = 1;
+          if (skip == 1) {
+            while (desc_bytes < size && d[desc_bytes] != 0) desc_bytes++;
+            desc_bytes += 1;
+          } else {
+            while (desc_bytes + 1 < size && (d[desc_bytes] != 0 || d[desc_bytes + 1] != 0)) desc_bytes += 2;
+            desc_bytes += 2;
+          }
+          if (desc_bytes < size) {
+            char value[META_TEXT_BYTES / 2];
+            uint8_t tmp[META_MAX_FIELD + 1];
+            tmp[0] = d[0];
+            memcpy(tmp + 1, d + desc_bytes, size - desc_bytes);
+            size_t vn = meta_id3_text(tmp, size - desc_bytes + 1, value, sizeof(value));
+            meta_emit(sink, text, key, value, vn);
+          }
+        } else {
+          size_t n = meta_id3_text(d, size, text, sizeof(text));
+          if      (memcmp(frame, "TIT2", 4) == 0) sink.on_tag("TITLE", text, n);
+          else if (memcmp(frame, "TPE1", 4) == 0) sink.on_tag("ARTIST", text, n);
+          else if (memcmp(frame, "TALB", 4) == 0) sink.on_tag("ALBUM", text, n);
+        }
+      }
+    }
+    off += size;
+  }
+  return end;
+}
+
+inline bool meta_parse_id3v1(MetaWindow& win, MetaSink& sink) {
+  if (win.size() < 128) return false;
+  const uint8_t* t = win.get(win.size() - 128, 128);
+  if (!t || memcmp(t, "TAG", 3) != 0) return false;
+
+  const char* fields[3] = { "TITLE", "ARTIST", "ALBUM" };
+  for (int i = 0; i < 3; i++) {
+    const char* s = (const char*)t + 3 + i * 30;
+    size_t n = strnlen(s, 30);
+    while (n > 0 && s[n - 1] == ' ') n--;
+    if (n) sink.on_tag(fields[i], s, n);
+  }
+  return true;
+}
+
+inline bool meta_parse_mp3(MetaWindow& win, MetaSink& sink, MetaResult& res) {
+  uint64_t tag_end = meta_parse_id3v2(win, sink, &res.picture);
+  if (tag_end == 0) meta_parse_id3v1(win, sink);
+
+  // Duration needs the frame analyser (uta_Mp3Info.h)
+  res.audio_offset = tag_end;
+  return true;
+}
+
+// `start` is where "RIFF" sits, past any ID3v2 tag the probe skipped
+inline bool meta_parse_riff(MetaWindow& win, MetaSink& sink, MetaResult& res, uint64_t start = 0) {
+  const uint8_t* p = win.get(start, 12);
+  if (!p || memcmp(p, "RIFF", 4) != 0 || memcmp(p + 8, "WAVE", 4) != 0) return false;
+
+  uint32_t byte_rate   = 0;
+  uint16_t block_align = 0;
+  uint64_t off = start + 12;
+
+  while (off + 8 <= win.size()) {
+    if (!(p = win.get(off, 8))) break;
+    char id[4];
+    memcpy(id, p, 4);
+    uint32_t size = meta_le32(p + 4);
+    off += 8;
+
+    if (memcmp(id, "fmt ", 4) == 0 && size >= 16) {
+      const uint8_t* f = win.get(off, 16);
+      if (!f) return false;
+      res.channels    = meta_le16(f + 2);
+      res.sample_rate = meta_le32(f + 4);
+      byte_rate       = meta_le32(f + 8);
+      block_align     = meta_le16(f + 12);
+      res.bits        = meta_le16(f + 14);
+    } else if (memcmp(id, "data", 4) == 0) {
+      res.audio_offset = off;
+      if (byte_rate)   res.duration      = size / (float)byte_rate;
+      if (block_align) res.total_samples = size / block_align;
+      return true;
+    } else if (memcmp(id, "LIST", 4) == 0 && size >= 4) {
+      const uint8_t* t = win.get(off, 4);
+      if (t && memcmp(t, "INFO", 4) == 0) {
+        uint64_t sub = off + 4, end = off + size;
+        while (sub + 8 <= end) {
+          const uint8_t* s = win.get(sub, 8);
+          if (!s) break;
+          char sid[4];
+          memcpy(sid, s, 4);
+          uint32_t len = meta_le32(s + 4);
+          sub += 8;
+
+          size_t take = len < META_MAX_FIELD ? len : META_MAX_FIELD;
+          const char* v = (const char*)win.get(sub, take);
+          if (v) {
+            size_t n = strnlen(v, take);
+            if      (memcmp(sid, "INAM", 4) == 0) sink.on_tag("TITLE", v, n);
+            else if (memcmp(sid, "IART", 4) == 0) sink.on_tag("ARTIST", v, n);
+            else if (memcmp(sid, "IPRD", 4) == 0) sink.on_tag("ALBUM", v, n);
+          }
+          sub += len + (len & 1);
+        }
+      }
+    }
+    off += size + (size & 1);
+  }
+  return false;
+}
@@ -0,0 +1,328 @@
+#pragma once
+
+#include "uta_MetaParser.h"
+
+// MPEG audio frame analyser: duration and a seek TOC for MP3 files, from a
+// Xing/Info/VBRI header, a CBR check, or a full scan done off the playback path.
+
+#define MP3_TOC_ENTRIES   100
+#define MP3_CBR_PROBE     8      // frames compared to decide CBR
+
+enum Mp3Source : uint8_t {
+  MP3_SRC_NONE,
+  MP3_SRC_XING,       // VBR with Xing header
+  MP3_SRC_INFO,       // CBR with Info header
+  MP3_SRC_VBRI,
+  MP3_SRC_CBR,        // no header, constant bitrate
+  MP3_SRC_SCAN,       // counted frame by frame
+  MP3_SRC_ESTIMATE,   // VBR without header, waiting for a scan
+};
+
+struct Mp3Frame {
+  uint32_t sample_rate = 0;
+  uint32_t bitrate     = 0;       // bits per second
+  uint16_t length      = 0;       // bytes, including header
+  uint16_t samples     = 0;       // PCM frames per MPEG frame
+  uint8_t  version     = 0;       // 3 = MPEG1, 2 = MPEG2, 0 = MPEG2.5
+  uint8_t  layer       = 0;       // 1..3
+  uint8_t  channels    = 0;
+};
+
+struct Mp3Info {
+  uint64_t  first_frame  = 0;
+  uint64_t  stream_bytes = 0;     // first frame to end of audio
+  uint32_t  frames       = 0;
+  uint32_t  sample_rate  = 0;
+  uint16_t  samples_per_frame = 0;
+  uint8_t   channels     = 0;
+  uint32_t  bitrate      = 0;     // average
+  uint16_t  enc_delay    = 0;     // LAME gapless info
+  uint16_t  enc_padding  = 0;
+  float     duration     = 0.0f;
+  uint8_t   source       = MP3_SRC_NONE;
+  bool      has_toc      = false;
+  uint8_t   toc[MP3_TOC_ENTRIES] = {};  // toc[p]: position at p% of the duration, in 1/256 of the stream
+
+  bool needs_scan() const { return source == MP3_SRC_ESTIMATE; }
+};
+
+inline bool mp3_parse_frame_header(const uint8_t* h, Mp3Frame& f) {
+  if (h[0] != 0xFF || (h[1] & 0xE0) != 0xE0) return false;
+
+  uint8_t version = (h[1] >> 3) & 0x03;
+  uint8_t layer_b = (h[1] >> 1) & 0x03;
+  uint8_t br_idx  = h[2] >> 4;
+  uint8_t sr_idx  = (h[2] >> 2) & 0x03;
+  uint8_t padding = (h[2] >> 1) & 0x01;
+  if (version == 1 || layer_b == 0 || br_idx == 0 || br_idx == 15 || sr_idx == 3) return false;
+
+  static const uint16_t br_v1[3][15] = {
+    { 0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448 },  // L1
+    { 0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384 },     // L2
+    { 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320 },      // L3
+  };
+  static const uint16_t br_v2[2][15] = {
+    { 0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256 },     // L1
+    { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160 },          // L2, L3
+  };
+  static const uint32_t sr_v1[3] = { 44100, 48000, 32000 };
+
+  uint8_t layer = 4 - layer_b;
+  bool    v1    = version == 3;
+
+  f.version     = version;
+  f.layer       = layer;
+  f.bitrate     = (v1 ? br_v1[layer - 1][br_idx] : br_v2[layer == 1 ? 0 : 1][br_idx]) * 1000u;
+  f.sample_rate = sr_v1[sr_idx] >> (v1 ? 0 : (version == 2 ? 1 : 2));
+  f.channels    = (h[3] >> 6) == 3 ? 1 : 2;
+
+  if (layer == 1) {
+    f.samples = 384;
+    f.length  = (uint16_t)((12 * f.bitrate / f.sample_rate + padding) * 4);
+  } else if (layer == 2 || v1) {
+    f.samples = 1152;
+    f.length  = (uint16_t)(144 * f.bitrate / f.sample_rate + padding);
+  } else {
+    f.samples = 576;
+    f.length  = (uint16_t)(72 * f.bitrate / f.sample_rate + padding);
+  }
+  return f.length >= 4;
+}
+
+// Frame at `offset` whose successor also parses, with matching stream
+// parameters. Rules out most false syncs in tag or junk data.
+inline bool mp3_confirmed_frame(MetaWindow& win, uint64_t offset, Mp3Frame& f) {
+  const uint8_t* h = win.get(offset, 4);
+  if (!h || !mp3_parse_frame_header(h, f)) return false;
+
+  Mp3Frame next;
+  const uint8_t* n = win.get(offset + f.length, 4);
+  if (!n) return offset + f.length >= win.size();   // last frame of the file
+  return mp3_parse_frame_header(n, next) && next.version == f.version &&
+         next.layer == f.layer && next.sample_rate == f.sample_rate;
+}
+
+// First confirmed frame in [from, limit)
+inline bool mp3_find_frame(MetaWindow& win, uint64_t from, uint64_t limit, uint64_t& offset, Mp3Frame& f) {
+  if (limit > win.size()) limit = win.size();
+  while (from + 4 <= limit) {
+    size_t span = 4096;
+    if (from + span > limit) span = limit - from;
+    const uint8_t* p = win.get(from, span);
+    if (!p) return false;
+
+    for (size_t i = 0; i + 1 < span; i++) {
+      if (p[i] != 0xFF || (p[i + 1] & 0xE0) != 0xE0) continue;
+      if (mp3_confirmed_frame(win, from + i, f)) {
+        offset = from + i;
+        return true;
+      }
+      p = win.get(from, span);
+      if (!p) return false;
+    }
+    from += span > 1 ? span - 1 : 1;
+  }
+  return false;
+}
+
+inline void mp3_linear_toc(Mp3Info& info) {
+  for (int i = 0; i < MP3_TOC_ENTRIES; i++) info.toc[i] = (uint8_t)(i * 256 / MP3_TOC_ENTRIES);
+  info.has_toc = true;
+}
+
+inline void mp3_finish(Mp3Info& info) {
+  if (info.sample_rate && info.frames) {
+    info.duration = (float)info.frames * info.samples_per_frame / info.sample_rate;
+  }
+  if (info.duration > 0) info.bitrate = (uint32_t)(info.stream_bytes * 8 / info.duration);
+}
+
+// `audio_start` is the first byte after the ID3v2 tag
+inline bool mp3_analyse(MetaWindow& win, uint64_t audio_start, Mp3Info& info) {
+  info = Mp3Info{};
+
+  uint64_t end = win.size();
+  const uint8_t* tail = end >= 128 ? win.get(end - 128, 3) : nullptr;
+  if (tail && memcmp(tail, "TAG", 3) == 0) end -= 128;
+
+  Mp3Frame f;
+  uint64_t first;
+  if (!mp3_find_frame(win, audio_start, end, first, f)) return false;
+
+  info.first_frame       = first;
+  info.stream_bytes      = end - first;
+  info.sample_rate       = f.sample_rate;
+  info.samples_per_frame = f.samples;
+  info.channels          = f.channels;
+
+  // Xing / Info, right after the side info of the first frame
+  bool v1 = f.version == 3;
+  size_t xing_at = v1 ? (f.channels == 1 ? 21 : 36) : (f.channels == 1 ? 13 : 21);
+  const uint8_t* x = win.get(first + xing_at, 8);
+  if (x && (memcmp(x, "Xing", 4) == 0 || memcmp(x, "Info", 4) == 0)) {
+    info.source = x[0] == 'X' ? MP3_SRC_XING : MP3_SRC_INFO;
+    uint32_t flags = meta_be32(x + 4);
+    uint64_t pos   = first + xing_at + 8;
+
+    if (flags & 0x1) { const uint8_t* p = win.get(pos, 4); if (p) info.frames = meta_be32(p); pos += 4; }
+    if (flags & 0x2) { const uint8_t* p = win.get(pos, 4); if (p && meta_be32(p)) info.stream_bytes = meta_be32(p); pos += 4; }
+    if (flags & 0x4) {
+      const uint8_t* p = win.get(pos, MP3_TOC_ENTRIES);
+      if (p) { memcpy(info.toc, p, MP3_TOC_ENTRIES); info.has_toc = true; }
+      pos += MP3_TOC_ENTRIES;
+    }
+    if (flags & 0x8) pos += 4;
+
+    // LAME extension: encoder delay / padding, 12 bits each
+    const uint8_t* lame = win.get(pos, 24);
+    if (lame && (memcmp(lame, "LAME", 4) == 0 || memcmp(lame, "Lavf", 4) == 0 || memcmp(lame, "Lavc", 4) == 0)) {
+      info.enc_delay   = (lame[21] << 4) | (lame[22] >> 4);
+      info.enc_padding = ((lame[22] & 0x0F) << 8) | lame[23];
+    }
+
+    // The header frame itself carries no audio
+    info.first_frame   = first + f.length;
+    info.stream_bytes -= info.stream_bytes > f.length ? f.length : 0;
+    if (info.frames) {
+      mp3_finish(info);
+      if (!info.has_toc) mp3_linear_toc(info);
+      return true;
+    }
+  }
+
+  // VBRI, always 32 bytes after the header
+  const uint8_t* v = win.get(first + 36, 26);
+  if (v && memcmp(v, "VBRI", 4) == 0) {
+    info.source         = MP3_SRC_VBRI;
+    info.stream_bytes   = meta_be32(v + 10);
+    info.frames         = meta_be32(v + 14);
+    uint16_t entries    = (v[18] << 8) | v[19];
+    uint16_t scale      = (v[20] << 8) | v[21];
+    uint16_t entry_size = (v[22] << 8) | v[23];
+    uint16_t per_entry  = (v[24] << 8) | v[25];
+    info.first_frame    = first + f.length;
+
+    if (entries && entry_size >= 1 && entry_size <= 4 && per_entry && info.stream_bytes) {
+      // Cumulative byte position per entry, resampled to percent steps
+      uint64_t pos = 0;
+      uint32_t entry = 0;
+      uint64_t at = first + 36 + 26;
+      for (int p = 0; p < MP3_TOC_ENTRIES; p++) {
+        uint64_t want = (uint64_t)info.frames * p / MP3_TOC_ENTRIES;
+        while (entry < entries && (uint64_t)(entry + 1) * per_entry <= want) {
+          const uint8_t* e = win.get(at + (uint64_t)entry * entry_size, entry_size);
+          if (!e) break;
+          uint32_t size = 0;
+          for (int b = 0; b < entry_size; b++) size = (size << 8) | e[b];
+          pos += (uint64_t)size * scale;
+          entry++;
+        }
+        uint64_t t = pos * 256 / info.stream_bytes;
+        info.toc[p] = t > 255 ? 255 : (uint8_t)t;
+      }
+      info.has_toc = true;
+    }
+    mp3_finish(info);
+    if (!info.has_toc) mp3_linear_toc(info);
+    return info.frames > 0;
+  }
+
+  // No header: constant bitrate if the first frames agree
+  bool cbr = true;
+  uint64_t off = first;
+  Mp3Frame g = f;
+  uint64_t probe_bytes = 0;
+  int probed = 0;
+  for (; probed < MP3_CBR_PROBE; probed++) {
+    const uint8_t* h = win.get(off, 4);
+    if (!h || !mp3_parse_frame_header(h, g)) break;
+    if (g.bitrate != f.bitrate) cbr = false;
+    probe_bytes += g.length;
+    off += g.length;
+  }
+
+  if (cbr) {
+    info.source   = MP3_SRC_CBR;
+    info.bitrate  = f.bitrate;
+    info.duration = (float)info.stream_bytes * 8 / f.bitrate;
+    info.frames   = (uint32_t)(info.duration * f.sample_rate / f.samples);
+  } else {
+    // Rough figure from the probed frames until mp3_scan() replaces it
+    info.source   = MP3_SRC_ESTIMATE;
+    info.bitrate  = probed ? (uint32_t)(probe_bytes * 8 * f.sample_rate / ((uint64_t)probed * f.samples)) : f.bitrate;
+    info.duration = (float)info.stream_bytes * 8 / info.bitrate;
+  }
+  mp3_linear_toc(info);
+  return true;
+}
+
+// Counts every frame from info.first_frame and rebuilds duration and TOC.
+// `marks` (capacity `mark_cap`, >= 2 * MP3_TOC_ENTRIES) holds the offset of
+// every `step`-th frame; the step doubles whenever it fills. `yield` is
+// called every few hundred frames and may return false to abort.
+template <typename Yield>
+bool mp3_scan(MetaWindow& win, Mp3Info& info, uint32_t* marks, size_t mark_cap, Yield yield) {
+  uint64_t end = info.first_frame + info.stream_bytes;
+  if (end > win.size()) end = win.size();
+
+  uint64_t off    = info.first_frame;
+  uint32_t frames = 0;
+  uint32_t step   = 1;
+  size_t   n      = 0;
+
+  Mp3Frame f;
+  while (off + 4 <= end) {
+    const uint8_t* h = win.get(off, 4);
+    if (!h) break;
+    if (!mp3_parse_frame_header(h, f)) {
+      // Lost sync (junk or a damaged frame): look for the next real one
+      uint64_t next;
+      if (!mp3_find_frame(win, off + 1, end, next, f)) break;
+      off = next;
+      continue;
+    }
+
+    if (frames % step == 0) {
+      if (n == mark_cap) {
+        for (size_t i = 0; i < mark_cap / 2; i++) marks[i] = marks[i * 2];
+        n = mark_cap / 2;
+        step *= 2;
+      }
+      if (frames % step == 0) marks[n++] = (uint32_t)(off - info.first_frame);
+    }
+
+    frames++;
+    off += f.length;
+    if ((frames & 0xFF) == 0 && !yield()) return false;
+  }
+  if (frames == 0) return false;
+
+  info.frames = frames;
+  info.source = MP3_SRC_SCAN;
+  mp3_finish(info);
+
+  for (int p = 0; p < MP3_TOC_ENTRIES; p++) {
+    uint64_t frame = (uint64_t)frames * p / MP3_TOC_ENTRIES;
+    size_t   k     = frame / step;
+    uint64_t pos   = k < n ? marks[k] : info.stream_bytes;
+    uint64_t t     = info.stream_bytes ? pos * 256 / info.stream_bytes : 0;
+    info.toc[p] = t > 255 ? 255 : (uint8_t)t;
+  }
+  info.has_toc = true;
+  return true;
+}
+
+// Byte offset for `seconds` from the TOC (linearly interpolated inside a
+// percent step). The caller still has to find the next frame sync.
+inline uint64_t mp3_toc_offset(const Mp3Info& info, float seconds) {
+  if (info.duration <= 0 || !info.has_toc) return info.first_frame;
+  float pct = seconds * MP3_TOC_ENTRIES / info.duration;
+  if (pct < 0) pct = 0;
+  if (pct > MP3_TOC_ENTRIES - 0.001f) pct = MP3_TOC_ENTRIES - 0.001f;
+
+  int   a  = (int)pct;
+  float fa = info.toc[a];
+  float fb = a + 1 < MP3_TOC_ENTRIES ? info.toc[a + 1] : 256.0f;
+  float fx = fa + (fb - fa) * (pct - a);
+  return info.first_frame + (uint64_t)(fx / 256.0f * info.stream_bytes);
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "uta_Mp3Info.h"
+
+// Container / codec detection from the first bytes of a file, past any
+// leading ID3v2 tags, out of the metadata parsers' MetaWindow.
+
+#define PROBE_SYNC_SEARCH  4096   // bytes after the tags searched for an MPEG sync
+
+enum AudioFormat : uint8_t {
+  AUDIO_FORMAT_UNKNOWN,
+  AUDIO_FORMAT_FLAC,
+  AUDIO_FORMAT_MP3,
+  AUDIO_FORMAT_WAV,
+  AUDIO_FORMAT_AAC,       // ADTS stream
+  AUDIO_FORMAT_MP4,       // ISO BMFF (m4a): recognised, no demuxer
+  AUDIO_FORMAT_OGG,       // recognised, no decoder
+};
+
+struct ProbeResult {
+  AudioFormat format = AUDIO_FORMAT_UNKNOWN;
+  uint64_t    start  = 0;   // first byte after leading ID3v2 tags
+};
+
+// MIME strings the decoders are registered under
+inline const char* probe_mime(AudioFormat format) {
+  switch (format) {
+    case AUDIO_FORMAT_FLAC: return "audio/flac";
+    case AUDIO_FORMAT_MP3:  return "audio/mpeg";
+    case AUDIO_FORMAT_WAV:  return "audio/wav";
+    case AUDIO_FORMAT_AAC:  return "audio/aac";
+    default:                return nullptr;
+  }
+}
+
+inline const char* probe_name(AudioFormat format) {
+  switch (format) {
+    case AUDIO_FORMAT_FLAC: return "FLAC (Lossless)";
+    case AUDIO_FORMAT_MP3:  return "MP3";
+    case AUDIO_FORMAT_WAV:  return "WAV (Uncompressed)";
+    case AUDIO_FORMAT_AAC:  return "AAC (ADTS)";
+    case AUDIO_FORMAT_MP4:  return "MP4/M4A";
+    case AUDIO_FORMAT_OGG:  return "Ogg";
+    default:                return "Unknown";
+  }
+}
+
+inline bool probe_playable(AudioFormat format) {
+  return probe_mime(format) != nullptr;
+}
+
+inline bool adts_parse_header(const uint8_t* h, uint16_t& length) {
+  if (h[0] != 0xFF || (h[1] & 0xF6) != 0xF0) return false;   // sync, layer 0
+  if (((h[2] >> 2) & 0x0F) >= 13) return false;                // sampling index
+  length = (uint16_t)(((h[3] & 0x03) << 11) | (h[4] << 3) | (h[5] >> 5));
+  return length >= 7;
+}
+
+// ADTS frame at `offset` followed by another one (or the end of the file)
+inline bool adts_confirmed_frame(MetaWindow& win, uint64_t offset) {
+  uint16_t len, next_len;
+  const uint8_t* h = win.get(offset, 7);
+  if (!h || !adts_parse_header(h, len)) return false;
+  const uint8_t* n = win.get(offset + len, 7);
+  if (!n) return offset + len >= win.size();
+  return adts_parse_header(n, next_len);
+}
+
+inline ProbeResult probe_format(MetaWindow& win) {
+  ProbeResult res;
+
+  // Skip any number of ID3v2 tags (header + size + optional footer)
+  const uint8_t* p;
+  while ((p = win.get(res.start, 10)) && memcmp(p, "ID3", 3) == 0) {
+    res.start += 10 + meta_syncsafe(p + 6) + ((p[5] & 0x10) ? 10 : 0);
+  }
+
+  uint64_t left = win.size() > res.start ? win.size() - res.start : 0;
+  if (left < 4) return res;
+  p = win.get(res.start, left < 12 ? (size_t)left : 12);
+  if (!p) return res;
+
+  if (memcmp(p, "fLaC", 4) == 0) {
+    res.format = AUDIO_FORMAT_FLAC;
+  } else if (memcmp(p, "OggS", 4) == 0) {
+    res.format = AUDIO_FORMAT_OGG;
+  } else if (left >= 12 && memcmp(p, "RIFF", 4) == 0 && memcmp(p + 8, "WAVE", 4) == 0) {
+    res.format = AUDIO_FORMAT_WAV;
+  } else if (left >= 8 && memcmp(p + 4, "ftyp", 4) == 0) {
+    res.format = AUDIO_FORMAT_MP4;
+  } else if (adts_confirmed_frame(win, res.start)) {
+    res.format = AUDIO_FORMAT_AAC;
+  } else {
+    // MPEG audio may follow the tag after some padding or junk
+    uint64_t offset;
+    Mp3Frame f;
+    if (mp3_find_frame(win, res.start, res.start + PROBE_SYNC_SEARCH, offset, f)) {
+      res.format = AUDIO_FORMAT_MP3;
+    }
+  }
+  return res;
+}
@@ -0,0 +1,218 @@
+#pragma once
+
+#include <atomic>
+#include "uta_SDCard.h"
+
+// Read-ahead between the audio FsFile and the decoder: two PSRAM slots
+// refilled by a background task, by sector number when the file is contiguous.
+
+#ifndef UTA_READAHEAD_BYTES
+#define UTA_READAHEAD_BYTES     (32 * 1024)   // per slot, multiple of 512
+#endif
+#define UTA_READAHEAD_CORE      0
+#define UTA_READAHEAD_PRIORITY  4
+
+// The task holds the SD lock for every fill; attach() and seek() must be
+// called with the SD lock held, so no fill is in flight.
+class ReadAheadFile : public Stream {
+public:
+  struct Stats {
+    uint32_t fills;
+    uint32_t direct_fills;    // contiguous fast path
+    uint32_t waits;           // decoder found nothing ready
+    uint32_t fill_us;         // last fill duration
+  };
+
+  bool begin() {
+    for (Slot& s : slots) {
+      s.data = (uint8_t*)heap_caps_malloc(UTA_READAHEAD_BYTES, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+      if (!s.data) {
+        Serial.println("[ERROR] Read-ahead buffer allocation failed");
+        return false;
+      }
+    }
+    ready_sem = xSemaphoreCreateBinary();
+    if (!ready_sem) return false;
+
+    xTaskCreatePinnedToCore(fill_task, "ReadAhead", 4096, this,
+                            UTA_READAHEAD_PRIORITY, &task_handle, UTA_READAHEAD_CORE);
+    return task_handle != nullptr;
+  }
+
+  // Starts serving `file` from byte `start`. Pass nullptr to detach.
+  void attach(FsFile* file, uint64_t start = 0) {
+    this->file = file;
+    file_size  = file ? file->fileSize() : 0;
+    contiguous = file && file->isContiguous();
+    first_sector = contiguous ? file->firstSector() : 0;
+    seek(start);
+  }
+
+  bool seek(uint64_t offset) {
+    if (offset > file_size) return false;
+    for (Slot& s : slots) s.state = SLOT_FREE;
+    pos        = offset;
+    next_fetch = offset - (offset % 512);
+    kick();
+    return true;
+  }
+
+  uint64_t position() const { return pos; }
+  uint64_t size() const     { return file_size; }
+  bool     isOpen() const   { return file != nullptr; }
+  void     close()          { attach(nullptr); }
+
+  // Bytes ready in memory without touching the card
+  size_t buffered() const {
+    size_t total = 0;
+    for (const Slot& s : slots) {
+      if (s.state == SLOT_READY && pos < s.base + s.len) {
+        total += s.base + s.len - (pos > s.base ? pos : s.base);
+      }
+    }
+    return total;
+  }
+
+  Stats stats() const { return stats_; }
+
+  operator bool() { return file != nullptr; }
+
+  int available() override {
+    uint64_t left = file_size - pos;
+    return left > INT32_MAX ? INT32_MAX : (int)left;
+  }
+
+  int read() override {
+    uint8_t b;
+    return read_into(&b, 1) == 1 ? b : -1;
+  }
+
+  int peek() override {
+    if (pos >= file_size) return -1;
+    Slot* s = wait_slot();
+    return s ? s->data[pos - s->base] : -1;
+  }
+
+  // Stream::readBytes(uint8_t*) is not virtual; both forms land here
+  size_t readBytes(char* dst, size_t len) override { return read_into((uint8_t*)dst, len); }
+  size_t readBytes(uint8_t* dst, size_t len)       { return read_into(dst, len); }
+
+  size_t write(uint8_t) override { return 0; }
+
+private:
+  enum : uint8_t { SLOT_FREE, SLOT_LOADING, SLOT_READY };
+
+  struct Slot {
+    uint8_t*             data = nullptr;
+    uint64_t             base = 0;
+    size_t               len  = 0;
+    std::atomic<uint8_t> state{SLOT_FREE};
+  };
+
+  Slot              slots[2];
+  FsFile*           file         = nullptr;
+  uint64_t          file_size    = 0;
+  uint64_t          pos          = 0;
+  uint64_t          next_fetch   = 0;     // only touched by the task or under the SD lock
+  bool              contiguous   = false;
+  uint32_t          first_sector = 0;
+  TaskHandle_t      task_handle  = nullptr;
+  SemaphoreHandle_t ready_sem    = nullptr;
+  Stats             stats_       = {};
+
+  size_t read_into(uint8_t* dst, size_t len) {
+    size_t done = 0;
+    while (done < len && pos < file_size) {
+      Slot* s = wait_slot();
+      if (!s) break;
+
+      size_t off = pos - s->base;
+      size_t n   = s->len - off;
+      if (n > len - done) n = len - done;
+      memcpy(dst + done, s->data + off, n);
+      done += n;
+      pos  += n;
+
+      if (pos >= s->base + s->len) {
+        s->state = SLOT_FREE;
+        kick();
+      }
+    }
+    return done;
+  }
+
+  void kick() {
+    if (task_handle) xTaskNotifyGive(task_handle);
+  }
+
+  Slot* find_slot() {
+    for (Slot& s : slots) {
+      if (s.state == SLOT_READY && pos >= s.base && pos < s.base + s.len) return &s;
+    }
+    return nullptr;
+  }
+
+  // Only waits when the decoder has caught up with the card (start of a
+  // track, after a seek, or a card that is slower than the bitrate)
+  Slot* wait_slot() {
+    Slot* s = find_slot();
+    for (int tries = 0; !s && tries < 50; tries++) {
+      if (tries == 0) stats_.waits++;
+      kick();
+      xSemaphoreTake(ready_sem, pdMS_TO_TICKS(20));
+      s = find_slot();
+    }
+    return s;
+  }
+
+  bool fill(Slot& s) {
+    uint64_t base = next_fetch;
+    if (!file || base >= file_size) return false;
+
+    size_t want = UTA_READAHEAD_BYTES;
+    if (base + want > file_size) want = file_size - base;
+
+    s.state = SLOT_LOADING;
+    uint32_t t0 = micros();
+    bool ok;
+
+    FsBlockDevice* dev = contiguous ? sd_block_device() : nullptr;
+    if (dev) {
+      size_t sectors = (want + 511) / 512;
+      ok = dev->readSectors(first_sector + base / 512, s.data, sectors);
+      stats_.direct_fills++;
+    } else {
+      ok = file->seekSet(base) && file->read(s.data, want) == (int)want;
+    }
+
+    stats_.fill_us = micros() - t0;
+    stats_.fills++;
+
+    if (!ok) {
+      s.state = SLOT_FREE;
+      return false;
+    }
+    s.base     = base;
+    s.len      = want;
+    next_fetch = base + want;
+    s.state    = SLOT_READY;
+    xSemaphoreGive(ready_sem);
+    return true;
+  }
+
+  static void fill_task(void* arg) {
+    auto* ra = (ReadAheadFile*)arg;
+    while (true) {
+      ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+      bool progress = true;
+      while (progress) {
+        progress = false;
+        SdLock lock;
+        for (Slot& s : ra->slots) {
+          if (s.state == SLOT_FREE && ra->fill(s)) progress = true;
+        }
+      }
+    }
+  }
+};
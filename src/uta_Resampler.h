@@ -0,0 +1,274 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Polyphase FIR sample-rate converter to a fixed 48 kHz / stereo / 32-bit
+// output, so I2S is never re-initialised between tracks of different rates.
+
+#define RESAMPLE_OUT_RATE         48000
+#define RESAMPLE_OUT_CHANNELS     2
+#define RESAMPLE_OUT_FRAME_BYTES  (RESAMPLE_OUT_CHANNELS * 4)
+#define RESAMPLE_BLOCK            256    // input frames per process() call
+#define RESAMPLE_MAX_TAPS         256
+
+enum ResampleMode : uint8_t {
+  RESAMPLE_BYPASS,      // I2S follows each track's format
+  RESAMPLE_FAST,        // Q15 taps on 16-bit history, about 60 dB stopband
+  RESAMPLE_HQ,          // Q30 taps on 32-bit history, about 90 dB stopband
+  RESAMPLE_MODES,
+};
+
+inline const char* resample_mode_name(ResampleMode mode) {
+  switch (mode) {
+    case RESAMPLE_FAST: return "FAST";
+    case RESAMPLE_HQ:   return "HQ";
+    default:            return "BYPASS";
+  }
+}
+
+namespace resample_detail {
+
+constexpr double PI = 3.14159265358979323846;
+
+constexpr double sin(double x) {
+  while (x >  PI) x -= 2 * PI;
+  while (x < -PI) x += 2 * PI;
+  double term = x, sum = x;
+  for (int k = 1; k < 14; k++) {
+    term *= -x * x / ((2 * k) * (2 * k + 1));
+    sum  += term;
+  }
+  return sum;
+}
+
+constexpr double sqrt(double v) {
+  if (v <= 0) return 0;
+  double x = v > 1 ? v : 1;
+  for (int i = 0; i < 40; i++) x = 0.5 * (x + v / x);
+  return x;
+}
+
+// Modified Bessel function of the first kind, order 0
+constexpr double bessel_i0(double x) {
+  double sum = 1, term = 1;
+  for (int k = 1; k < 40; k++) {
+    term *= x / (2 * k);
+    sum  += term * term;
+  }
+  return sum;
+}
+
+// Prototype low-pass at the upsampled rate, tap n of L * TAPS
+constexpr double prototype(int n, int length, double cutoff, double beta) {
+  double c = (length - 1) / 2.0;
+  double t = n - c;
+  double x = 2 * cutoff * t;
+  double sinc = x == 0 ? 1.0 : sin(PI * x) / (PI * x);
+  double r = t / c;
+  return 2 * cutoff * sinc * bessel_i0(beta * sqrt(1 - r * r)) / bessel_i0(beta);
+}
+
+}  // namespace resample_detail
+
+// L phases of TAPS coefficients for an L/M conversion, each phase reversed
+// and scaled to sum to `unity`
+template <typename T, int L, int M, int TAPS>
+struct PolyphaseTable {
+  alignas(16) T c[L * TAPS];
+
+  constexpr PolyphaseTable(double rolloff, double beta, double unity) : c() {
+    int    length = L * TAPS;
+    double cutoff = rolloff * 0.5 / (L > M ? L : M);
+    for (int p = 0; p < L; p++) {
+      double sum = 0;
+      for (int k = 0; k < TAPS; k++) sum += resample_detail::prototype(p + k * L, length, cutoff, beta);
+      for (int k = 0; k < TAPS; k++) {
+        double v = resample_detail::prototype(p + k * L, length, cutoff, beta) / sum * unity;
+        c[p * TAPS + TAPS - 1 - k] = (T)(v < 0 ? v - 0.5 : v + 0.5);
+      }
+    }
+  }
+};
+
+#define RESAMPLE_FAST_TABLE(L, M, TAPS) PolyphaseTable<int16_t, L, M, TAPS>(0.87, 6.0, 32768.0)
+#define RESAMPLE_HQ_TABLE(L, M, TAPS)   PolyphaseTable<int32_t, L, M, TAPS>(0.91, 9.0, 1073741824.0)
+
+// 48 kHz output from 44.1 / 88.2 / 96 / 176.4 / 192 kHz. Decimating
+// ratios widen the filter in proportion so the transition band stays put.
+static constexpr auto RESAMPLE_FAST_44K1  = RESAMPLE_FAST_TABLE(160, 147, 32);
+static constexpr auto RESAMPLE_FAST_88K2  = RESAMPLE_FAST_TABLE(80, 147, 64);
+static constexpr auto RESAMPLE_FAST_96K   = RESAMPLE_FAST_TABLE(1, 2, 64);
+static constexpr auto RESAMPLE_FAST_176K4 = RESAMPLE_FAST_TABLE(40, 147, 128);
+static constexpr auto RESAMPLE_FAST_192K  = RESAMPLE_FAST_TABLE(1, 4, 128);
+static constexpr auto RESAMPLE_HQ_44K1    = RESAMPLE_HQ_TABLE(160, 147, 64);
+static constexpr auto RESAMPLE_HQ_88K2    = RESAMPLE_HQ_TABLE(80, 147, 128);
+static constexpr auto RESAMPLE_HQ_96K     = RESAMPLE_HQ_TABLE(1, 2, 128);
+static constexpr auto RESAMPLE_HQ_176K4   = RESAMPLE_HQ_TABLE(40, 147, 256);
+static constexpr auto RESAMPLE_HQ_192K    = RESAMPLE_HQ_TABLE(1, 4, 256);
+
+inline int32_t resample_dot16(const int16_t* x, const int16_t* c, int taps) {
+  int32_t acc = 0;
+  for (int k = 0; k < taps; k++) acc += (int32_t)x[k] * c[k];
+  return acc;
+}
+
+inline int64_t resample_dot32(const int32_t* x, const int32_t* c, int taps) {
+  int64_t acc = 0;
+  for (int k = 0; k < taps; k++) acc += (int64_t)x[k] * c[k];
+  return acc;
+}
+
+inline int32_t resample_sat32(int64_t v) {
+  return v > INT32_MAX ? INT32_MAX : v < INT32_MIN ? INT32_MIN : (int32_t)v;
+}
+
+class Resampler {
+public:
+  // Selects the table for `in_rate`. Returns false (and stays in bypass)
+  // for RESAMPLE_BYPASS or a rate without a table. The filter history
+  // survives a call with unchanged settings, so gapless tracks at the same
+  // rate run through without a seam.
+  bool configure(ResampleMode want, uint32_t in_rate) {
+    if (want == mode && in_rate == rate && want != RESAMPLE_BYPASS) return true;
+
+    mode  = RESAMPLE_BYPASS;
+    rate  = in_rate;
+    L     = M = taps = 1;
+    c16   = nullptr;
+    c32   = nullptr;
+    if (want == RESAMPLE_BYPASS) return false;
+
+    bool fast = want == RESAMPLE_FAST;
+    switch (in_rate) {
+      case RESAMPLE_OUT_RATE: break;
+      case 44100:  fast ? use(RESAMPLE_FAST_44K1)  : use(RESAMPLE_HQ_44K1);  break;
+      case 88200:  fast ? use(RESAMPLE_FAST_88K2)  : use(RESAMPLE_HQ_88K2);  break;
+      case 96000:  fast ? use(RESAMPLE_FAST_96K)   : use(RESAMPLE_HQ_96K);   break;
+      case 176400: fast ? use(RESAMPLE_FAST_176K4) : use(RESAMPLE_HQ_176K4); break;
+      case 192000: fast ? use(RESAMPLE_FAST_192K)  : use(RESAMPLE_HQ_192K);  break;
+      default: return false;
+    }
+    mode = want;
+    reset();
+    return true;
+  }
+
+  bool active() const { return mode != RESAMPLE_BYPASS; }
+  ResampleMode current_mode() const { return mode; }
+
+  // Input frames to output frames, e.g. for a seek target
+  uint64_t output_frames(uint64_t frames) const { return frames * L / M; }
+
+  // Forget the history, e.g. after a seek
+  void reset() {
+    memset(h16, 0, sizeof(h16));
+    memset(h32, 0, sizeof(h32));
+    fill  = taps - 1;
+    pos   = taps - 1;
+    phase = 0;
+  }
+
+  // Converts up to RESAMPLE_BLOCK interleaved frames of 16-bit, 24-in-32
+  // or 32-bit PCM (any channel count; mono is duplicated, channels past
+  // the second are dropped). Returns the number of stereo 32-bit frames
+  // now in output().
+  size_t process(const uint8_t* in, size_t frames, uint8_t bits, uint8_t channels) {
+    if (frames > RESAMPLE_BLOCK) frames = RESAMPLE_BLOCK;
+    if (channels == 0) return 0;
+    uint8_t right = channels > 1 ? 1 : 0;
+
+    if (L == 1 && M == 1) {
+      for (size_t f = 0; f < frames; f++) {
+        out[2 * f]     = sample_q31(in, f * channels, bits);
+        out[2 * f + 1] = sample_q31(in, f * channels + right, bits);
+      }
+      return frames;
+    }
+
+    bool hq = mode == RESAMPLE_HQ;
+    for (size_t f = 0; f < frames; f++) {
+      int32_t l = sample_q31(in, f * channels, bits);
+      int32_t r = sample_q31(in, f * channels + right, bits);
+      if (hq) {
+        h32[0][fill + f] = l;
+        h32[1][fill + f] = r;
+      } else {
+        h16[0][fill + f] = (int16_t)(l >> 16);
+        h16[1][fill + f] = (int16_t)(r >> 16);
+      }
+    }
+    fill += frames;
+
+    size_t n = 0;
+    while (pos < fill) {
+      size_t start = pos + 1 - taps;
+      if (hq) {
+        const int32_t* c = c32 + phase * taps;
+        out[2 * n]     = resample_sat32(resample_dot32(&h32[0][start], c, taps) >> 30);
+        out[2 * n + 1] = resample_sat32(resample_dot32(&h32[1][start], c, taps) >> 30);
+      } else {
+        const int16_t* c = c16 + phase * taps;
+        out[2 * n]     = resample_sat32((int64_t)resample_dot16(&h16[0][start], c, taps) * 2);
+        out[2 * n + 1] = resample_sat32((int64_t)resample_dot16(&h16[1][start], c, taps) * 2);
+      }
+      n++;
+      for (phase += M; phase >= L; phase -= L) pos++;
+    }
+
+    // Keep the last taps - 1 samples the next output still needs
+    size_t keep_from = (pos < fill ? pos : fill) + 1 - taps;
+    if (keep_from > 0) {
+      size_t keep = fill - keep_from;
+      if (hq) {
+        memmove(h32[0], h32[0] + keep_from, keep * sizeof(int32_t));
+        memmove(h32[1], h32[1] + keep_from, keep * sizeof(int32_t));
+      } else {
+        memmove(h16[0], h16[0] + keep_from, keep * sizeof(int16_t));
+        memmove(h16[1], h16[1] + keep_from, keep * sizeof(int16_t));
+      }
+      pos  -= keep_from;
+      fill -= keep_from;
+    }
+    return n;
+  }
+
+  const int32_t* output() const { return out; }
+
+private:
+  template <int TL, int TM, int TT>
+  void use(const PolyphaseTable<int16_t, TL, TM, TT>& t) {
+    c16 = t.c; L = TL; M = TM; taps = TT;
+  }
+  template <int TL, int TM, int TT>
+  void use(const PolyphaseTable<int32_t, TL, TM, TT>& t) {
+    c32 = t.c; L = TL; M = TM; taps = TT;
+  }
+
+  static int32_t sample_q31(const uint8_t* in, size_t index, uint8_t bits) {
+    if (bits == 16) {
+      int16_t s;
+      memcpy(&s, in + index * 2, 2);
+      return (int32_t)s * 65536;
+    }
+    int32_t s;
+    memcpy(&s, in + index * 4, 4);
+    return bits == 24 ? (int32_t)((uint32_t)s << 8) : s;
+  }
+
+  ResampleMode   mode  = RESAMPLE_BYPASS;
+  uint32_t       rate  = 0;
+  int            L     = 1;
+  int            M     = 1;
+  int            taps  = 1;
+  const int16_t* c16   = nullptr;
+  const int32_t* c32   = nullptr;
+  size_t         fill  = 0;     // history samples per channel
+  size_t         pos   = 0;     // newest input sample of the next output
+  int            phase = 0;
+
+  alignas(16) int16_t h16[2][RESAMPLE_MAX_TAPS + RESAMPLE_BLOCK];
+  alignas(16) int32_t h32[2][RESAMPLE_MAX_TAPS + RESAMPLE_BLOCK];
+  int32_t             out[RESAMPLE_BLOCK * 2 * RESAMPLE_OUT_CHANNELS];   // up to 2x upsampling
+};
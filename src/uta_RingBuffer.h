@@ -0,0 +1,115 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <atomic>
+
+/// Lock-free single-producer / single-consumer byte ring for decoded PCM.
+class PcmRingBuffer {
+public:
+  // `storage` stays owned by the caller (PSRAM on the device). Capacity
+  // must be a power of two; head and tail run freely and are masked.
+  bool begin(uint8_t* storage, size_t capacity) {
+    if (!storage || capacity == 0 || (capacity & (capacity - 1)) != 0) return false;
+    buf  = storage;
+    cap  = capacity;
+    mask = capacity - 1;
+    head.store(0, std::memory_order_relaxed);
+    tail.store(0, std::memory_order_relaxed);
+    return true;
+  }
+
+  size_t capacity() const { return cap; }
+
+  // Bytes ready for the consumer
+  size_t available() const {
+    return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+  }
+
+  // Running byte totals, for tagging positions in the stream
+  size_t write_position() const { return head.load(std::memory_order_acquire); }
+  size_t read_position() const  { return tail.load(std::memory_order_acquire); }
+
+  // Bytes the producer may still write
+  size_t free_space() const {
+    return cap - available();
+  }
+
+  // Producer side. Returns the number of bytes actually queued.
+  size_t write(const uint8_t* data, size_t len) {
+    size_t h = head.load(std::memory_order_relaxed);
+    size_t t = tail.load(std::memory_order_acquire);
+    size_t room = cap - (h - t);
+    if (len > room) len = room;
+    if (len == 0) return 0;
+
+    size_t off   = h & mask;
+    size_t first = cap - off;
+    if (first > len) first = len;
+    memcpy(buf + off, data, first);
+    memcpy(buf, data + first, len - first);
+
+    head.store(h + len, std::memory_order_release);
+    return len;
+  }
+
+  // Consumer side. Returns the number of bytes copied out.
+  size_t read(uint8_t* out, size_t len) {
+    size_t t = tail.load(std::memory_order_relaxed);
+    size_t h = head.load(std::memory_order_acquire);
+    size_t have = h - t;
+    if (len > have) len = have;
+    if (len == 0) return 0;
+
+    size_t off   = t & mask;
+    size_t first = cap - off;
+    if (first > len) first = len;
+    memcpy(out, buf + off, first);
+    memcpy(out + first, buf, len - first);
+
+    tail.store(t + len, std::memory_order_release);
+    return len;
+  }
+
+  // Consumer side: drop everything queued so far
+  void discard() {
+    tail.store(head.load(std::memory_order_acquire), std::memory_order_release);
+  }
+
+private:
+  uint8_t* buf  = nullptr;
+  size_t   cap  = 0;
+  size_t   mask = 0;
+
+  // Producer owns head, consumer owns tail
+  alignas(32) std::atomic<size_t> head{0};
+  alignas(32) std::atomic<size_t> tail{0};
+};
+
+// Cuts one decoder write down to whole frames inside the wanted range:
+// drops up to `skip` leading frames (seek landing) and keeps at most `left`
+// frames (gapless: the container's exact length, UINT64_MAX when unknown).
+// Both counters are advanced. Returns the bytes to keep from `data`.
+inline size_t pcm_trim(const uint8_t*& data, size_t len, size_t frame_bytes,
+                       uint64_t& skip, uint64_t& left) {
+  if (frame_bytes == 0) return len;
+
+  if (skip > 0) {
+    uint64_t frames = len / frame_bytes;
+    uint64_t drop   = frames < skip ? frames : skip;
+    skip -= drop;
+    data += drop * frame_bytes;
+    len  -= drop * frame_bytes;
+  }
+
+  if (left != UINT64_MAX) {
+    uint64_t frames = len / frame_bytes;
+    if (frames > left) {
+      frames = left;
+      len    = frames * frame_bytes;
+    }
+    left -= frames;
+  }
+  return len;
+}
@@ -2,6 +2,15 @@
 
 #include "sdios.h"
 #include "SdFat.h"
+#include "driver/spi_master.h"
+#include "driver/sdmmc_host.h"
+#include "sdmmc_cmd.h"
+#include "esp_heap_caps.h"
+#if __has_include("esp_memory_utils.h")
+#include "esp_memory_utils.h"
+#else
+#include "soc/soc_memory_layout.h"
+#endif
 
 #include "uta_Display.h"
 
@@ -13,39 +22,447 @@
 #define SD_FAT_TYPE 2
 #define SPI_CLOCK SD_SCK_MHZ(50)
 
+// Card transport. SPI by default; SDMMC is opt-in (-DSD_BUS_MODE or the
+// [M] command) and reuses the SPI wiring (CLK = SCK, CMD = MOSI, D0 = MISO,
+// D3 = CS); 4-bit additionally needs D1/D2 wired and set below. Whatever is
+// selected falls back to SPI if the card does not come up.
+#define SD_BUS_SPI          0
+#define SD_BUS_SDMMC_1BIT   1
+#define SD_BUS_SDMMC_4BIT   4
+
+#ifndef SD_BUS_MODE
+#define SD_BUS_MODE SD_BUS_SPI
+#endif
+#ifndef SD_MMC_D1
+#define SD_MMC_D1 -1
+#endif
+#ifndef SD_MMC_D2
+#define SD_MMC_D2 -1
+#endif
+#ifndef SD_MMC_FREQ_KHZ
+#define SD_MMC_FREQ_KHZ SDMMC_FREQ_HIGHSPEED
+#endif
+
 SdFs sd;
 extern DisplayManager display;
 
-/// Taken from https://github.com/greiman/SdFat/issues/450
+// Serialises card access between the decode task, the library scanner and
+// the UI. Recursive, so a holder may call into code that locks again.
+SemaphoreHandle_t sd_mutex = nullptr;
+
+void sd_lock()   { if (sd_mutex) xSemaphoreTakeRecursive(sd_mutex, portMAX_DELAY); }
+void sd_unlock() { if (sd_mutex) xSemaphoreGiveRecursive(sd_mutex); }
+
+class SdLock {
+public:
+  SdLock()  { sd_lock(); }
+  ~SdLock() { sd_unlock(); }
+};
+
+// Multi-byte transfers go through the ESP-IDF SPI master with DMA. Anything
+// at or above SD_DMA_BLOCKING_MIN waits on the transaction interrupt, so the
+// CPU is free for the decoder while a sector streams in; shorter ones poll.
+#define SD_SPI_HOST           SPI2_HOST
+#define SD_DMA_MAX            4096
+#define SD_DMA_BLOCKING_MIN   512
+
+/// SdFat transport on the ESP-IDF SPI master.
+/// Based on https://github.com/greiman/SdFat/issues/450
 class ExFatSPI : public SdSpiBaseClass {
 public:
-  void activate() { SPI.beginTransaction(m_spiSettings); }
   void begin(SdSpiConfig config) {
     (void)config;
-    SPI.begin(SPI_SCK, SPI_MISO, SPI_MOSI, -1);
+    if (bus_ready) return;
+
+    spi_bus_config_t bus = {};
+    bus.mosi_io_num     = SPI_MOSI;
+    bus.miso_io_num     = SPI_MISO;
+    bus.sclk_io_num     = SPI_SCK;
+    bus.quadwp_io_num   = -1;
+    bus.quadhd_io_num   = -1;
+    bus.max_transfer_sz = SD_DMA_MAX;
+
+    esp_err_t err = spi_bus_initialize(SD_SPI_HOST, &bus, SPI_DMA_CH_AUTO);
+    if (err != ESP_OK) {
+      Serial.printf("[ERROR] SD SPI bus init failed (%s)\n", esp_err_to_name(err));
+      return;
+    }
+
+    ff_buf     = (uint8_t*)heap_caps_malloc(SD_DMA_MAX, MALLOC_CAP_DMA);
+    bounce_buf = (uint8_t*)heap_caps_malloc(SD_DMA_MAX, MALLOC_CAP_DMA);
+    if (!ff_buf || !bounce_buf) {
+      Serial.println("[ERROR] SD DMA buffers failed");
+      return;
+    }
+    memset(ff_buf, 0xFF, SD_DMA_MAX);
+    bus_ready = true;
+  }
+
+  void activate() {
+    if (device_hz != sck_hz) attach_device();
+    if (device) spi_device_acquire_bus(device, portMAX_DELAY);
   }
-  void deactivate() { SPI.endTransaction(); }
-  uint8_t receive() { return SPI.transfer(0XFF); }
+
+  void deactivate() {
+    if (device) spi_device_release_bus(device);
+  }
+
+  uint8_t receive() {
+    spi_transaction_t t = {};
+    t.flags     = SPI_TRANS_USE_TXDATA | SPI_TRANS_USE_RXDATA;
+    t.length    = 8;
+    t.tx_data[0] = 0xFF;
+    spi_device_polling_transmit(device, &t);
+    return t.rx_data[0];
+  }
+
   uint8_t receive(uint8_t* buf, size_t count) {
-    for (size_t i = 0; i < count; i++) buf[i] = SPI.transfer(0XFF);
+    // Straight into the caller's buffer when the DMA engine can reach it,
+    // otherwise (PSRAM, unaligned) through the bounce buffer
+    bool direct = dma_ok(buf, count);
+    while (count > 0) {
+      size_t n = count < SD_DMA_MAX ? count : SD_DMA_MAX;
+      if (direct) {
+        transfer(ff_buf, buf, n);
+      } else {
+        transfer(ff_buf, bounce_buf, n);
+        memcpy(buf, bounce_buf, n);
+        bounced++;
+      }
+      buf   += n;
+      count -= n;
+    }
     return 0;
   }
-  void send(uint8_t data) { SPI.transfer(data); }
+
+  void send(uint8_t data) {
+    spi_transaction_t t = {};
+    t.flags      = SPI_TRANS_USE_TXDATA;
+    t.length     = 8;
+    t.tx_data[0] = data;
+    spi_device_polling_transmit(device, &t);
+  }
+
   void send(const uint8_t* buf, size_t count) {
-    for (size_t i = 0; i < count; i++) SPI.transfer(buf[i]);
+    bool direct = dma_ok(buf, count);
+    while (count > 0) {
+      size_t n = count < SD_DMA_MAX ? count : SD_DMA_MAX;
+      if (direct) {
+        transfer(buf, nullptr, n);
+      } else {
+        memcpy(bounce_buf, buf, n);
+        transfer(bounce_buf, nullptr, n);
+        bounced++;
+      }
+      buf   += n;
+      count -= n;
+    }
   }
+
   void setSckSpeed(uint32_t maxSck) {
-    m_spiSettings = SPISettings(maxSck, MSBFIRST, SPI_MODE0);
+    sck_hz = maxSck;
   }
+
+  uint32_t bounced_transfers() const { return bounced; }
+
 private:
-  SPISettings m_spiSettings;
+  spi_device_handle_t device = nullptr;
+  bool     bus_ready  = false;
+  uint32_t sck_hz     = 400000;
+  uint32_t device_hz  = 0;
+  uint8_t* ff_buf     = nullptr;   // 0xFF clocked out while reading
+  uint8_t* bounce_buf = nullptr;
+  uint32_t bounced    = 0;
+
+  // The device clock is fixed when it is added, so SdFat's switch from the
+  // 400 kHz init rate to full speed re-adds it. CS stays under SdFat's
+  // control; the pins go through the GPIO matrix, hence no dummy cycles.
+  void attach_device() {
+    if (!bus_ready) return;
+    if (device) {
+      spi_bus_remove_device(device);
+      device = nullptr;
+    }
+
+    spi_device_interface_config_t cfg = {};
+    cfg.mode           = 0;
+    cfg.clock_speed_hz = sck_hz;
+    cfg.spics_io_num   = -1;
+    cfg.queue_size     = 1;
+    cfg.flags          = SPI_DEVICE_NO_DUMMY;
+
+    esp_err_t err = spi_bus_add_device(SD_SPI_HOST, &cfg, &device);
+    if (err != ESP_OK) {
+      Serial.printf("[ERROR] SD SPI device at %lu Hz failed (%s)\n", sck_hz, esp_err_to_name(err));
+      device = nullptr;
+      return;
+    }
+    device_hz = sck_hz;
+  }
+
+  static bool dma_ok(const void* p, size_t n) {
+    return esp_ptr_dma_capable(p) && ((uintptr_t)p & 3) == 0 && (n & 3) == 0;
+  }
+
+  void transfer(const uint8_t* tx, uint8_t* rx, size_t n) {
+    spi_transaction_t t = {};
+    t.length    = n * 8;
+    t.rxlength  = rx ? n * 8 : 0;
+    t.tx_buffer = tx;
+    t.rx_buffer = rx;
+    if (n >= SD_DMA_BLOCKING_MIN) spi_device_transmit(device, &t);
+    else                          spi_device_polling_transmit(device, &t);
+  }
 } exfat_spi;
 
 #define SD_CONFIG SdSpiConfig(SPI_CS, DEDICATED_SPI, SPI_CLOCK, &exfat_spi)
 
+/// SdFat block device on the native SDMMC host
+class SdmmcBlockDevice : public FsBlockDevice {
+public:
+  bool begin(uint8_t width) {
+    if (width == 4 && (SD_MMC_D1 < 0 || SD_MMC_D2 < 0)) {
+      Serial.println("[WARN] SDMMC 4-bit needs SD_MMC_D1/D2, using 1-bit");
+      width = 1;
+    }
+
+    // D3 high at CMD0 keeps the card in SD mode
+    pinMode(SPI_CS, OUTPUT);
+    digitalWrite(SPI_CS, HIGH);
+
+    host = SDMMC_HOST_DEFAULT();
+    host.slot         = SDMMC_HOST_SLOT_1;
+    host.max_freq_khz = SD_MMC_FREQ_KHZ;
+
+    sdmmc_slot_config_t slot = SDMMC_SLOT_CONFIG_DEFAULT();
+    slot.width = width;
+    slot.clk   = (gpio_num_t)SPI_SCK;
+    slot.cmd   = (gpio_num_t)SPI_MOSI;
+    slot.d0    = (gpio_num_t)SPI_MISO;
+    if (width == 4) {
+      slot.d1 = (gpio_num_t)SD_MMC_D1;
+      slot.d2 = (gpio_num_t)SD_MMC_D2;
+      slot.d3 = (gpio_num_t)SPI_CS;
+    }
+    slot.flags |= SDMMC_SLOT_FLAG_INTERNAL_PULLUP;
+
+    if (sdmmc_host_init() != ESP_OK) return false;
+    host_ready = true;
+
+    esp_err_t err = sdmmc_host_init_slot(host.slot, &slot);
+    if (err == ESP_OK) err = sdmmc_card_init(&host, &card);
+    if (err != ESP_OK) {
+      Serial.printf("[WARN] SDMMC init failed (%s)\n", esp_err_to_name(err));
+      end();
+      return false;
+    }
+
+    bus_width = width;
+    return true;
+  }
+
+  void end() {
+    if (host_ready) sdmmc_host_deinit();
+    host_ready = false;
+    bus_width  = 0;
+  }
+
+  uint8_t  width() const { return bus_width; }
+  uint32_t freq_khz() const { return card.max_freq_khz; }
+
+  bool isBusy() { return false; }
+
+  bool readSector(uint32_t sector, uint8_t* dst) {
+    return readSectors(sector, dst, 1);
+  }
+
+  // Non-DMA-capable buffers are bounced sector by sector inside the driver
+  bool readSectors(uint32_t sector, uint8_t* dst, size_t ns) {
+    return sdmmc_read_sectors(&card, dst, sector, ns) == ESP_OK;
+  }
+
+  uint32_t sectorCount() { return card.csd.capacity; }
+
+  bool syncDevice() { return true; }
+
+  bool writeSector(uint32_t sector, const uint8_t* src) {
+    return writeSectors(sector, src, 1);
+  }
+
+  bool writeSectors(uint32_t sector, const uint8_t* src, size_t ns) {
+    return sdmmc_write_sectors(&card, src, sector, ns) == ESP_OK;
+  }
+
+private:
+  sdmmc_host_t host = {};
+  sdmmc_card_t card = {};
+  bool         host_ready = false;
+  uint8_t      bus_width  = 0;
+} sdmmc_dev;
+
+// Survives a software restart, so the transport can be switched at runtime
+// and the benchmark can show both sides of the comparison.
+struct SdBenchResult {
+  float mbps[3];
+  float cpu[3];
+  bool  valid;
+};
+
+struct SdBootState {
+  uint32_t      magic;
+  uint8_t       requested_bus;
+  SdBenchResult bench[3];   // SPI, SDMMC 1-bit, SDMMC 4-bit
+};
+
+#define SD_BOOT_MAGIC 0x53444253u  // "SDBS"
+
+RTC_NOINIT_ATTR SdBootState sd_boot;
+uint8_t sd_bus = SD_BUS_SPI;
+
+const char* sd_bus_name(uint8_t bus) {
+  switch (bus) {
+    case SD_BUS_SDMMC_1BIT: return "SDMMC 1-bit";
+    case SD_BUS_SDMMC_4BIT: return "SDMMC 4-bit";
+    default:                return "SPI";
+  }
+}
+
+uint8_t sd_bus_slot(uint8_t bus) {
+  return bus == SD_BUS_SDMMC_4BIT ? 2 : (bus == SD_BUS_SDMMC_1BIT ? 1 : 0);
+}
+
+// Raw sector access for callers that bypass the volume (read-ahead of
+// contiguous files). Only valid once sdcard_begin() has succeeded.
+FsBlockDevice* sd_block_device() {
+  if (sd_bus != SD_BUS_SPI) return &sdmmc_dev;
+  return sd.card();
+}
+
+// Takes effect on the next restart
+void sdcard_request_bus(uint8_t bus) {
+  sd_boot.requested_bus = bus;
+}
+
 bool sdcard_begin() {
+  if (!sd_mutex) sd_mutex = xSemaphoreCreateRecursiveMutex();
+
+  if (sd_boot.magic != SD_BOOT_MAGIC) {
+    memset(&sd_boot, 0, sizeof(sd_boot));
+    sd_boot.magic         = SD_BOOT_MAGIC;
+    sd_boot.requested_bus = SD_BUS_MODE;
+  }
+
+  uint8_t bus = sd_boot.requested_bus;
+  if (bus != SD_BUS_SPI) {
+    uint8_t width = bus == SD_BUS_SDMMC_4BIT ? 4 : 1;
+    if (sdmmc_dev.begin(width) && sd.FsVolume::begin(&sdmmc_dev)) {
+      sd_bus = sdmmc_dev.width() == 4 ? SD_BUS_SDMMC_4BIT : SD_BUS_SDMMC_1BIT;
+      Serial.printf("[INFO] SD card on %s at %lu kHz\n", sd_bus_name(sd_bus), sdmmc_dev.freq_khz());
+      return true;
+    }
+    sdmmc_dev.end();
+    Serial.println("[WARN] SDMMC unavailable, falling back to SPI");
+  }
+
   if (!sd.begin(SD_CONFIG)) {
     return false;
   }
+  sd_bus = SD_BUS_SPI;
+  Serial.println("[INFO] SD card on SPI");
   return true;
-}
\ No newline at end of file
+}
+
+// ======================================================================== //
+// ============================ Card Benchmark ============================ //
+// ======================================================================== //
+
+// Sequential read throughput of `path` at a few request sizes. CPU load is
+// taken from a spinner task on the same core: it only runs while the reader
+// is blocked on the card, so its lost iterations are the reader's CPU time.
+#define SD_BENCH_BYTES  (2UL * 1024 * 1024)
+
+static volatile uint32_t sd_bench_spins = 0;
+static volatile bool     sd_bench_spinning = false;
+
+static void sd_bench_spinner(void* arg) {
+  (void)arg;
+  while (sd_bench_spinning) sd_bench_spins++;
+  vTaskDelete(NULL);
+}
+
+void sdcard_benchmark(const char* path) {
+  static const size_t sizes[] = { 512, 4096, 32768 };
+
+  uint8_t* buf = (uint8_t*)heap_caps_malloc(32768, MALLOC_CAP_DMA);
+  if (!buf) {
+    Serial.println("[ERROR] Benchmark buffer allocation failed");
+    return;
+  }
+
+  UBaseType_t prio = uxTaskPriorityGet(NULL);
+  sd_bench_spinning = true;
+  xTaskCreatePinnedToCore(sd_bench_spinner, "SdBenchSpin", 2048, nullptr, prio, nullptr, xPortGetCoreID());
+  vTaskPrioritySet(NULL, prio + 1);
+
+  // Calibrate: spinner rate with the reader asleep
+  uint32_t s0 = sd_bench_spins, t0 = micros();
+  vTaskDelay(pdMS_TO_TICKS(200));
+  float spins_per_us = (float)(sd_bench_spins - s0) / (micros() - t0);
+
+  SdBenchResult& result = sd_boot.bench[sd_bus_slot(sd_bus)];
+  result.valid = false;
+
+  Serial.println(F("╔═══════════════════ SD CARD BENCHMARK ══════════════════╗"));
+  Serial.printf(   "  File: %s\n", path);
+  Serial.printf(   "  Transport: %s\n", sd_bus_name(sd_bus));
+  Serial.println(F("  Request      MB/s      CPU%"));
+
+  for (size_t i = 0; i < 3; i++) {
+    size_t size = sizes[i];
+    SdLock lock;
+    FsFile file;
+    if (!file.open(path, O_RDONLY)) {
+      Serial.println("[ERROR] Cannot open benchmark file");
+      break;
+    }
+
+    uint32_t total = 0;
+    uint32_t spins = sd_bench_spins, start = micros();
+    while (total < SD_BENCH_BYTES) {
+      int n = file.read(buf, size);
+      if (n <= 0) break;
+      total += n;
+    }
+    uint32_t elapsed = micros() - start;
+    spins = sd_bench_spins - spins;
+    file.close();
+
+    float mbps = elapsed ? total / (float)elapsed : 0.0f;
+    float idle = spins_per_us > 0 && elapsed ? spins / (spins_per_us * elapsed) : 0.0f;
+    float cpu  = 100.0f * (1.0f - (idle > 1.0f ? 1.0f : idle));
+    Serial.printf("  %6u B   %7.2f   %7.1f   (%lu KB)\n", (unsigned)size, mbps, cpu, total / 1024);
+    result.mbps[i] = mbps;
+    result.cpu[i]  = cpu;
+    result.valid   = true;
+  }
+
+  if (sd_bus == SD_BUS_SPI) {
+    Serial.printf( "  Bounced DMA transfers: %lu\n", exfat_spi.bounced_transfers());
+  }
+
+  // Results from other transports, measured before a restart
+  const uint8_t buses[] = { SD_BUS_SPI, SD_BUS_SDMMC_1BIT, SD_BUS_SDMMC_4BIT };
+  for (uint8_t bus : buses) {
+    const SdBenchResult& r = sd_boot.bench[sd_bus_slot(bus)];
+    if (bus == sd_bus || !r.valid) continue;
+    Serial.printf( "  vs %-12s", sd_bus_name(bus));
+    for (size_t i = 0; i < 3; i++) Serial.printf("  %.2f MB/s %.0f%%", r.mbps[i], r.cpu[i]);
+    Serial.println();
+  }
+  Serial.println(F("╚════════════════════════════════════════════════════════╝"));
+
+  vTaskPrioritySet(NULL, prio);
+  sd_bench_spinning = false;
+  vTaskDelay(1);
+  heap_caps_free(buf);
+}
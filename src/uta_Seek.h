@@ -0,0 +1,199 @@
+#pragma once
+
+#include "uta_MetaParser.h"
+
+// Sample-accurate seek targets for FLAC (SEEKTABLE, then a bisection over
+// CRC-checked frame headers) and RIFF/WAVE.
+
+#define SEEK_LINEAR_SPAN  (32 * 1024)   // walk frames once the span is this small
+#define SEEK_SCAN_CHUNK   4096
+
+// The caller drops `target - sample` leading frames to land exactly
+struct SeekTarget {
+  uint64_t offset = 0;    // byte offset the decoder should resume from
+  uint64_t sample = 0;    // first PCM frame decoded from there
+};
+
+struct FlacFrame {
+  uint64_t offset = 0;
+  uint64_t sample = 0;
+  uint32_t block  = 0;
+};
+
+inline uint8_t flac_crc8(const uint8_t* p, size_t n) {
+  uint8_t crc = 0;
+  while (n--) {
+    crc ^= *p++;
+    for (int i = 0; i < 8; i++) crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+  }
+  return crc;
+}
+
+// Parses a frame header at `h` (at least 16 readable bytes). `fixed_block` is
+// STREAMINFO's max block size, used to turn frame numbers into samples.
+inline bool flac_parse_frame_header(const uint8_t* h, uint32_t fixed_block, FlacFrame& f) {
+  if (h[0] != 0xFF || (h[1] & 0xFE) != 0xF8) return false;
+  bool variable = h[1] & 0x01;
+
+  uint8_t bs_code = h[2] >> 4;
+  uint8_t sr_code = h[2] & 0x0F;
+  uint8_t ch_code = h[3] >> 4;
+  uint8_t ss_code = (h[3] >> 1) & 0x07;
+  if (bs_code == 0 || sr_code == 0x0F || ch_code >= 11 || ss_code == 3 || (h[3] & 0x01)) return false;
+
+  // UTF-8 style coded frame / sample number
+  size_t pos = 4;
+  uint8_t lead = h[pos++];
+  int extra;
+  uint64_t number;
+  if      (!(lead & 0x80))         { extra = 0; number = lead; }
+  else if ((lead & 0xE0) == 0xC0)  { extra = 1; number = lead & 0x1F; }
+  else if ((lead & 0xF0) == 0xE0)  { extra = 2; number = lead & 0x0F; }
+  else if ((lead & 0xF8) == 0xF0)  { extra = 3; number = lead & 0x07; }
+  else if ((lead & 0xFC) == 0xF8)  { extra = 4; number = lead & 0x03; }
+  else if ((lead & 0xFE) == 0xFC)  { extra = 5; number = lead & 0x01; }
+  else if (lead == 0xFE)           { extra = 6; number = 0; }
+  else return false;
+  if (!variable && extra > 5) return false;
+  for (int i = 0; i < extra; i++) {
+    uint8_t c = h[pos++];
+    if ((c & 0xC0) != 0x80) return false;
+    number = (number << 6) | (c & 0x3F);
+  }
+
+  uint32_t block;
+  if      (bs_code == 1) block = 192;
+  else if (bs_code <= 5) block = 576u << (bs_code - 2);
+  else if (bs_code == 6) block = h[pos++] + 1;
+  else if (bs_code == 7) { block = ((h[pos] << 8) | h[pos + 1]) + 1; pos += 2; }
+  else                   block = 256u << (bs_code - 8);
+
+  if      (sr_code == 12) pos += 1;
+  else if (sr_code == 13 || sr_code == 14) pos += 2;
+
+  if (flac_crc8(h, pos) != h[pos]) return false;
+
+  f.block  = block;
+  f.sample = variable ? number : number * (fixed_block ? fixed_block : block);
+  return true;
+}
+
+// First valid frame header in [from, limit)
+inline bool flac_find_frame(MetaWindow& win, uint64_t from, uint64_t limit, uint32_t fixed_block, FlacFrame& f) {
+  if (limit > win.size()) limit = win.size();
+  while (from + 16 <= limit) {
+    size_t span = SEEK_SCAN_CHUNK;
+    if (from + span > limit) span = limit - from;
+    const uint8_t* p = win.get(from, span);
+    if (!p) return false;
+
+    for (size_t i = 0; i + 1 < span; i++) {
+      if (p[i] != 0xFF || (p[i + 1] & 0xFE) != 0xF8) continue;
+      const uint8_t* h = win.get(from + i, 16);
+      if (!h) return false;
+      if (flac_parse_frame_header(h, fixed_block, f)) {
+        f.offset = from + i;
+        return true;
+      }
+      p = win.get(from, span);   // the window may have moved
+      if (!p) return false;
+    }
+    from += span > 1 ? span - 1 : 1;
+  }
+  return false;
+}
+
+// `start` is the offset of "fLaC" (the probe's start)
+inline bool flac_seek(MetaWindow& win, uint64_t target, SeekTarget& out, uint64_t start = 0) {
+  const uint8_t* p = win.get(start, 4);
+  if (!p || memcmp(p, "fLaC", 4) != 0) return false;
+
+  uint32_t fixed_block = 0;
+  uint64_t lo_sample = 0, lo_rel = 0, hi_rel = UINT64_MAX;
+  bool     have_point = false;
+
+  uint64_t off = start + 4;
+  bool last = false;
+  while (!last) {
+    if (!(p = win.get(off, 4))) return false;
+    last          = p[0] & 0x80;
+    uint8_t type  = p[0] & 0x7F;
+    uint32_t size = meta_be24(p + 1);
+    off += 4;
+
+    if (type == 0 && size >= 34) {
+      const uint8_t* b = win.get(off, 34);
+      if (!b) return false;
+      uint16_t min_block = (b[0] << 8) | b[1];
+      uint16_t max_block = (b[2] << 8) | b[3];
+      if (min_block == max_block) fixed_block = max_block;
+    } else if (type == 3) {
+      for (uint32_t i = 0; i + 18 <= size; i += 18) {
+        const uint8_t* e = win.get(off + i, 18);
+        if (!e) break;
+        uint64_t sample = ((uint64_t)meta_be32(e) << 32) | meta_be32(e + 4);
+        uint64_t rel    = ((uint64_t)meta_be32(e + 8) << 32) | meta_be32(e + 12);
+        if (sample == UINT64_MAX) continue;        // placeholder
+        if (sample <= target) {
+          if (!have_point || sample >= lo_sample) { lo_sample = sample; lo_rel = rel; have_point = true; }
+        } else if (rel < hi_rel) {
+          hi_rel = rel;
+        }
+      }
+    }
+    off += size;
+  }
+
+  uint64_t first_frame = off;
+  uint64_t lo = first_frame + lo_rel;
+  uint64_t hi = hi_rel == UINT64_MAX ? win.size() : first_frame + hi_rel;
+
+  FlacFrame best;
+  if (!flac_find_frame(win, lo, hi, fixed_block, best) || best.sample > target) {
+    if (!flac_find_frame(win, first_frame, win.size(), fixed_block, best)) return false;
+    lo = first_frame;
+    hi = win.size();
+  }
+  lo = best.offset;
+
+  while (hi - lo > SEEK_LINEAR_SPAN) {
+    uint64_t mid = lo + (hi - lo) / 2;
+    FlacFrame f;
+    if (!flac_find_frame(win, mid, hi, fixed_block, f) || f.sample > target) {
+      hi = mid;
+    } else {
+      best = f;
+      lo   = f.offset;
+    }
+  }
+
+  // Walk forward to the frame that holds `target`
+  FlacFrame f;
+  while (best.sample + best.block <= target &&
+         flac_find_frame(win, best.offset + 2, hi + SEEK_SCAN_CHUNK, fixed_block, f) &&
+         f.sample <= target && f.sample > best.sample) {
+    best = f;
+  }
+
+  out.offset = best.offset;
+  out.sample = best.sample;
+  return true;
+}
+
+inline bool riff_seek(MetaWindow& win, uint64_t target, SeekTarget& out, uint64_t start = 0) {
+  class NullSink : public MetaSink {
+  public:
+    void on_tag(const char*, const char*, size_t) override {}
+  } sink;
+
+  MetaResult res;
+  if (!meta_parse_riff(win, sink, res, start)) return false;
+
+  uint32_t block_align = res.channels * (res.bits / 8);
+  if (block_align == 0) return false;
+  if (res.total_samples && target > res.total_samples) target = res.total_samples;
+
+  out.offset = res.audio_offset + target * block_align;
+  out.sample = target;
+  return true;
+}
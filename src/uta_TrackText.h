@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include "uta_Utf.h"
+
+// Title, artist and album of one track, stored inline so track changes
+// never touch the heap. Values that do not fit are cut at a code point.
+
+#define TRACK_TITLE_BYTES   96
+#define TRACK_ARTIST_BYTES  64
+#define TRACK_ALBUM_BYTES   96
+
+class TrackText {
+public:
+  enum Field : uint8_t { TITLE, ARTIST, ALBUM, FIELD_COUNT };
+
+  void set(Field f, const char* s, size_t len) {
+    char* dst = arena + offset(f);
+    len = s ? utf8_fit(s, len, capacity(f)) : 0;
+    if (len) memcpy(dst, s, len);
+    dst[len] = '\0';
+  }
+  void set(Field f, const char* s) { set(f, s, s ? strlen(s) : 0); }
+
+  const char* get(Field f) const { return arena + offset(f); }
+  bool empty(Field f) const      { return arena[offset(f)] == '\0'; }
+
+  void clear() {
+    for (uint8_t f = 0; f < FIELD_COUNT; f++) arena[offset((Field)f)] = '\0';
+  }
+
+private:
+  static size_t offset(Field f) {
+    return f == TITLE ? 0 : f == ARTIST ? TRACK_TITLE_BYTES : TRACK_TITLE_BYTES + TRACK_ARTIST_BYTES;
+  }
+  static size_t capacity(Field f) {
+    return f == TITLE ? TRACK_TITLE_BYTES : f == ARTIST ? TRACK_ARTIST_BYTES : TRACK_ALBUM_BYTES;
+  }
+
+  char arena[TRACK_TITLE_BYTES + TRACK_ARTIST_BYTES + TRACK_ALBUM_BYTES] = {};
+};
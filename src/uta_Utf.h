@@ -0,0 +1,198 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Tag text (UTF-16, ISO-8859-1, UTF-8) to bounded UTF-8. Each routine stops
+// at the first NUL, writes at most `cap` bytes and never splits a code point.
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define UTF_SWAR 1
+#else
+#define UTF_SWAR 0
+#endif
+
+// Longest prefix of `s` that fits in `cap` bytes with its terminator and
+// does not end inside a UTF-8 sequence
+inline size_t utf8_fit(const char* s, size_t len, size_t cap) {
+  if (cap == 0) return 0;
+  if (len < cap) return len;
+  len = cap - 1;
+  while (len > 0 && ((uint8_t)s[len] & 0xC0) == 0x80) len--;
+  return len;
+}
+
+// Appends one code point if all of it fits
+inline size_t utf8_put(char* out, size_t pos, size_t cap, uint32_t cp) {
+  if (cp < 0x80) {
+    if (pos + 1 > cap) return pos;
+    out[pos++] = (char)cp;
+  } else if (cp < 0x800) {
+    if (pos + 2 > cap) return pos;
+    out[pos++] = (char)(0xC0 | (cp >> 6));
+    out[pos++] = (char)(0x80 | (cp & 0x3F));
+  } else if (cp < 0x10000) {
+    if (pos + 3 > cap) return pos;
+    out[pos++] = (char)(0xE0 | (cp >> 12));
+    out[pos++] = (char)(0x80 | ((cp >> 6) & 0x3F));
+    out[pos++] = (char)(0x80 | (cp & 0x3F));
+  } else {
+    if (pos + 4 > cap) return pos;
+    out[pos++] = (char)(0xF0 | (cp >> 18));
+    out[pos++] = (char)(0x80 | ((cp >> 12) & 0x3F));
+    out[pos++] = (char)(0x80 | ((cp >> 6) & 0x3F));
+    out[pos++] = (char)(0x80 | (cp & 0x3F));
+  }
+  return pos;
+}
+
+inline size_t utf8_copy(const uint8_t* src, size_t len, char* out, size_t cap) {
+  const void* nul = memchr(src, 0, len);
+  if (nul) len = (const uint8_t*)nul - src;
+  len = utf8_fit((const char*)src, len, cap + 1);   // no terminator here
+  memcpy(out, src, len);
+  return len;
+}
+
+inline size_t latin1_to_utf8(const uint8_t* src, size_t len, char* out, size_t cap) {
+  size_t i = 0, pos = 0;
+  while (i < len) {
+#if UTF_SWAR
+    if (i + 8 <= len && pos + 8 <= cap) {
+      uint64_t w;
+      memcpy(&w, src + i, 8);
+      bool has_nul = (w - 0x0101010101010101ull) & ~w & 0x8080808080808080ull;
+      if (!has_nul && !(w & 0x8080808080808080ull)) {
+        memcpy(out + pos, &w, 8);
+        i   += 8;
+        pos += 8;
+        continue;
+      }
+    }
+#endif
+    if (src[i] == 0) break;
+    size_t next = utf8_put(out, pos, cap, src[i]);
+    if (next == pos) break;
+    pos = next;
+    i++;
+  }
+  return pos;
+}
+
+#if UTF_SWAR
+// Four 16-bit lanes: byte-swaps each lane, finds a zero lane, packs the
+// low byte of each lane into 4 bytes
+inline uint64_t utf16_swap_lanes(uint64_t w) {
+  return ((w >> 8) & 0x00FF00FF00FF00FFull) | ((w & 0x00FF00FF00FF00FFull) << 8);
+}
+inline bool utf16_has_zero(uint64_t w) {
+  return (w - 0x0001000100010001ull) & ~w & 0x8000800080008000ull;
+}
+inline uint32_t utf16_pack_ascii(uint64_t w) {
+  w = (w | (w >> 8))  & 0x0000FFFF0000FFFFull;
+  w = (w | (w >> 16)) & 0x00000000FFFFFFFFull;
+  return (uint32_t)w;
+}
+// Four lanes that are all >= 0x800 and not surrogates: 12 bytes
+inline void utf16_put_wide4(char* o, uint64_t w) {
+  uint32_t u0 = (uint16_t)w, u1 = (uint16_t)(w >> 16), u2 = (uint16_t)(w >> 32), u3 = (uint16_t)(w >> 48);
+  uint8_t b[12] = {
+    (uint8_t)(0xE0 | (u0 >> 12)), (uint8_t)(0x80 | ((u0 >> 6) & 0x3F)), (uint8_t)(0x80 | (u0 & 0x3F)),
+    (uint8_t)(0xE0 | (u1 >> 12)), (uint8_t)(0x80 | ((u1 >> 6) & 0x3F)), (uint8_t)(0x80 | (u1 & 0x3F)),
+    (uint8_t)(0xE0 | (u2 >> 12)), (uint8_t)(0x80 | ((u2 >> 6) & 0x3F)), (uint8_t)(0x80 | (u2 & 0x3F)),
+    (uint8_t)(0xE0 | (u3 >> 12)), (uint8_t)(0x80 | ((u3 >> 6) & 0x3F)), (uint8_t)(0x80 | (u3 & 0x3F)),
+  };
+  memcpy(o, b, sizeof(b));
+}
+#endif
+
+// `bytes` of UTF-16 code units in the given byte order, no BOM. Unpaired
+// surrogates become U+FFFD. With UTF_SWAR, all-ASCII, all-three-byte and
+// surrogate-free runs of 8 units take a 64-bit fast path.
+inline size_t utf16_to_utf8(const uint8_t* src, size_t bytes, bool little_endian, char* out, size_t cap) {
+  size_t i = 0, pos = 0;
+
+  while (i + 1 < bytes) {
+#if UTF_SWAR
+    if (i + 16 <= bytes && pos + 8 <= cap) {
+      uint64_t a, b;
+      memcpy(&a, src + i, 8);
+      memcpy(&b, src + i + 8, 8);
+      if (!little_endian) {
+        a = utf16_swap_lanes(a);
+        b = utf16_swap_lanes(b);
+      }
+
+      if (!utf16_has_zero(a) && !utf16_has_zero(b)) {
+        if (((a | b) & 0xFF80FF80FF80FF80ull) == 0) {
+          uint32_t lo = utf16_pack_ascii(a), hi = utf16_pack_ascii(b);
+          memcpy(out + pos, &lo, 4);
+          memcpy(out + pos + 4, &hi, 4);
+          i   += 16;
+          pos += 8;
+          continue;
+        }
+
+        // A lane is a surrogate when (unit & 0xF800) == 0xD800
+        const uint64_t sur = 0xD800D800D800D800ull;
+        bool surrogate = utf16_has_zero((a & 0xF800F800F800F800ull) ^ sur) ||
+                         utf16_has_zero((b & 0xF800F800F800F800ull) ^ sur);
+        if (!surrogate && pos + 24 <= cap) {
+          const uint64_t wide = 0xF800F800F800F800ull;
+          char* o = out + pos;
+          if (!utf16_has_zero(a & wide) && !utf16_has_zero(b & wide)) {
+            // All >= 0x800 (kana, kanji, hangul): three bytes each
+            utf16_put_wide4(o, a);
+            utf16_put_wide4(o + 12, b);
+            o += 24;
+          } else {
+            uint64_t lanes[2] = { a, b };
+            for (uint64_t w : lanes) {
+              for (int k = 0; k < 4; k++, w >>= 16) {
+                uint32_t u = (uint16_t)w;
+                if (u < 0x80) {
+                  *o++ = (char)u;
+                } else if (u < 0x800) {
+                  o[0] = (char)(0xC0 | (u >> 6));
+                  o[1] = (char)(0x80 | (u & 0x3F));
+                  o += 2;
+                } else {
+                  o[0] = (char)(0xE0 | (u >> 12));
+                  o[1] = (char)(0x80 | ((u >> 6) & 0x3F));
+                  o[2] = (char)(0x80 | (u & 0x3F));
+                  o += 3;
+                }
+              }
+            }
+          }
+          pos = o - out;
+          i  += 16;
+          continue;
+        }
+      }
+    }
+#endif
+
+    uint32_t u = little_endian ? (src[i + 1] << 8 | src[i]) : (src[i] << 8 | src[i + 1]);
+    i += 2;
+    if (u == 0) break;
+
+    uint32_t cp = u;
+    if (u >= 0xD800 && u < 0xE000) {
+      cp = 0xFFFD;
+      if (u < 0xDC00 && i + 1 < bytes) {
+        uint32_t lo = little_endian ? (src[i + 1] << 8 | src[i]) : (src[i] << 8 | src[i + 1]);
+        if (lo >= 0xDC00 && lo < 0xE000) {
+          cp = 0x10000 + ((u - 0xD800) << 10) + (lo - 0xDC00);
+          i += 2;
+        }
+      }
+    }
+
+    size_t next = utf8_put(out, pos, cap, cp);
+    if (next == pos) break;
+    pos = next;
+  }
+  return pos;
+}
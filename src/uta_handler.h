@@ -2,21 +2,19 @@
 
 #include "music.h"
 #include "StaticBg.h"
+#include "uta_Library.h"
 
 DisplayManager  display;
 AudioManager    audio;
 
-uint8_t current_dir_index   = 0;
-String  current_directory   = DIRECTORIES[current_dir_index];
+uint32_t current_album      = 0;
+String  current_directory;
 float   current_volume      = 0.2f;
 uint8_t current_brightness  = 50;
 bool    screen_off          = false;
 
 constexpr uint16_t PROGRESS_UPDATE_INTERVAL_MS = 1000;
 
-FsFile dir;
-NamePrinter name_printer(audio.source);
-
 uint16_t    last_progress_update_ms = 0;
 float       last_reported_time_s = -1.0f;
 
@@ -50,71 +48,67 @@ void draw_bar(const char* label, int percent) {
     Serial.println("]");
 }
 
-void load_directory(const String& path) {
-    audio.player.stop();
-    Serial.printf("[INFO] Loading directory: %s\n", path.c_str());
-    current_directory = path;
-
-    name_printer.flush();
-    audio.source.clear();
+void load_album(uint32_t index) {
+    audio.stop();
+    audio.save_meta_cache();
+    audio.tracks.clear();
 
-    dir = sd.open(path.c_str(), O_READ);
-    if (!dir) {
-        Serial.println("[ERROR] Failed to open directory");
+    if (index >= library.album_count()) {
+        Serial.println("[ERROR] No albums in library");
+        current_directory = "";
         return;
     }
 
-    name_printer.setPrefix(path.c_str());
-    dir.ls(&name_printer, LS_R);
-    Serial.println(dir.curPosition());
-    dir.close();
+    current_album     = index;
+    current_directory = library.album_path(index);
+    Serial.printf("[INFO] Loading album: %s\n", current_directory.c_str());
+
+    uint32_t count = library.queue_album(index, audio.tracks);
+    Serial.printf("[INFO] %lu tracks queued\n", count);
 }
 
 void load_next_directory() {
-    current_dir_index = (current_dir_index + 1) % (sizeof(DIRECTORIES) / sizeof(DIRECTORIES[0]));
-    load_directory(DIRECTORIES[current_dir_index]);
+    if (library.album_count() == 0) return;
+    load_album((current_album + 1) % library.album_count());
 
     Serial.println();
     Serial.println(F( "╔══════════════════ FOLDER CHANGED ══════════════════╗"));
     Serial.printf(    "║  → Now Playing From: %-30s ║\n", current_directory.c_str());
     Serial.println(F( "╚════════════════════════════════════════════════════╝"));
 
-    sd.ls(current_directory.c_str(), LS_R | LS_SIZE);
+    library.print_album(current_album);
 
-    if (!audio.player.begin()) {
+    if (!audio.start()) {
         Serial.println(F("Failed to initialize player → please skip to next folder"));
     }
 }
 
 void load_previous_directory() {
-    current_dir_index = (current_dir_index == 0)
-        ? (sizeof(DIRECTORIES) / sizeof(DIRECTORIES[0])) - 1
-        : current_dir_index - 1;
-
-    load_directory(DIRECTORIES[current_dir_index]);
+    if (library.album_count() == 0) return;
+    load_album(current_album == 0 ? library.album_count() - 1 : current_album - 1);
 
     Serial.println();
     Serial.println(F( "╔══════════════════ FOLDER CHANGED ══════════════════╗"));
     Serial.printf(    "║  ← Now Playing From: %-30s ║\n", current_directory.c_str());
     Serial.println(F( "╚════════════════════════════════════════════════════╝"));
 
-    sd.ls(current_directory.c_str(), LS_R | LS_SIZE);
+    library.print_album(current_album);
 
-    if (!audio.player.begin()) {
+    if (!audio.start()) {
         Serial.println(F("Failed to initialize player → please skip to next folder"));
     }
 }
 
 void volume_up(){
     current_volume = min(1.0f, current_volume + 0.05f);
-    audio.player.setVolume(current_volume);
+    audio.set_volume(current_volume);
     display.show_volume((int)(current_volume * 100));
     Serial.printf("Volume Up → %d%%\n", (int)(current_volume * 100));
 }
 
 void volume_down(){
     current_volume = max(0.0f, current_volume - 0.05f);
-    audio.player.setVolume(current_volume);
+    audio.set_volume(current_volume);
     display.show_volume((int)(current_volume * 100));
     Serial.printf("Volume Down → %d%%\n", (int)(current_volume * 100));
 }
@@ -135,13 +129,13 @@ void brightness_down(){
 }
 
 void audio_toggle(){
-    if (audio.player.isActive()) {
-        audio.player.stop();
+    if (audio.is_active()) {
+        audio.stop();
         Serial.println(F( "╔══════════════════ PLAYER ═════════════════╗\n"
                           "║                   STOPPED                 ║\n"
                           "╚═══════════════════════════════════════════╝"));
     } else {
-        audio.player.play();
+        audio.play();
         Serial.println(F( "╔══════════════════ PLAYER ═════════════════╗\n"
                           "║               ▶ NOW PLAYING               ║\n"
                           "╚═══════════════════════════════════════════╝"));
@@ -149,28 +143,80 @@ void audio_toggle(){
 }
 
 void audio_next(){
-    audio.player.next();
+    audio.next();
     Serial.println(F( "╔══════════════════ TRACK ══════════════════╗\n"
                       "║               ▶▶ Next Track               ║\n"
                       "╚═══════════════════════════════════════════╝"));
 }
 
 void audio_previous(){
-    audio.player.previous();
+    audio.previous();
     Serial.println(F( "╔══════════════════ TRACK ══════════════════╗\n"
                       "║            ▶▶ Previous Track              ║\n"
                       "╚═══════════════════════════════════════════╝"));
 }
 
+void audio_seek(float delta){
+    if (!audio.seek_relative(delta)) {
+        Serial.println("[WARN] Seeking is not supported for this track");
+    }
+}
+
+void audio_seek_to(float fraction){
+    float duration = audio.get_audio_duration();
+    if (duration <= 0 || !audio.seek(fraction * duration)) {
+        Serial.println("[WARN] Seeking is not supported for this track");
+    }
+}
+
+void gapless_toggle(){
+    audio.set_gapless(!audio.is_gapless());
+    Serial.printf("Gapless playback → %s\n", audio.is_gapless() ? "ON" : "OFF");
+}
+
+void replaygain_cycle(){
+    auto mode = (ReplayGainMode)((audio.replaygain_mode() + 1) % REPLAYGAIN_MODES);
+    audio.set_replaygain_mode(mode);
+    Serial.printf("ReplayGain → %s\n", replaygain_mode_name(mode));
+}
+
+void resample_cycle(){
+    auto mode = (ResampleMode)((audio.resample_mode() + 1) % RESAMPLE_MODES);
+    audio.set_resample_mode(mode);
+    Serial.printf("Resampler → %s (from the next track)\n", resample_mode_name(mode));
+}
+
 void view_queue(){
     Serial.println();
     Serial.println(F( "╔══════════════════ CURRENT QUEUE ═══════════════════╗"));
     Serial.printf(    "║  Directory: %s\n", current_directory.c_str());
     Serial.println(F( "╟────────────────────────────────────────────────────╢"));
-    sd.ls(current_directory.c_str(), LS_SIZE);
+    library.print_album(current_album);
     Serial.println(F( "╚════════════════════════════════════════════════════╝"));
 }
 
+void library_rescan(){
+    Serial.println(F("╔══════════════════ LIBRARY RESCAN ══════════════════╗"));
+    if (library.start_background_rescan(ROOT)) {
+        Serial.println(F("  Scanning changed folders in the background"));
+        Serial.println(F("  Press [e] to follow progress"));
+    } else {
+        Serial.println(F("  A scan is already running"));
+    }
+    Serial.println(F("╚════════════════════════════════════════════════════╝"));
+}
+
+// Picks up an index written by the background scanner. The queue that is
+// already playing stays as it is; only the album cursor is re-resolved.
+void library_poll(){
+    if (!library.poll()) return;
+
+    int index = library.find_album(current_directory.c_str());
+    current_album = index >= 0 ? index : 0;
+    Serial.printf("[INFO] Library updated: %lu albums, %lu tracks\n",
+                  library.album_count(), library.track_count());
+}
+
 void view_root_directory(){
     Serial.println();
     Serial.println(F("╔═══════════════════ ROOT DIRECTORY ═════════════════╗"));
@@ -190,13 +236,22 @@ void view_help(){
     Serial.println(F("   [v]  View Current Queue                                      "));
     Serial.printf((  "   [V]  View Root (%s)                                          "), ROOT);
     Serial.println();
+    Serial.printf(   "   [L]  Rescan Library   (%lu albums, %lu tracks)\n", library.album_count(), library.track_count());
     Serial.println(F("  Audio Control                                                 "));
     Serial.println(F("   [>]  Next Track        [<]  Previous Track                   "));
     Serial.println(F("   [p]  Play / Stop       [+]  Volume Up    [-]  Volume Down    "));
-    Serial.printf(   "   Volume: %d%%\n                                               ", (int)(current_volume * 100));
+    Serial.println(F("   [[]  Back 10 s         []]  Forward 10 s                     "));
+    Serial.println(F("   [G]  Toggle Gapless Playback                                 "));
+    Serial.println(F("   [n]  Cycle ReplayGain (Off / Track / Album)                  "));
+    Serial.println(F("   [Q]  Cycle 48 kHz Resampler (Bypass / Fast / HQ)             "));
+    Serial.printf(   "   Volume: %d%%  |  Gapless: %s  |  ReplayGain: %s  |  Resampler: %s\n", (int)(current_volume * 100),
+                     audio.is_gapless() ? "ON" : "OFF", replaygain_mode_name(audio.replaygain_mode()),
+                     resample_mode_name(audio.resample_mode()));
     Serial.println();
     Serial.println(F("  System                                                        "));
     Serial.println(F("   [e]  Resource Monitor                                        "));
+    Serial.println(F("   [B]  SD Card Benchmark                                       "));
+    Serial.printf(   "   [M]  Switch SD Transport (%s)\n", sd_bus_name(sd_bus));
     Serial.println(F("   [x]  Restart ESP32                                           "));
     Serial.println(F("   [h]  Show this help                                          "));
     Serial.println();
@@ -253,6 +308,50 @@ void view_resources() {
     }
     Serial.println(F("╚══════════════════════════════════════════════════════════════╝\n"));
 
+    // Audio pipeline
+    Serial.println(F("╔══════════════════════════ AUDIO ═════════════════════════════╗"));
+    auto pcm = audio.pcm_stats();
+    draw_bar("PCM RING", pcm.fill / 1024, pcm.capacity / 1024, "KB");
+    Serial.printf(" Watermarks  : start %u KB | low %u KB | min fill %u KB\n",
+                  pcm.start_watermark / 1024, pcm.low_watermark / 1024, pcm.min_fill / 1024);
+    Serial.printf(" Underruns   : %lu | Low-water hits: %lu | Decoder stalls: %lu\n",
+                  pcm.underruns, pcm.low_water_hits, pcm.producer_stalls);
+    auto ra = audio.read_ahead_stats();
+    draw_bar("READ-AHEAD", audio.read_ahead_buffered() / 1024, 2 * UTA_READAHEAD_BYTES / 1024, "KB");
+    Serial.printf(" Card reads  : %lu fills (%lu contiguous) | last %lu us | waits %lu\n",
+                  ra.fills, ra.direct_fills, ra.fill_us, ra.waits);
+    auto meta = audio.meta_cache_stats();
+    draw_bar("META CACHE", meta.size, meta.capacity, "ent");
+    Serial.printf(" Cache       : %lu hits | %lu misses | %lu evictions\n",
+                  meta.hits, meta.misses, meta.evictions);
+    Serial.println(F("╚══════════════════════════════════════════════════════════════╝\n"));
+
+    // Display
+    Serial.println(F("╔══════════════════════════ DISPLAY ═══════════════════════════╗"));
+    auto scroll = display.scroll_stats();
+    Serial.printf(" Marquee     : %lu us/frame (max %lu) | %lu fps | %.1f%% busy\n",
+                  scroll.frame_us, scroll.max_frame_us, scroll.fps, scroll.busy_percent);
+    auto comp = display.compositor_stats();
+    Serial.printf(" Compositor  : %lu frames | last %lu px in %lu spans | avg %lu px (%.1f%% of screen)\n",
+                  comp.frames, comp.last_pixels, comp.last_spans,
+                  comp.frames ? (uint32_t)(comp.total_pixels / comp.frames) : 0,
+                  comp.frames ? 100.0f * comp.total_pixels / comp.frames / (MAX_IMAGE_WIDTH * MAX_IMAGE_HEIGHT) : 0.0f);
+    Serial.println(F("╚══════════════════════════════════════════════════════════════╝\n"));
+
+    // Library
+    Serial.println(F("╔══════════════════════════ LIBRARY ═══════════════════════════╗"));
+    const auto& scan = library.scan_status();
+    Serial.printf(" Index       : %lu albums | %lu tracks\n", library.album_count(), library.track_count());
+    if (scan.started_ms) {
+        draw_bar(scan.running ? "SCANNING" : "LAST SCAN", scan.albums_done, scan.albums_total, "albums");
+        Serial.printf(" Rescanned   : %lu albums | Entries: %lu | Files parsed: %lu\n",
+                      scan.albums_rescanned, scan.entries_visited, scan.files_parsed);
+        Serial.printf(" Elapsed     : %lu ms%s\n",
+                      (scan.running ? millis() : scan.finished_ms) - scan.started_ms,
+                      scan.running ? "" : (scan.ok ? "" : " (failed)"));
+    }
+    Serial.println(F("╚══════════════════════════════════════════════════════════════╝\n"));
+
     // Tasks
     Serial.println(F("╔══════════════════════════ TASKS ═════════════════════════════╗"));
     Serial.printf(" Total Running Tasks : %d\n", uxTaskGetNumberOfTasks());
@@ -279,7 +378,23 @@ void view_resources() {
     Serial.printf("\n Refreshed at %lus • Press 'e' to refresh\n\n", millis() / 1000);
 }
 
+// Playback is stopped first so the decoder is not competing for the card
+void system_benchmark(){
+    const char* path = audio.tracks.path(audio.get_file_index(audio));
+    if (!path) path = audio.tracks.path(0);
+    if (!path) {
+        Serial.println("[WARN] Nothing queued to benchmark with");
+        return;
+    }
+
+    bool was_playing = audio.is_active();
+    if (was_playing) audio.stop();
+    sdcard_benchmark(path);
+    if (was_playing) Serial.println(F("  Press [p] to resume playback"));
+}
+
 void system_reboot(){
+    audio.save_meta_cache();
     Serial.println(F("╔════════════════════ SYSTEM ════════════════════════╗"));
     Serial.println(F("              Restarting ESP32 in 3...                ")); delay(1000);
     Serial.println(F("              Restarting ESP32 in 2...                ")); delay(1000);
@@ -287,7 +402,22 @@ void system_reboot(){
     ESP.restart();
 }
 
+// Cycles SPI → SDMMC 1-bit → SDMMC 4-bit and restarts onto it. A card that
+// has been in SPI mode only accepts SD mode again after a power cycle.
+void system_sd_bus(){
+    uint8_t next = sd_boot.requested_bus == SD_BUS_SPI        ? SD_BUS_SDMMC_1BIT
+                 : sd_boot.requested_bus == SD_BUS_SDMMC_1BIT ? SD_BUS_SDMMC_4BIT
+                 :                                              SD_BUS_SPI;
+    sdcard_request_bus(next);
+    Serial.printf("SD transport → %s (now %s)\n", sd_bus_name(next), sd_bus_name(sd_bus));
+    if (sd_bus == SD_BUS_SPI && next != SD_BUS_SPI) {
+        Serial.println(F("  Card is in SPI mode; power cycle if SDMMC falls back"));
+    }
+    system_reboot();
+}
+
 void system_poweroff(){
+    audio.save_meta_cache();
     Serial.println(F("╔════════════════════ SYSTEM ════════════════════════╗"));
     Serial.println(F("              Shutting Down ESP32 in 3...             ")); delay(1000);
     Serial.println(F("              Shutting Down ESP32 in 2...             ")); delay(1000);
@@ -310,11 +440,14 @@ void handle_serial() {
         case 'R': load_previous_directory();  break;
         case 'v': view_queue();               break;
         case 'V': view_root_directory();      break;
+        case 'L': library_rescan();           break;
 
         ////////////////////////////////////////////////////////////////////
         //                          System Command                        //
         ////////////////////////////////////////////////////////////////////
         case 'e': view_resources();                 break;
+        case 'B': system_benchmark();               break;
+        case 'M': system_sd_bus();                  break;
         case 'x': system_reboot();                  break;
         case 'X': system_poweroff();                break;
         case 'h': case 'H': case '?': view_help();  break;
@@ -327,6 +460,11 @@ void handle_serial() {
         case 'p': audio_toggle();   break;
         case '+': volume_up();      break;
         case '-': volume_down();    break;
+        case 'G': gapless_toggle(); break;
+        case 'n': replaygain_cycle(); break;
+        case 'Q': resample_cycle();   break;
+        case '[': audio_seek(-10);  break;
+        case ']': audio_seek(10);   break;
 
         ////////////////////////////////////////////////////////////////////
         //                         Display Command                        //
@@ -347,8 +485,10 @@ constexpr uint8_t   DIRECTION_LOCK  = 10;
 constexpr uint16_t  HOLD_TIME_MS = 1000;
 
 constexpr uint16_t  SCREEN_WIDTH = 320;
+constexpr uint16_t  SCREEN_HEIGHT = 480;
 constexpr uint16_t  LEFT_ZONE_END    = SCREEN_WIDTH / 3;
 constexpr uint16_t  RIGHT_ZONE_START = (SCREEN_WIDTH * 2) / 3;
+constexpr uint16_t  SCRUB_ZONE_START = SCREEN_HEIGHT / 2;   // horizontal hold below this scrubs
 
 enum class SwipeDirection {
     None,
@@ -361,6 +501,7 @@ enum class SwipeDirection {
 bool is_touching      = false;
 bool direction_locked = false;
 bool hold_triggered   = false;
+bool scrubbing        = false;
 
 int16_t start_x = 0;
 int16_t start_y = 0;
@@ -372,8 +513,8 @@ uint16_t hold_start_time = 0;
 
 void trigger_swipe(SwipeDirection dir) {
     switch (dir) {
-        case SwipeDirection::Left:  audio.player.next();      break;
-        case SwipeDirection::Right: audio.player.previous();  break;
+        case SwipeDirection::Left:  audio.next();             break;
+        case SwipeDirection::Right: audio.previous();         break;
         case SwipeDirection::Up:    volume_up();              break;
         case SwipeDirection::Down:  volume_down();            break;
     }
@@ -399,6 +540,7 @@ void handle_touch() {
             is_touching      = true;
             direction_locked = false;
             hold_triggered   = false;
+            scrubbing        = false;
             locked_dir       = SwipeDirection::None;
         } 
         else {
@@ -428,7 +570,14 @@ void handle_touch() {
             // Hold?
             if (direction_locked && !hold_triggered) {
                 if (millis() - hold_start_time >= HOLD_TIME_MS) {
-                    trigger_swipe_hold(locked_dir);
+                    // Lower half, sideways: finger position picks the track position
+                    bool sideways = locked_dir == SwipeDirection::Left || locked_dir == SwipeDirection::Right;
+                    if (sideways && start_y >= SCRUB_ZONE_START) {
+                        scrubbing = true;
+                        Serial.println("Scrubbing: release to seek");
+                    } else {
+                        trigger_swipe_hold(locked_dir);
+                    }
                     hold_triggered = true;
                 }
             }
@@ -444,10 +593,10 @@ void handle_touch() {
             abs(dy) < TAP_THRESHOLD) {
 
             if (start_x < LEFT_ZONE_END) {
-                audio.player.previous();
+                audio.previous();
             }
             else if (start_x > RIGHT_ZONE_START) {
-                audio.player.next();
+                audio.next();
             }
             else {
                 audio_toggle();   // CENTER TAP
@@ -457,6 +606,11 @@ void handle_touch() {
         else if (direction_locked && !hold_triggered) {
             trigger_swipe(locked_dir);
         }
+        // Scrub
+        else if (scrubbing) {
+            audio_seek_to(constrain(last_x, 0, SCREEN_WIDTH) / (float)SCREEN_WIDTH);
+            scrubbing = false;
+        }
 
         is_touching = false;
     }
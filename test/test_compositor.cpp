@@ -0,0 +1,162 @@
+#include <math.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+#include "uta_Compositor.h"
+#include "uta_test.h"
+
+#define W        320
+#define H        480
+#define BUF_PX   (W * 19)
+
+static std::mt19937 rng(1);
+
+static int rnd(int n) { return (int)(rng() % (uint32_t)n); }
+
+// Random layer edits of every kind, with the marquee-style partial
+// invalidation the display uses for scrolling
+static void random_edit(Compositor& c, std::vector<uint8_t>* masks, const std::vector<uint16_t>& img) {
+  uint8_t id = rnd(COMP_MAX_LAYERS);
+  Layer l;
+  l.visible = rnd(5) != 0;
+  int op = rnd(6);
+  if (op == 0) {
+    l.kind = LAYER_FILL;
+    l.x = rnd(400) - 40; l.y = rnd(520) - 20; l.w = rnd(200); l.h = rnd(60);
+    l.color = rng();
+    c.set_layer(id, l);
+  } else if (op <= 2) {
+    int tw = rnd(1900) + 10;
+    l.kind = LAYER_MASK;
+    l.x = rnd(360) - 20; l.y = rnd(H); l.w = rnd(340); l.h = 38;
+    l.mask = masks[rnd(4)].data();
+    l.stride = l.src_w = tw;
+    l.src_x = rnd(600) - 300;
+    l.color = rng();
+    c.set_layer(id, l);
+  } else if (op == 3) {
+    l.kind = LAYER_IMAGE;
+    l.x = rnd(100); l.y = rnd(200); l.w = 300; l.h = rnd(300);
+    l.pixels = img.data();
+    l.stride = l.src_w = 300;
+    c.set_layer(id, l);
+  } else if (op == 4) {
+    Layer& e = c.edit(id);
+    if (e.kind == LAYER_MASK && e.visible) {
+      int16_t before = e.x - e.src_x;
+      e.src_x--;
+      c.invalidate(before, e.y, e.src_w + 1, e.h);
+    }
+  } else {
+    c.hide(id);
+  }
+}
+
+int main() {
+  // One-multiply blend against an exact per-channel blend
+  int worst = 0;
+  for (int t = 0; t < 200000; t++) {
+    uint16_t f = rng(), b = rng();
+    uint8_t a = rng();
+    uint16_t r = comp_blend(f, b, a);
+    const int channels[3][2] = { { 11, 31 }, { 5, 63 }, { 0, 31 } };
+    for (const auto& ch : channels) {
+      int ff = (f >> ch[0]) & ch[1], bb = (b >> ch[0]) & ch[1], rr = (r >> ch[0]) & ch[1];
+      int d = abs((int)lround(bb + (ff - bb) * (a / 255.0)) - rr);
+      if (d > worst) worst = d;
+    }
+  }
+  CHECK(worst <= 2);
+  CHECK(comp_blend(0xF800, 0x001F, 255) == 0xF800);
+  CHECK(comp_blend(0xF800, 0x001F, 0) == 0x001F);
+
+  // Pushing only dirty spans always leaves the panel equal to a full
+  // recompose, and every span is on screen and fits the buffer
+  std::vector<uint16_t> bg(W * H), panel(W * H, 0), ref(W * H), img(300 * 300);
+  std::vector<uint16_t>* target = &panel;
+  for (auto& p : bg)  p = rng();
+  for (auto& p : img) p = rng();
+  std::vector<uint8_t> masks[4];
+  for (auto& m : masks) {
+    m.resize(2000 * 38);
+    for (auto& v : m) v = rnd(4) ? 0 : rng();
+  }
+
+  static uint16_t b0[BUF_PX], b1[BUF_PX];
+  uint16_t* const bufs[2] = { b0, b1 };
+  bool spans_ok = true;
+  uint8_t half = 0;
+  const uint16_t* in_flight = nullptr;
+  auto push = [&](int16_t x, int16_t y, int16_t w, int16_t h, uint16_t* px) {
+    // Consecutive spans, across compose() calls too, never share a buffer
+    if (px == in_flight) spans_ok = false;
+    in_flight = px;
+    if (x < 0 || y < 0 || x + w > W || y + h > H || (uint32_t)w * h > BUF_PX) {
+      spans_ok = false;
+      return;
+    }
+    for (int r = 0; r < h; r++) memcpy(&(*target)[(y + r) * W + x], px + r * w, w * sizeof(uint16_t));
+  };
+
+  Compositor c(W, H);
+  c.set_background(bg.data());
+  c.invalidate_all();
+  int mismatches = 0;
+  for (int it = 0; it < 2000; it++) {
+    random_edit(c, masks, img);
+    if (rnd(3)) continue;
+
+    c.compose(bufs, BUF_PX, push, half);
+    CHECK(!c.is_dirty());
+    for (int y = 0; y < H; y += COMP_TILE_H) c.compose_rect(0, y, W, H - y < COMP_TILE_H ? H - y : COMP_TILE_H, &ref[y * W]);
+    mismatches += panel != ref;
+  }
+  CHECK(spans_ok);
+  CHECK(mismatches == 0);
+
+  c.compose(bufs, BUF_PX, push, half);
+  CompositorStats s = c.statistics();
+  CHECK(s.frames > 0);
+  printf("%u frames, %.0f pixels per frame on average (%.1f%% of the screen)\n",
+         s.frames, (double)s.total_pixels / s.frames, 100.0 * s.total_pixels / s.frames / (W * H));
+
+  // Nothing dirty, nothing pushed
+  CHECK(c.compose(bufs, BUF_PX, push, half) == 0);
+
+  // A background supplied a band at a time, as the display does when it
+  // has to decode it again, gives the same panel as the whole one
+  const int band_h = 2 * COMP_TILE_H;
+  std::vector<uint16_t> band(W * band_h);
+  Compositor whole(W, H), banded(W, H);
+  whole.set_background(bg.data());
+  whole.invalidate_all();
+  banded.invalidate_all();
+  std::fill(panel.begin(), panel.end(), 0);
+  std::fill(ref.begin(), ref.end(), 0);
+  for (int it = 0; it < 500; it++) {
+    for (int e = rnd(4) + 1; e > 0; e--) {
+      uint32_t state = rng();
+      rng.seed(state);
+      random_edit(whole, masks, img);
+      rng.seed(state);
+      random_edit(banded, masks, img);
+    }
+    target = &ref;
+    whole.compose(bufs, BUF_PX, push, half);
+    target = &panel;
+
+    for (int16_t y0; (y0 = banded.first_dirty_row()) >= 0;) {
+      int16_t rows = H - y0 < band_h ? H - y0 : band_h;
+      memcpy(band.data(), &bg[y0 * W], W * rows * sizeof(uint16_t));
+      banded.set_background(band.data(), y0, rows);
+      banded.compose(bufs, BUF_PX, push, half, y0 + rows);
+      CHECK(banded.first_dirty_row() < 0 || banded.first_dirty_row() >= y0 + rows);
+    }
+    banded.set_background(nullptr);
+    mismatches += panel != ref;
+  }
+  CHECK(spans_ok);
+  CHECK(mismatches == 0);
+
+  return uta_test_result();
+}
@@ -0,0 +1,162 @@
+#include <chrono>
+#include <random>
+#include <vector>
+#include "uta_Gain.h"
+#include "uta_test.h"
+
+// Exact floor(s * gain) on the quantised gain, saturated to the width
+static int16_t ref_s16(int16_t s, uint32_t g) {
+  if (g == GAIN_UNITY) return s;
+  g = gain_clamp(g);
+  uint8_t e = gain_exponent(g);
+  int64_t num = (int64_t)s * (g >> (1 + e)) * (1 << e);
+  int64_t q = num >= 0 ? num / 32768 : -((-num + 32767) / 32768);
+  return (int16_t)gain_saturate(q, INT16_MIN, INT16_MAX);
+}
+
+static int32_t ref_s32(int32_t s, uint32_t g, uint8_t bits) {
+  if (g == GAIN_UNITY) return s;
+  g = gain_clamp(g);
+  int64_t num = (int64_t)s * g;
+  int64_t q = num >= 0 ? num / 65536 : -((-num + 65535) / 65536);
+  int32_t hi = bits == 24 ? 0x7FFFFF : INT32_MAX;
+  return gain_saturate(q, -hi - 1, hi);
+}
+
+static ReplayGain parse(const char* const* tags, int count) {
+  ReplayGain rg;
+  for (int i = 0; i < count; i += 2) rg_parse_tag(tags[i], tags[i + 1], strlen(tags[i + 1]), rg);
+  return rg;
+}
+
+// The volume pass the kernels replaced: arduino-audio-tools' VolumeStream
+// multiplies every sample by a float factor and clips to the width
+static void float_volume(uint8_t* pcm, size_t bytes, uint8_t bits, float factor) {
+  if (bits == 16) {
+    int16_t* s = (int16_t*)pcm;
+    for (size_t i = 0; i < bytes / 2; i++) {
+      float v = s[i] * factor;
+      s[i] = v > INT16_MAX ? INT16_MAX : v < INT16_MIN ? INT16_MIN : (int16_t)v;
+    }
+  } else {
+    int32_t* s = (int32_t*)pcm;
+    float hi = bits == 24 ? 0x7FFFFF : 2147483647.0f, lo = -hi - 1;
+    for (size_t i = 0; i < bytes / 4; i++) {
+      float v = s[i] * factor;
+      s[i] = v >= hi ? (int32_t)hi : v <= lo ? (int32_t)lo : (int32_t)v;
+    }
+  }
+}
+
+int main() {
+  std::mt19937 rng(1);
+  const uint32_t gains[] = { 0, 1, 2621, 32768, GAIN_UNITY - 1, GAIN_UNITY, GAIN_UNITY + 1,
+                             100000, 2 * GAIN_UNITY, 200000, GAIN_MAX - 1, GAIN_MAX };
+
+  // Scalar kernels against the exact result, extremes included
+  long bad16 = 0, bad24 = 0, bad32 = 0;
+  std::vector<int16_t> a(4096);
+  std::vector<int32_t> b(4096);
+  for (uint32_t g : gains) {
+    for (auto& x : a) x = (int16_t)rng();
+    a[0] = INT16_MIN;
+    a[1] = INT16_MAX;
+    std::vector<int16_t> c = a;
+    gain_apply((uint8_t*)c.data(), c.size() * 2, 16, g);
+    for (size_t i = 0; i < a.size(); i++) bad16 += c[i] != ref_s16(a[i], g);
+
+    for (uint8_t bits : { 24, 32 }) {
+      for (auto& x : b) x = bits == 24 ? (int32_t)(rng() << 8) >> 8 : (int32_t)rng();
+      b[0] = bits == 24 ? -0x800000 : INT32_MIN;
+      b[1] = bits == 24 ?  0x7FFFFF : INT32_MAX;
+      std::vector<int32_t> d = b;
+      gain_apply((uint8_t*)d.data(), d.size() * 4, bits, g);
+      for (size_t i = 0; i < b.size(); i++) (bits == 24 ? bad24 : bad32) += d[i] != ref_s32(b[i], g, bits);
+    }
+  }
+  CHECK(bad16 == 0);
+  CHECK(bad24 == 0);
+  CHECK(bad32 == 0);
+
+  // gain_s16 (the PIE kernel when GAIN_PIE is set) matches the scalar one
+  // for every alignment and tail length
+  long bad_vec = 0;
+  for (uint32_t g : gains) {
+    for (size_t skip = 0; skip < 8; skip++) {
+      for (size_t n : { 0, 1, 7, 8, 9, 31, 1000 }) {
+        alignas(16) int16_t x[1024], y[1024];
+        for (size_t i = 0; i < 1024; i++) x[i] = y[i] = (int16_t)rng();
+        gain_s16(x + skip, n, g);
+        gain_scalar_s16(y + skip, n, g);
+        bad_vec += memcmp(x, y, sizeof(x)) != 0;
+      }
+    }
+  }
+  CHECK(bad_vec == 0);
+
+  // REPLAYGAIN_* wins over R128_* in either order
+  const char* r128_first[] = { "R128_TRACK_GAIN", "-1280", "REPLAYGAIN_TRACK_GAIN", "-6.20 dB" };
+  const char* rg_first[]   = { "REPLAYGAIN_TRACK_GAIN", "-6.20 dB", "R128_TRACK_GAIN", "-1280" };
+  CHECK(parse(r128_first, 4).track_cdb == -620);
+  CHECK(parse(rg_first, 4).track_cdb == -620);
+
+  // R128 is Q7.8 dB relative to -23 LUFS: 256 = +1 dB, +5 dB to ReplayGain
+  const char* r128[] = { "R128_ALBUM_GAIN", "256", "REPLAYGAIN_ALBUM_PEAK", "0.8" };
+  ReplayGain rg = parse(r128, 4);
+  CHECK(rg.flags == RG_HAS_ALBUM);
+  CHECK(rg.album_cdb == 600);
+  CHECK(rg.album_peak == rg_peak_q14(0.8f));
+
+  // Missing track gain falls back to the album gain; the peak caps it
+  uint32_t capped = (uint32_t)(((uint64_t)GAIN_UNITY * RG_PEAK_UNITY) / rg.album_peak);
+  CHECK(capped < gain_from_db(6.0f));
+  CHECK(rg_gain(rg, REPLAYGAIN_TRACK) == capped);
+  CHECK(rg_gain(rg, REPLAYGAIN_ALBUM, -600) == gain_from_db(0.0f));
+  CHECK(rg_gain(rg, REPLAYGAIN_OFF) == GAIN_UNITY);
+  CHECK(rg_gain(ReplayGain{}, REPLAYGAIN_ALBUM) == GAIN_UNITY);
+
+  const char* junk[] = { "REPLAYGAIN_TRACK_GAIN", "loud", "REPLAYGAIN_ALBUM_GAIN", "+900 dB" };
+  rg = parse(junk, 4);
+  CHECK(!(rg.flags & RG_HAS_TRACK));
+  CHECK(rg.album_cdb == RG_LIMIT_CDB);
+
+  // A ramp moves monotonically, keeps channels together and ends on target
+  OutputGain og;
+  og.jump(GAIN_UNITY);
+  og.ramp_to(2621);
+  std::vector<int16_t> r(2 * 2 * GAIN_RAMP_FRAMES, 10000);
+  og.process((uint8_t*)r.data(), r.size() * 2, 16, 2);
+  bool monotonic = true;
+  for (size_t i = 2; i < r.size(); i += 2) {
+    if (r[i] > r[i - 2] || r[i] != r[i + 1]) monotonic = false;
+  }
+  CHECK(monotonic);
+  CHECK(og.gain() == 2621);
+  CHECK(r.back() == ref_s16(10000, 2621));
+
+  // Cost per 1024 samples at -6 dB, against the float volume pass
+  for (uint8_t bits : { 16, 24, 32 }) {
+    size_t width = bits == 16 ? 2 : 4;
+    std::vector<uint8_t> pcm(1024 * width);
+    std::mt19937 fill(bits);
+    for (auto& b : pcm) b = fill();
+    if (bits == 24) {
+      for (size_t i = 0; i < pcm.size(); i += 4) pcm[i + 3] = (pcm[i + 2] & 0x80) ? 0xFF : 0;
+    }
+    const int rounds = 20000;
+    auto time = [&](auto kernel) {
+      auto t0 = std::chrono::steady_clock::now();
+      for (int r = 0; r < rounds; r++) {
+        kernel();
+        asm volatile("" : : "r"(pcm.data()) : "memory");
+      }
+      return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count() / rounds;
+    };
+    uint32_t g = gain_from_db(-6.0f);
+    double fixed = time([&] { gain_apply(pcm.data(), pcm.size(), bits, g); });
+    double flt   = time([&] { float_volume(pcm.data(), pcm.size(), bits, 0.501f); });
+    printf("%2u-bit: %5.0f ns fixed, %5.0f ns float per 1024 samples\n", bits, fixed, flt);
+  }
+
+  return uta_test_result();
+}
@@ -0,0 +1,105 @@
+#include "uta_MetaCache.h"
+#include "uta_test.h"
+
+#include <vector>
+
+static void fill(MetaCacheEntry* e, uint32_t n) {
+  e->total_samples = 1000000ull * n + 7;
+  e->duration_ms   = 1000 * n + 1;
+  e->audio_offset  = 4096 + n;
+  e->stream_start  = 300 + n;
+  e->flags         = META_CACHE_HAS_TOC | META_CACHE_ART_PNG | META_CACHE_RG_TRACK | META_CACHE_RG_ALBUM;
+  e->format        = (uint8_t)(1 + n % 3);
+  e->stream_bytes  = 5000000 + n;
+  e->file_size     = 6000000 + n;
+  e->file_modified = 0x5A215C00u + n;
+  e->art_offset    = 300 + n;
+  e->art_length    = 20000 + n;
+  e->rg_track_cdb  = (int16_t)(-650 - n);
+  e->rg_album_cdb  = (int16_t)(-700 + n);
+  e->rg_track_peak = (uint16_t)(15000 + n);
+  e->rg_album_peak = (uint16_t)(16000 + n);
+  for (int i = 0; i < META_CACHE_TOC_LEN; i++) e->toc[i] = (uint8_t)(i * 2 + n);
+  char buf[32];
+  snprintf(buf, sizeof(buf), "title %u", n);
+  e->set_title(buf);
+  snprintf(buf, sizeof(buf), "artist %u", n);
+  e->set_artist(buf);
+  snprintf(buf, sizeof(buf), "album %u", n);
+  e->set_album(buf);
+}
+
+// Every payload field, i.e. everything but the links
+static bool same_payload(const MetaCacheEntry& a, const MetaCacheEntry& b) {
+  MetaCacheEntry x = a, y = b;
+  x.prev = y.prev = x.next = y.next = x.chain = y.chain = 0;
+  return memcmp(&x, &y, sizeof(x)) == 0;
+}
+
+int main() {
+  const uint16_t cap = 32;
+  static MetaCacheEntry store_a[cap], store_b[cap];
+  static uint16_t heads_a[32], heads_b[32];
+
+  MetaCache a, b;
+  CHECK(a.begin(store_a, cap, heads_a, 32));
+  CHECK(b.begin(store_b, cap, heads_b, 32));
+
+  // Memset first so padding compares equal after the round trip
+  static MetaCacheEntry expect[cap];
+  memset(expect, 0, sizeof(expect));
+  for (uint32_t n = 0; n < cap; n++) {
+    MetaCacheEntry* e = a.insert(1000 + n);
+    fill(e, n);
+    expect[n] = *e;
+  }
+  a.find(1000);   // make the first one most recent
+
+  std::vector<uint8_t> file;
+  CHECK(a.save([&](const void* p, size_t len) {
+    file.insert(file.end(), (const uint8_t*)p, (const uint8_t*)p + len);
+    return true;
+  }));
+
+  size_t at = 0;
+  CHECK(b.load([&](void* p, size_t len) {
+    if (at + len > file.size()) return false;
+    memcpy(p, file.data() + at, len);
+    at += len;
+    return true;
+  }));
+  CHECK(at == file.size());
+  CHECK(b.size() == cap);
+
+  // Recency survives: 1000 was touched last before saving, so the first
+  // insert after loading evicts 1001
+  b.insert(5000);
+  CHECK(b.find(1001) == nullptr);
+
+  for (uint32_t n = 0; n < cap; n++) {
+    if (n == 1) continue;
+    const MetaCacheEntry* e = b.find(1000 + n);
+    CHECK(e != nullptr);
+    if (e) CHECK(same_payload(*e, expect[n]));
+  }
+
+  // A retagged or replaced file misses
+  CHECK(b.find(1002, 6000002, 0x5A215C02u) != nullptr);
+  CHECK(b.find(1002, 6000003, 0x5A215C02u) == nullptr);
+  CHECK(b.find(1002, 6000002, 0x5A215C03u) == nullptr);
+  uint32_t misses = b.misses;
+  b.find(1003, 1, 1);
+  CHECK(b.misses == misses + 1);
+
+  // A file from another version is refused
+  file[4] ^= 1;
+  at = 0;
+  CHECK(!b.load([&](void* p, size_t len) {
+    if (at + len > file.size()) return false;
+    memcpy(p, file.data() + at, len);
+    at += len;
+    return true;
+  }));
+
+  return uta_test_result();
+}
@@ -0,0 +1,179 @@
+#include <map>
+#include <string>
+#include "uta_MetaParser.h"
+#include "uta_test.h"
+#include "uta_test_data.h"
+
+static uint8_t window_buf[16384];
+
+class MapSink : public MetaSink {
+public:
+  void on_tag(const char* key, const char* value, size_t len) override {
+    tags[key] = std::string(value, len);
+  }
+  std::map<std::string, std::string> tags;
+};
+
+static Bytes le_string(const char* s) {
+  Bytes out;
+  put_le(out, strlen(s), 4);
+  put_str(out, s);
+  return out;
+}
+
+static Bytes text(uint8_t encoding, const Bytes& payload) {
+  Bytes out(1, encoding);
+  out.insert(out.end(), payload.begin(), payload.end());
+  return out;
+}
+
+static Bytes str(const char* s) {
+  Bytes out;
+  put_str(out, s);
+  return out;
+}
+
+int main() {
+  // FLAC: Vorbis comments with mixed-case keys, a back cover before the
+  // front cover, all in one window read
+  {
+    Bytes comments = le_string("test vendor");
+    put_le(comments, 3, 4);
+    Bytes c1 = le_string("Title=Flac Title"), c2 = le_string("ARTIST=Flac Artist"),
+          c3 = le_string("replaygain_track_gain=-3.50 dB");
+    comments = concat(concat(concat(comments, c1), c2), c3);
+
+    auto picture = [](uint32_t type, const char* mime, uint32_t length) {
+      Bytes p;
+      put_be(p, type, 4);
+      put_be(p, strlen(mime), 4);
+      put_str(p, mime);
+      put_be(p, 4, 4);
+      put_str(p, "desc");
+      p.resize(p.size() + 16, 0);           // width, height, depth, colours
+      put_be(p, length, 4);
+      p.resize(p.size() + length, 0x55);
+      return p;
+    };
+    Bytes back  = picture(4, "image/jpeg", 100);
+    Bytes front = picture(3, "image/PNG", 200);
+    Bytes metadata = concat(concat(flac_block(4, comments, false), flac_block(6, back, false)),
+                            flac_block(6, front, true));
+    Bytes flac = flac_stream(4, 600, metadata);
+
+    MemReader  reader(flac);
+    MetaWindow window(reader, window_buf, sizeof(window_buf));
+    MapSink    sink;
+    MetaResult res;
+    CHECK(meta_parse_flac(window, sink, res));
+    CHECK(sink.tags["TITLE"] == "Flac Title");
+    CHECK(sink.tags["ARTIST"] == "Flac Artist");
+    CHECK(sink.tags["REPLAYGAIN_TRACK_GAIN"] == "-3.50 dB");
+    CHECK(res.sample_rate == TEST_RATE);
+    CHECK(res.channels == 2);
+    CHECK(res.bits == 16);
+    CHECK(res.total_samples == 4ull * TEST_FLAC_BLOCK);
+    CHECK(res.audio_offset == flac.size() - 4 * 600);
+    CHECK(res.picture.format == META_PICTURE_PNG);
+    CHECK(res.picture.type == 3);
+    CHECK(res.picture.length == 200);
+    CHECK(flac[res.picture.offset] == 0x55 && flac[res.picture.offset - 1] == 200);
+    CHECK(window.reads() == 1);
+  }
+
+  // MP3: ID3v2.4 text in Latin-1, UTF-16 with BOM and UTF-8, a TXXX pair
+  // and an APIC; the audio starts after the tag
+  {
+    Bytes utf16 = { 0xFF, 0xFE, 'A', 0, 'r', 0, 't', 0, 0x3C, 0xD8, 0xB5, 0xDF };   // "Art" U+1F3B5
+    Bytes latin = { 'A', 'l', 'b', 0xE9 };
+    Bytes frames = concat(concat(concat(
+        id3_frame("TIT2", text(3, str("Mp3 Title"))),
+        id3_frame("TPE1", text(1, utf16))),
+        id3_frame("TALB", text(0, latin))),
+        id3_frame("TXXX", text(0, concat(str("REPLAYGAIN_ALBUM_GAIN"), concat(Bytes(1, 0), str("+1.25 dB"))))));
+    Bytes apic = text(0, concat(str("image/jpeg"), Bytes{ 0, 3, 0 }));
+    apic.resize(apic.size() + 500, 0xAB);
+    frames = concat(frames, id3_frame("APIC", apic));
+
+    Bytes mp3 = concat(id3_tag(64, frames), Bytes(1000, 0));
+    MemReader  reader(mp3);
+    MetaWindow window(reader, window_buf, sizeof(window_buf));
+    MapSink    sink;
+    MetaResult res;
+    CHECK(meta_parse_mp3(window, sink, res));
+    CHECK(sink.tags["TITLE"] == "Mp3 Title");
+    CHECK(sink.tags["ARTIST"] == "Art\xF0\x9F\x8E\xB5");
+    CHECK(sink.tags["ALBUM"] == "Alb\xC3\xA9");
+    CHECK(sink.tags["REPLAYGAIN_ALBUM_GAIN"] == "+1.25 dB");
+    CHECK(res.audio_offset == mp3.size() - 1000);
+    CHECK(res.picture.format == META_PICTURE_JPEG);
+    CHECK(res.picture.length == 500);
+    CHECK(mp3[res.picture.offset] == 0xAB && mp3[res.picture.offset - 1] == 0);
+  }
+
+  // MP3 without ID3v2: the ID3v1 tag at the end, trailing spaces cut
+  {
+    Bytes mp3(2000, 0);
+    Bytes v1 = str("TAG");
+    const char* fields[3] = { "V1 Title", "V1 Artist", "V1 Album" };
+    for (const char* f : fields) {
+      Bytes field = str(f);
+      field.resize(30, ' ');
+      v1 = concat(v1, field);
+    }
+    v1.resize(128, 0);
+    mp3 = concat(mp3, v1);
+
+    MemReader  reader(mp3);
+    MetaWindow window(reader, window_buf, sizeof(window_buf));
+    MapSink    sink;
+    MetaResult res;
+    CHECK(meta_parse_mp3(window, sink, res));
+    CHECK(sink.tags["TITLE"] == "V1 Title");
+    CHECK(sink.tags["ALBUM"] == "V1 Album");
+    CHECK(res.audio_offset == 0);
+  }
+
+  // WAV: LIST/INFO before the data chunk
+  {
+    Bytes wav = wav_stream(100);
+    Bytes info = str("INFO");
+    Bytes nam = str("INAM"), art = str("IART");
+    put_le(nam, 7, 4);
+    put_str(nam, "Wav Ti");
+    nam.push_back(0);
+    nam.push_back(0);                        // pad to even
+    put_le(art, 4, 4);
+    put_str(art, "Who");
+    art.push_back(0);
+    info = concat(concat(info, nam), art);
+    Bytes list = str("LIST");
+    put_le(list, info.size(), 4);
+    list = concat(list, info);
+    wav.insert(wav.begin() + 36, list.begin(), list.end());
+
+    MemReader  reader(wav);
+    MetaWindow window(reader, window_buf, sizeof(window_buf));
+    MapSink    sink;
+    MetaResult res;
+    CHECK(meta_parse_riff(window, sink, res));
+    CHECK(sink.tags["TITLE"] == "Wav Ti");
+    CHECK(sink.tags["ARTIST"] == "Who");
+    CHECK(res.audio_offset == 44 + list.size());
+    CHECK(res.total_samples == 100);
+    CHECK(res.sample_rate == TEST_RATE);
+  }
+
+  // Truncated headers fail cleanly
+  {
+    Bytes flac = flac_stream(1, 100);
+    flac.resize(20);
+    MemReader  reader(flac);
+    MetaWindow window(reader, window_buf, sizeof(window_buf));
+    MapSink    sink;
+    MetaResult res;
+    CHECK(!meta_parse_flac(window, sink, res));
+  }
+
+  return uta_test_result();
+}
@@ -0,0 +1,411 @@
+#include <chrono>
+#include <map>
+#include <string>
+#include "uta_MetaParser.h"
+#include "uta_test.h"
+#include "uta_test_data.h"
+
+// Windowed metadata parser against the per-field FsFile reads it replaced,
+// over a generated corpus of tagged files. Pass a directory to also write
+// the corpus there, e.g. to copy it to a card.
+
+#define BENCH_SECTOR 512
+
+static uint8_t window_buf[16384];
+
+class MapSink : public MetaSink {
+public:
+  void on_tag(const char* key, const char* value, size_t len) override {
+    tags[key] = std::string(value, len);
+  }
+  std::map<std::string, std::string> tags;
+};
+
+// Card traffic of the windowed parser: every read_at() is one multi-block read
+class CountingReader : public MetaReader {
+public:
+  explicit CountingReader(MetaReader& inner) : inner(inner) {}
+
+  size_t read_at(uint64_t offset, uint8_t* dst, size_t len) override {
+    calls++;
+    sectors += (offset + len + BENCH_SECTOR - 1) / BENCH_SECTOR - offset / BENCH_SECTOR;
+    return inner.read_at(offset, dst, len);
+  }
+  uint64_t size() override { return inner.size(); }
+
+  uint32_t calls = 0, sectors = 0;
+
+private:
+  MetaReader& inner;
+};
+
+// FsFile as the old parser used it: reads go through SdFat's one-sector
+// cache, so every read that leaves the cached sector is a single-block
+// card read
+class FieldFile {
+public:
+  explicit FieldFile(MetaReader& reader) : reader(reader), file_size(reader.size()) {}
+
+  size_t read(void* dst, size_t len) {
+    calls++;
+    if (pos >= file_size) return 0;
+    if (pos + len > file_size) len = file_size - pos;
+    for (uint64_t s = pos / BENCH_SECTOR; s <= (pos + len - 1) / BENCH_SECTOR; s++) {
+      if (s != cached) {
+        cached = s;
+        sectors++;
+      }
+    }
+    len = reader.read_at(pos, (uint8_t*)dst, len);
+    pos += len;
+    return len;
+  }
+
+  bool seek(uint64_t p) {
+    pos = p;
+    return p <= file_size;
+  }
+  uint64_t position() const { return pos; }
+  uint64_t size() const { return file_size; }
+
+  uint32_t calls = 0, sectors = 0;
+
+private:
+  MetaReader& reader;
+  uint64_t    file_size;
+  uint64_t    pos    = 0;
+  uint64_t    cached = UINT64_MAX;
+};
+
+// The old get_flac_metadata / get_vorbis_data, minus the Arduino Strings
+static bool field_parse_flac(FieldFile& file, MapSink& sink) {
+  char sig[4];
+  if (file.read(sig, 4) != 4 || strncmp(sig, "fLaC", 4) != 0) return false;
+  bool last = false;
+  while (!last) {
+    uint8_t h[4];
+    if (file.read(h, 4) != 4) break;
+    last = h[0] & 0x80;
+    uint32_t size = (h[1] << 16) | (h[2] << 8) | h[3];
+    if ((h[0] & 0x7F) == 0) {
+      uint8_t info[34];
+      if (file.read(info, 34) != 34) return false;
+    } else if ((h[0] & 0x7F) == 4) {
+      uint32_t vendor, count;
+      if (file.read(&vendor, 4) != 4) return false;
+      file.seek(file.position() + vendor);
+      if (file.read(&count, 4) != 4) return false;
+      for (uint32_t i = 0; i < count; i++) {
+        uint32_t len;
+        if (file.read(&len, 4) != 4) break;
+        char buf[257];
+        size_t n = len < 256 ? len : 256;
+        if (file.read(buf, n) != n) break;
+        buf[n] = 0;
+        const char* keys[3] = { "TITLE=", "ARTIST=", "ALBUM=" };
+        for (const char* k : keys) {
+          if (strncmp(buf, k, strlen(k)) == 0) sink.tags[std::string(k, strlen(k) - 1)] = buf + strlen(k);
+        }
+        file.seek(file.position() + len - n);
+      }
+      return true;
+    } else {
+      file.seek(file.position() + size);
+    }
+  }
+  return false;
+}
+
+// The old get_mp3_metadata: one read per frame header field and body,
+// then the 1 KB read for the bitrate estimate
+static bool field_parse_mp3(FieldFile& file, MapSink& sink) {
+  uint8_t h[10];
+  if (file.read(h, 10) != 10 || memcmp(h, "ID3", 3)) return false;
+  uint32_t tag = ((h[6] & 0x7F) << 21) | ((h[7] & 0x7F) << 14) | ((h[8] & 0x7F) << 7) | (h[9] & 0x7F);
+  uint64_t pos = 10;
+  while (pos < tag + 10 && pos + 10 < file.size()) {
+    char id[4];
+    uint8_t sz[4];
+    if (file.read(id, 4) != 4 || id[0] == 0) break;
+    file.read(sz, 4);
+    uint32_t size = ((uint32_t)sz[0] << 24) | (sz[1] << 16) | (sz[2] << 8) | sz[3];
+    file.seek(file.position() + 2);
+    if (size <= 512) {
+      uint8_t data[513];
+      file.read(data, size);
+      char out[META_TEXT_BYTES];
+      size_t n = 0;
+      if (size > 1 && data[0] == 1 && size >= 3) {
+        n = utf16_to_utf8(data + 3, size - 3, data[1] == 0xFF, out, sizeof(out));
+      } else if (size > 1 && data[0] == 0) {
+        n = latin1_to_utf8(data + 1, size - 1, out, sizeof(out));
+      } else if (size > 1) {
+        n = utf8_copy(data + 1, size - 1, out, sizeof(out));
+      }
+      if      (!strncmp(id, "TIT2", 4)) sink.tags["TITLE"]  = std::string(out, n);
+      else if (!strncmp(id, "TPE1", 4)) sink.tags["ARTIST"] = std::string(out, n);
+      else if (!strncmp(id, "TALB", 4)) sink.tags["ALBUM"]  = std::string(out, n);
+    }
+    pos += 10 + size;
+    file.seek(pos);
+  }
+  uint8_t head[1024];
+  file.seek(0);
+  file.read(head, sizeof(head));
+  return true;
+}
+
+// The old get_wav_metadata: fmt fields one by one, then every chunk and
+// LIST/INFO entry as a header read and a body read
+static bool field_parse_wav(FieldFile& file, MapSink& sink) {
+  char riff[4];
+  if (file.read(riff, 4) != 4 || strncmp(riff, "RIFF", 4)) return false;
+  file.seek(20);
+  uint16_t format, channels, bits;
+  uint32_t rate, byte_rate;
+  file.read(&format, 2);
+  file.read(&channels, 2);
+  file.read(&rate, 4);
+  file.read(&byte_rate, 4);
+  file.seek(file.position() + 2);
+  file.read(&bits, 2);
+  while (true) {
+    char id[4];
+    uint32_t size;
+    if (file.read(id, 4) != 4) break;
+    file.read(&size, 4);
+    if (!strncmp(id, "data", 4)) break;
+    if (strncmp(id, "LIST", 4)) {
+      file.seek(file.position() + size);
+      continue;
+    }
+    char type[4];
+    file.read(type, 4);
+    uint64_t end = file.position() + size - 4;
+    while (file.position() + 8 < end) {
+      char sub[4];
+      uint32_t len;
+      file.read(sub, 4);
+      file.read(&len, 4);
+      std::string val(len, 0);
+      file.read(&val[0], len);
+      val.resize(strlen(val.c_str()));
+      if      (!strncmp(sub, "INAM", 4)) sink.tags["TITLE"]  = val;
+      else if (!strncmp(sub, "IART", 4)) sink.tags["ARTIST"] = val;
+      else if (!strncmp(sub, "IPRD", 4)) sink.tags["ALBUM"]  = val;
+      if (len % 2) file.seek(file.position() + 1);
+    }
+  }
+  return true;
+}
+
+// ---- Corpus -------------------------------------------------------------
+
+static Bytes str(const char* s) {
+  Bytes out;
+  put_str(out, s);
+  return out;
+}
+
+static Bytes vorbis_comments(const std::map<std::string, std::string>& tags) {
+  Bytes out;
+  put_le(out, 20, 4);
+  put_str(out, "reference libFLAC 1");
+  out.push_back(0);
+  put_le(out, tags.size(), 4);
+  for (const auto& t : tags) {
+    std::string c = t.first + "=" + t.second;
+    put_le(out, c.size(), 4);
+    put_str(out, c.c_str());
+  }
+  return out;
+}
+
+static Bytes flac_picture(uint32_t length) {
+  Bytes p;
+  put_be(p, 3, 4);
+  put_be(p, 10, 4);
+  put_str(p, "image/jpeg");
+  put_be(p, 0, 4);
+  p.resize(p.size() + 16, 0);
+  put_be(p, length, 4);
+  for (uint32_t i = 0; i < length; i++) p.push_back((uint8_t)(i * 7));
+  return p;
+}
+
+static Bytes seektable(int points) {
+  Bytes t;
+  for (int i = 0; i < points; i++) {
+    put_be(t, (uint64_t)i * TEST_FLAC_BLOCK, 8);
+    put_be(t, (uint64_t)i * 600, 8);
+    put_be(t, TEST_FLAC_BLOCK, 2);
+  }
+  return t;
+}
+
+static const std::map<std::string, std::string> common_tags = {
+  { "TITLE", "Corpus Title" }, { "ARTIST", "Corpus Artist" }, { "ALBUM", "Corpus Album" },
+  { "ALBUMARTIST", "Corpus Artist" }, { "DATE", "2024" }, { "GENRE", "Pop" },
+  { "TRACKNUMBER", "3" }, { "TRACKTOTAL", "12" }, { "DISCNUMBER", "1" },
+  { "REPLAYGAIN_TRACK_GAIN", "-7.12 dB" }, { "REPLAYGAIN_TRACK_PEAK", "0.988525" },
+  { "REPLAYGAIN_ALBUM_GAIN", "-6.90 dB" }, { "REPLAYGAIN_ALBUM_PEAK", "1.000000" },
+  { "COMMENT", "Generated for the metadata parser benchmark" },
+};
+
+// ID3v2.3 frame: plain 32-bit size, which most taggers still write
+static Bytes id3v23_frame(const char* id, const Bytes& body) {
+  Bytes out = str(id);
+  put_be(out, body.size(), 4);
+  out.push_back(0);
+  out.push_back(0);
+  return concat(out, body);
+}
+
+static Bytes id3v23_tag(const Bytes& frames, uint32_t padding) {
+  Bytes out = { 'I', 'D', '3', 3, 0, 0 };
+  put_syncsafe(out, frames.size() + padding);
+  out = concat(out, frames);
+  out.resize(out.size() + padding, 0);
+  return out;
+}
+
+static Bytes latin1_text(const char* s) {
+  return concat(Bytes(1, 0), str(s));
+}
+
+static Bytes utf16_text(const char* s) {
+  Bytes out = { 1, 0xFF, 0xFE };
+  for (; *s; s++) {
+    out.push_back(*s);
+    out.push_back(0);
+  }
+  return out;
+}
+
+struct CorpusFile {
+  std::string name;
+  Bytes       data;
+};
+
+static std::vector<CorpusFile> make_corpus() {
+  std::vector<CorpusFile> corpus;
+  Bytes comments = flac_block(4, vorbis_comments(common_tags), false);
+  Bytes table    = flac_block(3, seektable(100), false);
+  Bytes picture  = flac_block(6, flac_picture(120 * 1024), false);
+  Bytes padding  = flac_block(1, Bytes(8192, 0), true);
+
+  corpus.push_back({ "tagged.flac", flac_stream(20, 600, concat(concat(concat(table, comments), picture), padding)) });
+  corpus.push_back({ "art_first.flac", flac_stream(20, 600, concat(concat(concat(table, picture), comments), padding)) });
+
+  Bytes frames;
+  for (const char* t : { "TIT2", "TPE1", "TALB", "TPE2", "TYER", "TRCK", "TCON" }) {
+    const char* v = !strcmp(t, "TIT2") ? "Corpus Title" : !strcmp(t, "TPE1") ? "Corpus Artist" :
+                    !strcmp(t, "TALB") ? "Corpus Album" : "x";
+    frames = concat(frames, id3v23_frame(t, latin1_text(v)));
+  }
+  for (const char* rg : { "REPLAYGAIN_TRACK_GAIN", "REPLAYGAIN_TRACK_PEAK", "REPLAYGAIN_ALBUM_GAIN",
+                          "REPLAYGAIN_ALBUM_PEAK" }) {
+    frames = concat(frames, id3v23_frame("TXXX", concat(latin1_text(rg), latin1_text("-6.50 dB"))));
+  }
+  Bytes apic = concat(latin1_text("image/jpeg"), Bytes{ 0, 3, 0 });
+  apic.resize(apic.size() + 80 * 1024, 0x5A);
+  Bytes art_frames = concat(id3v23_frame("APIC", apic), frames);
+  corpus.push_back({ "v23.mp3", concat(id3v23_tag(concat(frames, id3v23_frame("APIC", apic)), 2048), Bytes(64 * 1024, 0)) });
+  corpus.push_back({ "v23_art_first.mp3", concat(id3v23_tag(art_frames, 2048), Bytes(64 * 1024, 0)) });
+
+  Bytes wide = concat(concat(id3_frame("TIT2", utf16_text("Corpus Title")), id3_frame("TPE1", utf16_text("Corpus Artist"))),
+                      id3_frame("TALB", utf16_text("Corpus Album")));
+  corpus.push_back({ "v24_utf16.mp3", concat(id3_tag(1024, wide), Bytes(64 * 1024, 0)) });
+
+  Bytes wav = wav_stream(44100);
+  Bytes info = str("INFO");
+  for (const auto& e : { std::make_pair("INAM", "Corpus Title"), std::make_pair("IART", "Corpus Artist"),
+                         std::make_pair("IPRD", "Corpus Album"), std::make_pair("ICRD", "2024"),
+                         std::make_pair("IGNR", "Pop") }) {
+    Bytes sub = str(e.first);
+    put_le(sub, strlen(e.second) + 1, 4);
+    put_str(sub, e.second);
+    sub.push_back(0);
+    if (sub.size() % 2) sub.push_back(0);
+    info = concat(info, sub);
+  }
+  Bytes list = str("LIST");
+  put_le(list, info.size(), 4);
+  list = concat(list, info);
+  wav.insert(wav.begin() + 36, list.begin(), list.end());
+  corpus.push_back({ "info.wav", wav });
+  return corpus;
+}
+
+// ---- Benchmark ----------------------------------------------------------
+
+static bool window_parse(const std::string& name, MetaWindow& win, MapSink& sink) {
+  MetaResult res;
+  if (name.find(".flac") != std::string::npos) return meta_parse_flac(win, sink, res);
+  if (name.find(".mp3") != std::string::npos)  return meta_parse_mp3(win, sink, res);
+  return meta_parse_riff(win, sink, res);
+}
+
+static bool field_parse(const std::string& name, FieldFile& file, MapSink& sink) {
+  if (name.find(".flac") != std::string::npos) return field_parse_flac(file, sink);
+  if (name.find(".mp3") != std::string::npos)  return field_parse_mp3(file, sink);
+  return field_parse_wav(file, sink);
+}
+
+template <typename F>
+static double ns_per_call(F f) {
+  const int rounds = 2000;
+  auto t0 = std::chrono::steady_clock::now();
+  for (int r = 0; r < rounds; r++) f();
+  return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count() / rounds;
+}
+
+int main(int argc, char** argv) {
+  std::vector<CorpusFile> corpus = make_corpus();
+
+  if (argc > 1) {
+    for (const CorpusFile& f : corpus) {
+      std::string path = std::string(argv[1]) + "/" + f.name;
+      FILE* out = fopen(path.c_str(), "wb");
+      CHECK(out != nullptr);
+      if (!out) continue;
+      CHECK(fwrite(f.data.data(), 1, f.data.size(), out) == f.data.size());
+      fclose(out);
+    }
+  }
+
+  printf("%-18s %21s %21s %15s\n", "", "windowed", "per-field", "host ns");
+  printf("%-18s %10s %10s %10s %10s %7s %7s\n", "file", "reads", "sectors", "reads", "sectors", "window", "field");
+  for (const CorpusFile& f : corpus) {
+    MemReader mem(f.data);
+
+    // Both read the same title, artist and album
+    CountingReader counted(mem);
+    MetaWindow     win(counted, window_buf, sizeof(window_buf));
+    MapSink        tags;
+    CHECK(window_parse(f.name, win, tags));
+    FieldFile      file(mem);
+    MapSink        field_tags;
+    CHECK(field_parse(f.name, file, field_tags));
+    for (const char* key : { "TITLE", "ARTIST", "ALBUM" }) {
+      CHECK(tags.tags[key] == field_tags.tags[key]);
+      CHECK(!tags.tags[key].empty());
+    }
+    CHECK(counted.calls < file.calls);
+
+    double window_ns = ns_per_call([&] {
+      MetaWindow w(mem, window_buf, sizeof(window_buf));
+      MapSink    s;
+      window_parse(f.name, w, s);
+    });
+    double field_ns = ns_per_call([&] {
+      FieldFile file(mem);
+      MapSink   s;
+      field_parse(f.name, file, s);
+    });
+    printf("%-18s %10u %10u %10u %10u %7.0f %7.0f\n", f.name.c_str(), counted.calls, counted.sectors,
+           file.calls, file.sectors, window_ns, field_ns);
+  }
+
+  return uta_test_result();
+}
@@ -0,0 +1,158 @@
+#include <math.h>
+#include <random>
+#include "uta_Mp3Info.h"
+#include "uta_test.h"
+#include "uta_test_data.h"
+
+#define MP3_FRAMES  5000
+
+static uint8_t window_buf[16384];
+static uint32_t marks[1024];
+
+static const uint16_t kbps[15] = { 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320 };
+
+// MPEG-1 layer III, 44.1 kHz, joint stereo. Padded frames keep the average
+// length at the exact bitrate, as encoders do.
+static Bytes mp3_frame(uint8_t bitrate_index, uint32_t* pad_acc = nullptr) {
+  uint32_t bytes = 144 * kbps[bitrate_index] * 1000;
+  bool pad = false;
+  if (pad_acc) {
+    *pad_acc += bytes % 44100;
+    pad = *pad_acc >= 44100;
+    if (pad) *pad_acc -= 44100;
+  }
+  Bytes f = { 0xFF, 0xFB, (uint8_t)(bitrate_index << 4 | (pad ? 0x02 : 0)), 0x40 };
+  f.resize(bytes / 44100 + pad, 0);
+  return f;
+}
+
+// ID3v2 tag whose padding is full of sync words that never confirm
+static Bytes noisy_tag() {
+  Bytes tag = id3_tag(2048);
+  for (size_t i = 10; i + 4 <= tag.size(); i += 4) {
+    tag[i] = 0xFF; tag[i + 1] = 0xFB; tag[i + 2] = 0x90; tag[i + 3] = 0x00;
+  }
+  return tag;
+}
+
+struct Mp3File {
+  Bytes    data;
+  uint64_t audio_start;                  // first frame after the tag
+  std::vector<uint64_t> offsets;         // of every audio frame
+};
+
+static Mp3File mp3_file(bool vbr, bool xing) {
+  std::mt19937 rng(5);
+  const uint8_t choices[5] = { 5, 7, 9, 11, 13 };
+  Mp3File file;
+  file.data = noisy_tag();
+  file.audio_start = file.data.size();
+
+  Bytes body;
+  uint32_t pad_acc = 0;
+  for (int i = 0; i < MP3_FRAMES; i++) {
+    file.offsets.push_back(body.size());
+    Bytes f = mp3_frame(vbr ? choices[rng() % 5] : 9, &pad_acc);
+    body.insert(body.end(), f.begin(), f.end());
+  }
+
+  if (xing) {
+    Bytes x = mp3_frame(9);
+    size_t at = 36;
+    memcpy(&x[at], "Xing", 4);
+    x[at + 7] = 0x07;                    // frames, bytes, TOC
+    Bytes fields;
+    put_be(fields, MP3_FRAMES, 4);
+    put_be(fields, body.size(), 4);
+    for (int p = 0; p < MP3_TOC_ENTRIES; p++) fields.push_back((uint8_t)(p * 256 / 100));
+    memcpy(&x[at + 8], fields.data(), fields.size());
+    for (uint64_t& o : file.offsets) o += x.size();
+    file.data = concat(file.data, x);
+  }
+  for (uint64_t& o : file.offsets) o += file.audio_start;
+  file.data = concat(file.data, body);
+  return file;
+}
+
+static bool analyse(const Mp3File& file, Mp3Info& info, bool scan) {
+  MemReader  reader(file.data);
+  MetaWindow window(reader, window_buf, sizeof(window_buf));
+  if (!mp3_analyse(window, file.audio_start, info)) return false;
+  return !scan || mp3_scan(window, info, marks, 1024, [] { return true; });
+}
+
+// The TOC position for `seconds`, synced to the next frame, is the frame
+// a percent step or less away from where that time really is
+static bool toc_lands_near(const Mp3File& file, const Mp3Info& info, float seconds) {
+  MemReader  reader(file.data);
+  MetaWindow window(reader, window_buf, sizeof(window_buf));
+  uint64_t offset;
+  Mp3Frame f;
+  if (!mp3_find_frame(window, mp3_toc_offset(info, seconds), window.size(), offset, f)) return false;
+
+  size_t landed = 0;
+  while (landed < file.offsets.size() && file.offsets[landed] < offset) landed++;
+  if (landed == file.offsets.size() || file.offsets[landed] != offset) return false;
+  long want = lroundf(seconds * 44100 / 1152);
+  return labs((long)landed - want) <= MP3_FRAMES / MP3_TOC_ENTRIES;
+}
+
+int main() {
+  const float duration = MP3_FRAMES * 1152.0f / 44100;
+
+  // Constant bitrate, no header: the false syncs in the tag are skipped
+  {
+    Mp3File file = mp3_file(false, false);
+    Mp3Info info;
+    CHECK(analyse(file, info, false));
+    CHECK(info.source == MP3_SRC_CBR);
+    CHECK(info.first_frame == file.audio_start);
+    CHECK(fabsf(info.duration - duration) < 0.05f);
+    CHECK(!info.needs_scan());
+    CHECK(toc_lands_near(file, info, duration / 3));
+  }
+
+  // Xing: exact frame count, header frame excluded from the audio
+  {
+    Mp3File file = mp3_file(true, true);
+    Mp3Info info;
+    CHECK(analyse(file, info, false));
+    CHECK(info.source == MP3_SRC_XING);
+    CHECK(info.frames == MP3_FRAMES);
+    CHECK(info.first_frame == file.offsets[0]);
+    CHECK(fabsf(info.duration - duration) < 0.001f);
+    CHECK(info.has_toc);
+  }
+
+  // VBR without a header: an estimate first, exact after the scan, and a
+  // TOC that follows the real frame positions
+  {
+    Mp3File file = mp3_file(true, false);
+    Mp3Info info;
+    CHECK(analyse(file, info, false));
+    CHECK(info.needs_scan());
+
+    CHECK(analyse(file, info, true));
+    CHECK(info.source == MP3_SRC_SCAN);
+    CHECK(info.frames == MP3_FRAMES);
+    CHECK(fabsf(info.duration - duration) < 0.001f);
+    bool monotonic = true;
+    for (int p = 1; p < MP3_TOC_ENTRIES; p++) monotonic &= info.toc[p] >= info.toc[p - 1];
+    CHECK(monotonic);
+    CHECK(toc_lands_near(file, info, duration / 2));
+    CHECK(toc_lands_near(file, info, duration * 0.9f));
+  }
+
+  // A scan asked to stop gives up and leaves the estimate alone
+  {
+    Mp3File file = mp3_file(true, false);
+    Mp3Info info;
+    MemReader  reader(file.data);
+    MetaWindow window(reader, window_buf, sizeof(window_buf));
+    CHECK(mp3_analyse(window, file.audio_start, info));
+    CHECK(!mp3_scan(window, info, marks, 1024, [] { return false; }));
+    CHECK(info.needs_scan());
+  }
+
+  return uta_test_result();
+}
@@ -0,0 +1,91 @@
+#include "uta_Probe.h"
+#include "uta_test.h"
+#include "uta_test_data.h"
+
+static uint8_t window_buf[16384];
+
+class NullSink : public MetaSink {
+public:
+  void on_tag(const char*, const char*, size_t) override {}
+};
+
+static ProbeResult probe(const Bytes& data) {
+  MemReader   reader(data);
+  MetaWindow  window(reader, window_buf, sizeof(window_buf));
+  return probe_format(window);
+}
+
+static Bytes adts_frames(int count) {
+  Bytes out;
+  for (int i = 0; i < count; i++) {
+    const uint8_t h[7] = { 0xFF, 0xF1, 0x50, 0x80, 0x02, 0x1F, 0xFC };   // 16 byte frame
+    out.insert(out.end(), h, h + 7);
+    out.resize(out.size() + 9, 0xAA);
+  }
+  return out;
+}
+
+int main() {
+  Bytes flac = flac_stream(8, 600);
+  Bytes wav  = wav_stream(1000);
+  Bytes tag  = id3_tag(300);
+
+  CHECK(probe(flac).format == AUDIO_FORMAT_FLAC);
+  CHECK(probe(flac).start == 0);
+  CHECK(probe(wav).format == AUDIO_FORMAT_WAV);
+  CHECK(probe(adts_frames(5)).format == AUDIO_FORMAT_AAC);
+  CHECK(probe(concat(tag, adts_frames(5))).format == AUDIO_FORMAT_AAC);
+
+  Bytes m4a = { 0, 0, 0, 0x20, 'f', 't', 'y', 'p', 'M', '4', 'A', ' ' };
+  m4a.resize(64);
+  CHECK(probe(m4a).format == AUDIO_FORMAT_MP4);
+  CHECK(!probe_playable(AUDIO_FORMAT_MP4));
+
+  Bytes junk(5000, 0xFF);
+  CHECK(probe(junk).format == AUDIO_FORMAT_UNKNOWN);
+  Bytes huge_tag = { 'I', 'D', '3', 4, 0, 0, 0x7F, 0x7F, 0x7F, 0x7F };
+  CHECK(probe(huge_tag).format == AUDIO_FORMAT_UNKNOWN);
+
+  // FLAC and WAV behind an ID3v2 tag: the parsers and the seek have to
+  // start where the probe found the container, not at byte 0
+  {
+    Bytes tagged = concat(tag, flac);
+    ProbeResult p = probe(tagged);
+    CHECK(p.format == AUDIO_FORMAT_FLAC);
+    CHECK(p.start == tag.size());
+
+    MemReader  reader(tagged);
+    MetaWindow window(reader, window_buf, sizeof(window_buf));
+    NullSink   sink;
+    MetaResult res;
+    CHECK(!meta_parse_flac(window, sink, res));
+    CHECK(meta_parse_flac(window, sink, res, p.start));
+    CHECK(res.sample_rate == TEST_RATE);
+    CHECK(res.total_samples == 8ull * TEST_FLAC_BLOCK);
+    CHECK(res.audio_offset == p.start + 42);
+
+    SeekTarget st;
+    CHECK(flac_seek(window, 5 * TEST_FLAC_BLOCK + 10, st, p.start));
+    CHECK(st.sample == 5ull * TEST_FLAC_BLOCK);
+    CHECK(st.offset == p.start + 42 + 5 * 600);
+  }
+  {
+    Bytes tagged = concat(tag, wav);
+    ProbeResult p = probe(tagged);
+    CHECK(p.format == AUDIO_FORMAT_WAV);
+
+    MemReader  reader(tagged);
+    MetaWindow window(reader, window_buf, sizeof(window_buf));
+    NullSink   sink;
+    MetaResult res;
+    CHECK(meta_parse_riff(window, sink, res, p.start));
+    CHECK(res.audio_offset == p.start + 44);
+    CHECK(res.total_samples == 1000);
+
+    SeekTarget st;
+    CHECK(riff_seek(window, 250, st, p.start));
+    CHECK(st.offset == p.start + 44 + 250 * 4);
+  }
+
+  return uta_test_result();
+}
@@ -0,0 +1,110 @@
+#include <random>
+#include <thread>
+#include <vector>
+#include "uta_RingBuffer.h"
+#include "uta_test.h"
+
+// Decoder output for frames [from, to) of a track, each frame tagged with
+// the track and frame number, in ragged chunks through pcm_trim()
+static void decode(uint8_t track, uint32_t from, uint32_t to, uint64_t skip, uint64_t left,
+                   std::mt19937& rng, std::vector<uint32_t>& out) {
+  std::vector<uint32_t> pcm;
+  for (uint32_t f = from; f < to; f++) pcm.push_back((uint32_t)track << 24 | f);
+
+  const uint8_t* p   = (const uint8_t*)pcm.data();
+  const uint8_t* end = p + pcm.size() * 4;
+  while (p < end) {
+    size_t len = (rng() % 300 + 1) * 4;
+    if (len > (size_t)(end - p)) len = end - p;
+    const uint8_t* data = p;
+    size_t keep = pcm_trim(data, len, 4, skip, left);
+    out.insert(out.end(), (const uint32_t*)data, (const uint32_t*)(data + keep));
+    p += len;
+  }
+}
+
+int main() {
+  std::vector<uint8_t> storage(4096);
+  PcmRingBuffer ring;
+  CHECK(!ring.begin(storage.data(), 3000));    // not a power of two
+  CHECK(ring.begin(storage.data(), storage.size()));
+
+  // Single thread: wrap-around, full and empty edges
+  uint8_t in[5000], out[5000];
+  for (size_t i = 0; i < sizeof(in); i++) in[i] = (uint8_t)(i * 7);
+  CHECK(ring.write(in, 3000) == 3000);
+  CHECK(ring.read(out, 2000) == 2000);
+  CHECK(memcmp(in, out, 2000) == 0);
+  CHECK(ring.write(in + 3000, 2000) == 2000);      // wraps
+  CHECK(ring.available() == 3000);
+  CHECK(ring.free_space() == 1096);
+  CHECK(ring.write(in, 5000) == 1096);             // only what fits
+  CHECK(ring.read(out, 3000) == 3000);
+  CHECK(memcmp(in + 2000, out, 3000) == 0);
+  ring.discard();
+  CHECK(ring.available() == 0);
+  CHECK(ring.read(out, 1) == 0);
+  CHECK(ring.write_position() == ring.read_position());
+
+  // Producer and consumer threads with ragged chunk sizes: every byte
+  // arrives once, in order
+  const size_t total = 20 * 1000 * 1000;
+  CHECK(ring.begin(storage.data(), storage.size()));
+  std::thread producer([&] {
+    std::mt19937 rng(1);
+    uint8_t chunk[777];
+    for (size_t i = 0; i < total; ) {
+      size_t n = rng() % sizeof(chunk) + 1;
+      if (n > total - i) n = total - i;
+      for (size_t k = 0; k < n; k++) chunk[k] = (uint8_t)((i + k) * 31);
+      for (size_t done = 0; done < n; ) {
+        size_t w = ring.write(chunk + done, n - done);
+        if (w == 0) std::this_thread::yield();
+        done += w;
+      }
+      i += n;
+    }
+  });
+
+  std::mt19937 rng(2);
+  size_t mismatches = 0;
+  uint8_t chunk[500];
+  for (size_t j = 0; j < total; ) {
+    size_t n = ring.read(chunk, rng() % sizeof(chunk) + 1);
+    if (n == 0) std::this_thread::yield();
+    for (size_t k = 0; k < n; k++) mismatches += chunk[k] != (uint8_t)((j + k) * 31);
+    j += n;
+  }
+  producer.join();
+  CHECK(mismatches == 0);
+  CHECK(ring.available() == 0);
+
+  // Gapless: decoder padding past each track's exact length is dropped, so
+  // two tracks join frame for frame
+  {
+    std::mt19937 trim_rng(3);
+    std::vector<uint32_t> out;
+    decode(1, 0, 10000 + 1105, 0, 10000, trim_rng, out);
+    decode(2, 0, 7000 + 576, 0, 7000, trim_rng, out);
+    bool exact = out.size() == 17000;
+    for (uint32_t i = 0; exact && i < 17000; i++) {
+      exact = out[i] == (i < 10000 ? (1u << 24 | i) : (2u << 24 | (i - 10000)));
+    }
+    CHECK(exact);
+
+    // Seek: decoding resumes at a frame start before the target; the head
+    // of it is dropped and the tail still ends on the exact length
+    out.clear();
+    decode(1, 4608, 10000 + 1105, 5000 - 4608, 10000 - 5000, trim_rng, out);
+    exact = out.size() == 5000;
+    for (uint32_t i = 0; exact && i < 5000; i++) exact = out[i] == (1u << 24 | (5000 + i));
+    CHECK(exact);
+
+    // Unknown length keeps everything
+    out.clear();
+    decode(3, 0, 999, 0, UINT64_MAX, trim_rng, out);
+    CHECK(out.size() == 999);
+  }
+
+  return uta_test_result();
+}
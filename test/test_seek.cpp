@@ -0,0 +1,88 @@
+#include <random>
+#include "uta_Seek.h"
+#include "uta_test.h"
+#include "uta_test_data.h"
+
+#define FRAMES       3000
+#define FRAME_BYTES  3000     // about 9 MB, so the search cannot just read it all
+
+static uint8_t window_buf[16384];
+
+// SEEKTABLE with a point every `every` frames
+static Bytes seektable(uint32_t every) {
+  Bytes body;
+  for (uint32_t n = 0; n < FRAMES; n += every) {
+    put_be(body, (uint64_t)n * TEST_FLAC_BLOCK, 8);
+    put_be(body, (uint64_t)n * FRAME_BYTES, 8);
+    put_be(body, TEST_FLAC_BLOCK, 2);
+  }
+  put_be(body, UINT64_MAX, 8);                // placeholder point
+  put_be(body, 0, 8);
+  put_be(body, 0, 2);
+  return flac_block(3, body, true);
+}
+
+// Every target lands on the frame that holds it; returns the most window
+// reads one seek needed, or -1 after a miss
+static int check_targets(const Bytes& flac, uint64_t first_frame) {
+  std::mt19937 rng(7);
+  MemReader reader(flac);
+  uint32_t max_reads = 0;
+  for (int i = 0; i < 500; i++) {
+    uint64_t target = i == 0 ? 0 : i == 1 ? (uint64_t)FRAMES * TEST_FLAC_BLOCK - 1
+                                          : rng() % ((uint64_t)FRAMES * TEST_FLAC_BLOCK);
+    MetaWindow window(reader, window_buf, sizeof(window_buf));
+    SeekTarget st;
+    if (!flac_seek(window, target, st)) return -1;
+    if (window.reads() > max_reads) max_reads = window.reads();
+
+    uint64_t frame = target / TEST_FLAC_BLOCK;
+    if (st.sample != frame * TEST_FLAC_BLOCK) return -1;
+    if (st.offset != first_frame + frame * FRAME_BYTES) return -1;
+  }
+  return (int)max_reads;
+}
+
+int main() {
+  // Without a SEEKTABLE the bisection starts from the whole file
+  Bytes plain = flac_stream(FRAMES, FRAME_BYTES);
+  int reads = check_targets(plain, 42);
+  CHECK(reads > 0);
+  CHECK(reads <= 12);
+  printf("no seektable: at most %d window reads per seek\n", reads);
+
+  // With one it only searches between two seek points
+  Bytes table = seektable(100);
+  Bytes indexed = flac_stream(FRAMES, FRAME_BYTES, table);
+  int indexed_reads = check_targets(indexed, 42 + table.size());
+  CHECK(indexed_reads > 0);
+  CHECK(indexed_reads <= reads);
+  printf("seektable:    at most %d window reads per seek\n", indexed_reads);
+
+  // Not FLAC
+  {
+    Bytes wav = wav_stream(1000);
+    MemReader  reader(wav);
+    MetaWindow window(reader, window_buf, sizeof(window_buf));
+    SeekTarget st;
+    CHECK(!flac_seek(window, 0, st));
+
+    // WAV: straight arithmetic, clamped to the length
+    CHECK(riff_seek(window, 123, st));
+    CHECK(st.offset == 44 + 123 * 4 && st.sample == 123);
+    CHECK(riff_seek(window, 5000, st));
+    CHECK(st.sample == 1000);
+  }
+
+  // Frame header checks: the CRC-8 rejects a corrupted header
+  {
+    Bytes flac = flac_stream(2, 100);
+    FlacFrame f;
+    CHECK(flac_parse_frame_header(&flac[42 + 100], TEST_FLAC_BLOCK, f));
+    CHECK(f.sample == TEST_FLAC_BLOCK && f.block == TEST_FLAC_BLOCK);
+    flac[42 + 100 + 4] ^= 0x01;
+    CHECK(!flac_parse_frame_header(&flac[42 + 100], TEST_FLAC_BLOCK, f));
+  }
+
+  return uta_test_result();
+}
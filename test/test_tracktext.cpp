@@ -0,0 +1,84 @@
+#include <stdlib.h>
+#include <new>
+#include "uta_TrackText.h"
+#include "uta_test.h"
+
+// Every heap allocation in this program goes through here
+static size_t allocations = 0;
+void* operator new(size_t n) {
+  allocations++;
+  void* p = malloc(n ? n : 1);
+  if (!p) throw std::bad_alloc();
+  return p;
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+// Stand-in for the player's Metadata: text plus plain fields
+struct Track {
+  TrackText text;
+  float     duration = 0.0f;
+};
+
+static bool valid_utf8(const char* s) {
+  for (size_t i = 0, n = strlen(s); i < n; ) {
+    uint8_t c = (uint8_t)s[i];
+    size_t k = c < 0x80 ? 1 : (c >> 5) == 6 ? 2 : (c >> 4) == 14 ? 3 : (c >> 3) == 30 ? 4 : 0;
+    if (k == 0 || i + k > n) return false;
+    for (size_t j = 1; j < k; j++) {
+      if (((uint8_t)s[i + j] & 0xC0) != 0x80) return false;
+    }
+    i += k;
+  }
+  return true;
+}
+
+int main() {
+  // Staging and switching tracks with over-long multibyte titles: no heap,
+  // and every cut lands on a code point boundary within the field
+  Track current, staged;
+  char title[300];
+  size_t before = allocations;
+  bool cuts_ok = true;
+  for (int i = 0; i < 1000; i++) {
+    int n = snprintf(title, sizeof(title), "Track %d ", i);
+    while (n + 3 < (int)sizeof(title)) {        // U+3042, three bytes each
+      title[n++] = (char)0xE3;
+      title[n++] = (char)0x81;
+      title[n++] = (char)0x82;
+    }
+    title[n] = '\0';
+    staged.text.set(TrackText::TITLE, title, n);
+    staged.text.set(TrackText::ARTIST, "\xC3\x84rtist");
+    staged.duration = (float)i;
+    current = staged;
+    staged  = Track{};
+
+    const char* t = current.text.get(TrackText::TITLE);
+    cuts_ok &= strlen(t) < TRACK_TITLE_BYTES && strlen(t) + 3 >= TRACK_TITLE_BYTES && valid_utf8(t);
+  }
+  CHECK(allocations == before);
+  CHECK(cuts_ok);
+  CHECK(strcmp(current.text.get(TrackText::ARTIST), "\xC3\x84rtist") == 0);
+  CHECK(current.duration == 999.0f);
+  CHECK(staged.text.empty(TrackText::TITLE));
+
+  // Fields do not bleed into each other when full
+  TrackText t;
+  char full[400];
+  memset(full, 'x', sizeof(full));
+  t.set(TrackText::TITLE, full, sizeof(full));
+  t.set(TrackText::ARTIST, full, sizeof(full));
+  t.set(TrackText::ALBUM, "Album");
+  CHECK(strlen(t.get(TrackText::TITLE)) == TRACK_TITLE_BYTES - 1);
+  CHECK(strlen(t.get(TrackText::ARTIST)) == TRACK_ARTIST_BYTES - 1);
+  CHECK(strcmp(t.get(TrackText::ALBUM), "Album") == 0);
+
+  t.set(TrackText::ARTIST, nullptr);
+  CHECK(t.empty(TrackText::ARTIST));
+  CHECK(strlen(t.get(TrackText::TITLE)) == TRACK_TITLE_BYTES - 1);
+  t.clear();
+  CHECK(t.empty(TrackText::TITLE) && t.empty(TrackText::ALBUM));
+
+  return uta_test_result();
+}
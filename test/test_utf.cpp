@@ -0,0 +1,152 @@
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include "uta_Utf.h"
+#include "uta_test.h"
+
+static void put_utf16(std::vector<uint8_t>& out, uint32_t cp, bool little_endian) {
+  auto unit = [&](uint16_t u) {
+    out.push_back(little_endian ? u & 0xFF : u >> 8);
+    out.push_back(little_endian ? u >> 8 : u & 0xFF);
+  };
+  if (cp >= 0x10000) {
+    cp -= 0x10000;
+    unit(0xD800 + (cp >> 10));
+    unit(0xDC00 + (cp & 0x3FF));
+  } else {
+    unit(cp);
+  }
+}
+
+static std::string utf16(const uint8_t* p, size_t n, bool little_endian, size_t cap = 64) {
+  char out[256];
+  return std::string(out, utf16_to_utf8(p, n, little_endian, out, cap));
+}
+
+// The unit-at-a-time loop utf16_to_utf8() replaced (surrogates were not
+// paired), kept as the speed reference
+static size_t old_put_utf8(char* out, size_t pos, size_t cap, uint32_t cp) {
+  if (cp < 0x80) {
+    if (pos + 1 > cap) return pos;
+    out[pos++] = (char)cp;
+  } else if (cp < 0x800) {
+    if (pos + 2 > cap) return pos;
+    out[pos++] = (char)(0xC0 | (cp >> 6));
+    out[pos++] = (char)(0x80 | (cp & 0x3F));
+  } else {
+    if (pos + 3 > cap) return pos;
+    out[pos++] = (char)(0xE0 | (cp >> 12));
+    out[pos++] = (char)(0x80 | ((cp >> 6) & 0x3F));
+    out[pos++] = (char)(0x80 | (cp & 0x3F));
+  }
+  return pos;
+}
+
+static size_t old_utf16_to_utf8(const uint8_t* p, size_t avail, bool little_endian, char* out, size_t cap) {
+  size_t pos = 0;
+  for (size_t i = 0; i + 1 < avail; i += 2) {
+    uint16_t ch = little_endian ? (p[i + 1] << 8 | p[i]) : (p[i] << 8 | p[i + 1]);
+    if (ch == 0) break;
+    pos = old_put_utf8(out, pos, cap, ch);
+  }
+  return pos;
+}
+
+int main() {
+  // Random mixed-script strings in both byte orders and at every output
+  // cap: the result is the longest whole-code-point prefix that fits
+  std::mt19937 rng(1);
+  int mismatches = 0;
+  for (int t = 0; t < 20000; t++) {
+    bool little_endian = rng() & 1;
+    std::vector<uint8_t> src;
+    std::string want_all;
+    std::vector<size_t> ends;            // byte length after each code point
+    int count = rng() % 60;
+    for (int k = 0; k < count; k++) {
+      uint32_t cp;
+      int kind = rng() % 10;
+      if      (kind < 5) cp = 0x20 + rng() % 0x5F;             // ASCII
+      else if (kind < 6) cp = 0x80 + rng() % 0x780;            // two bytes
+      else if (kind < 9) cp = 0x3040 + rng() % 0x6000;         // kana, CJK
+      else               cp = 0x10000 + rng() % 0xFFFFF;       // surrogate pair
+      if (cp >= 0xD800 && cp < 0xE000) cp = 0x4E00;
+      put_utf16(src, cp, little_endian);
+      char b[4];
+      want_all.append(b, utf8_put(b, 0, 4, cp));
+      ends.push_back(want_all.size());
+    }
+
+    size_t cap = rng() % 300;
+    size_t keep = 0;
+    for (size_t e : ends) {
+      if (e <= cap) keep = e;
+    }
+    char out[512];
+    size_t got = utf16_to_utf8(src.data(), src.size(), little_endian, out, cap);
+    mismatches += std::string(out, got) != want_all.substr(0, keep);
+  }
+  CHECK(mismatches == 0);
+
+  // Unpaired surrogates become U+FFFD; a NUL unit ends the text
+  const uint8_t lone[] = { 0x00, 0xD8, 'A', 0x00, 0x00, 0xDC, 'B', 0x00, 0, 0, 'C', 0 };
+  CHECK(utf16(lone, sizeof(lone), true) == "\xEF\xBF\xBD" "A" "\xEF\xBF\xBD" "B");
+  const uint8_t high_last[] = { 'x', 0x00, 0x3D, 0xD8 };
+  CHECK(utf16(high_last, sizeof(high_last), true) == "x\xEF\xBF\xBD");
+
+  // Big-endian emoji, and a pair that does not fit is dropped whole
+  const uint8_t emoji[] = { 0xD8, 0x3D, 0xDE, 0x00, 0x00, 'h' };
+  CHECK(utf16(emoji, sizeof(emoji), false) == "\xF0\x9F\x98\x80h");
+  CHECK(utf16(emoji, sizeof(emoji), false, 3).empty());
+
+  // Long ASCII and kana runs take the SWAR paths and still cut cleanly
+  std::vector<uint8_t> run;
+  std::string ascii;
+  for (int k = 0; k < 40; k++) {
+    put_utf16(run, 'a' + k % 26, true);
+    ascii += (char)('a' + k % 26);
+  }
+  CHECK(utf16(run.data(), run.size(), true, 100) == ascii);
+  CHECK(utf16(run.data(), run.size(), true, 17) == ascii.substr(0, 17));
+  run.clear();
+  for (int k = 0; k < 40; k++) put_utf16(run, 0x3042, true);
+  std::string kana = utf16(run.data(), run.size(), true, 200);
+  CHECK(kana.size() == 120);
+  CHECK(utf16(run.data(), run.size(), true, 50).size() == 48);
+
+  // ISO-8859-1 and UTF-8 input
+  char out[64];
+  const uint8_t latin[] = { 'c', 'a', 'f', 0xE9, ' ', 'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 0, 'x' };
+  CHECK(std::string(out, latin1_to_utf8(latin, sizeof(latin), out, sizeof(out))) == "caf\xC3\xA9 abcdefgh");
+  CHECK(latin1_to_utf8(latin, sizeof(latin), out, 4) == 3);    // no half of U+00E9
+  const uint8_t utf8[] = { 'a', 0xE3, 0x81, 0x82, 'b' };
+  CHECK(utf8_copy(utf8, sizeof(utf8), out, 3) == 1);
+  CHECK(utf8_copy(utf8, sizeof(utf8), out, 4) == 4);
+  CHECK(utf8_fit("\xC3\xA9\xC3\xA9", 4, 4) == 2);
+
+  // Cost per 200-unit title, against the old loop
+  for (int kind = 0; kind < 2; kind++) {
+    std::vector<uint8_t> v;
+    for (int k = 0; k < 200; k++) put_utf16(v, kind ? 0x3042 + k % 80 : 'A' + k % 26, true);
+    char buf[1024], old[1024];
+    CHECK(std::string(buf, utf16_to_utf8(v.data(), v.size(), true, buf, sizeof(buf))) ==
+          std::string(old, old_utf16_to_utf8(v.data(), v.size(), true, old, sizeof(old))));
+
+    const int rounds = 20000;
+    size_t sink = 0;
+    auto time = [&](size_t (*convert)(const uint8_t*, size_t, bool, char*, size_t)) {
+      auto t0 = std::chrono::steady_clock::now();
+      for (int r = 0; r < rounds; r++) {
+        sink += convert(v.data(), v.size(), true, buf, sizeof(buf));
+        asm volatile("" : : "r"(buf) : "memory");
+      }
+      return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count() / rounds;
+    };
+    double ns = time(utf16_to_utf8), old_ns = time(old_utf16_to_utf8);
+    printf("%s: %.0f ns, old loop %.0f ns per 200 units (%zu)\n", kind ? "kana " : "ascii", ns, old_ns,
+           sink / rounds / 2);
+  }
+
+  return uta_test_result();
+}
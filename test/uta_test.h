@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdio.h>
+
+// Minimal check macro for the host tests: reports every failure and makes
+// main() return non-zero through uta_test_result().
+static int uta_test_failures = 0;
+
+#define CHECK(cond)                                                     \
+  do {                                                                  \
+    if (!(cond)) {                                                      \
+      printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond);   \
+      uta_test_failures++;                                              \
+    }                                                                   \
+  } while (0)
+
+static inline int uta_test_result() {
+  if (uta_test_failures) printf("%d check(s) failed\n", uta_test_failures);
+  else                   printf("ok\n");
+  return uta_test_failures ? 1 : 0;
+}
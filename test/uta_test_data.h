@@ -0,0 +1,137 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include "uta_Seek.h"
+
+// In-memory files for the parser, probe and seek tests.
+
+typedef std::vector<uint8_t> Bytes;
+
+class MemReader : public MetaReader {
+public:
+  explicit MemReader(const Bytes& data) : data(data) {}
+
+  size_t read_at(uint64_t offset, uint8_t* dst, size_t len) override {
+    if (offset >= data.size()) return 0;
+    if (offset + len > data.size()) len = data.size() - offset;
+    memcpy(dst, data.data() + offset, len);
+    return len;
+  }
+  uint64_t size() override { return data.size(); }
+
+private:
+  const Bytes& data;
+};
+
+inline void put_be(Bytes& out, uint64_t v, int bytes) {
+  for (int i = bytes - 1; i >= 0; i--) out.push_back((uint8_t)(v >> (i * 8)));
+}
+
+inline void put_le(Bytes& out, uint64_t v, int bytes) {
+  for (int i = 0; i < bytes; i++) out.push_back((uint8_t)(v >> (i * 8)));
+}
+
+inline void put_str(Bytes& out, const char* s) {
+  out.insert(out.end(), s, s + strlen(s));
+}
+
+inline void put_syncsafe(Bytes& out, uint32_t v) {
+  for (int shift = 21; shift >= 0; shift -= 7) out.push_back((v >> shift) & 0x7F);
+}
+
+// One ID3v2.4 frame
+inline Bytes id3_frame(const char* id, const Bytes& body) {
+  Bytes out;
+  put_str(out, id);
+  put_syncsafe(out, body.size());
+  out.push_back(0);
+  out.push_back(0);
+  out.insert(out.end(), body.begin(), body.end());
+  return out;
+}
+
+// ID3v2.4 tag holding `frames` followed by `padding` zero bytes
+inline Bytes id3_tag(uint32_t padding, const Bytes& frames = Bytes()) {
+  Bytes out = { 'I', 'D', '3', 4, 0, 0 };    // v2.4, no flags
+  put_syncsafe(out, frames.size() + padding);
+  out.insert(out.end(), frames.begin(), frames.end());
+  out.resize(out.size() + padding, 0);
+  return out;
+}
+
+#define TEST_FLAC_BLOCK  4096
+#define TEST_RATE        44100
+
+// One FLAC metadata block: header and body
+inline Bytes flac_block(uint8_t type, const Bytes& body, bool last) {
+  Bytes out;
+  out.push_back((last ? 0x80 : 0) | type);
+  put_be(out, body.size(), 3);
+  out.insert(out.end(), body.begin(), body.end());
+  return out;
+}
+
+// "fLaC", STREAMINFO, then `metadata` (whole blocks, the final one marked
+// last) and `frames` fixed-size frames of `frame_bytes` each. Frame bodies
+// never contain 0xFF, so the only sync codes are real headers.
+inline Bytes flac_stream(uint32_t frames, uint32_t frame_bytes, const Bytes& metadata = Bytes()) {
+  Bytes info;
+  put_be(info, TEST_FLAC_BLOCK, 2);         // min / max block size
+  put_be(info, TEST_FLAC_BLOCK, 2);
+  put_be(info, 0, 3);                       // min / max frame size
+  put_be(info, 0, 3);
+  uint64_t total = (uint64_t)frames * TEST_FLAC_BLOCK;
+  // 20-bit rate, 3-bit channels - 1, 5-bit bits - 1, 36-bit total samples
+  uint64_t packed = ((uint64_t)TEST_RATE << 44) | (1ull << 41) | (15ull << 36) | total;
+  put_be(info, packed, 8);
+  info.resize(info.size() + 16, 0);         // MD5
+
+  Bytes out;
+  put_str(out, "fLaC");
+  Bytes block = flac_block(0, info, metadata.empty());
+  out.insert(out.end(), block.begin(), block.end());
+  out.insert(out.end(), metadata.begin(), metadata.end());
+
+  for (uint32_t n = 0; n < frames; n++) {
+    size_t start = out.size();
+    out.push_back(0xFF);
+    out.push_back(0xF8);                    // fixed block size
+    out.push_back(0xC9);                    // 4096 samples, 44.1 kHz
+    out.push_back(0x18);                    // stereo, 16 bit
+    if      (n < 0x80)  out.push_back((uint8_t)n);
+    else if (n < 0x800) { out.push_back(0xC0 | (n >> 6)); out.push_back(0x80 | (n & 0x3F)); }
+    else                { out.push_back(0xE0 | (n >> 12)); out.push_back(0x80 | ((n >> 6) & 0x3F));
+                          out.push_back(0x80 | (n & 0x3F)); }
+    out.push_back(flac_crc8(out.data() + start, out.size() - start));
+    while (out.size() < start + frame_bytes) out.push_back((uint8_t)(0x11 + (out.size() % 0x60)));
+  }
+  return out;
+}
+
+// 16-bit stereo PCM WAV holding `frames` frames
+inline Bytes wav_stream(uint32_t frames) {
+  Bytes out;
+  uint32_t data_bytes = frames * 4;
+  put_str(out, "RIFF");
+  put_le(out, 36 + data_bytes, 4);
+  put_str(out, "WAVE");
+  put_str(out, "fmt ");
+  put_le(out, 16, 4);
+  put_le(out, 1, 2);                        // PCM
+  put_le(out, 2, 2);
+  put_le(out, TEST_RATE, 4);
+  put_le(out, TEST_RATE * 4, 4);
+  put_le(out, 4, 2);
+  put_le(out, 16, 2);
+  put_str(out, "data");
+  put_le(out, data_bytes, 4);
+  out.resize(out.size() + data_bytes, 0);
+  return out;
+}
+
+inline Bytes concat(Bytes a, const Bytes& b) {
+  a.insert(a.end(), b.begin(), b.end());
+  return a;
+}